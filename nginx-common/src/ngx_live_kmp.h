@@ -100,6 +100,8 @@ enum {
     KMP_CODEC_VIDEO_H264            = 7,
 
     KMP_CODEC_VIDEO_H265            = 8,
+    KMP_CODEC_VIDEO_VP9             = 9,
+    KMP_CODEC_VIDEO_AV1             = 10,
 
     /* NGX_RTMP_AUDIO_XXX + 1000 */
     KMP_CODEC_AUDIO_BASE            = 1000,
@@ -23,7 +23,7 @@ IGNORE_FUNCS = set([
     'ngx_live_preset_names',
     'ngx_live_segmenter_kf_list_dump',
     'ngx_live_segmenter_dump_track',
-    'ngx_http_pckg_capture_init_frame_processor',
+    'ngx_http_pckg_capture_init_process',
     'ngx_http_complex_value_flag',
     'ngx_http_complex_value_percent',
     'ngx_http_pckg_extract_string',
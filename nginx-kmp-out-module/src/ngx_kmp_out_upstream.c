@@ -14,6 +14,8 @@
 
 static void ngx_kmp_out_upstream_read_handler(ngx_event_t *rev);
 static void ngx_kmp_out_upstream_write_handler(ngx_event_t *wev);
+static ngx_int_t ngx_kmp_out_upstream_skip_to_frame(ngx_kmp_out_upstream_t *u,
+    uint64_t frame_id);
 
 
 typedef struct {
@@ -426,6 +428,16 @@ ngx_kmp_out_upstream_from_json(ngx_pool_t *temp_pool,
         return NGX_ABORT;
     }
 
+    if (json.initial_frame_id >= 0
+        && ngx_kmp_out_upstream_skip_to_frame(u, json.initial_frame_id)
+           != NGX_OK)
+    {
+        ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+            "ngx_kmp_out_upstream_from_json: skip to frame failed");
+        ngx_kmp_out_upstream_free(u);
+        return NGX_ABORT;
+    }
+
     if (ngx_kmp_out_upstream_connect(u, &url.addrs[0]) != NGX_OK) {
         ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
             "ngx_kmp_out_upstream_from_json: connect failed");
@@ -435,6 +447,7 @@ ngx_kmp_out_upstream_from_json(ngx_pool_t *temp_pool,
 
     u->required = json.required != 0;   /* enabled by default */
     ngx_json_set_uint_value(u->resume_from, json.resume_from);
+    ngx_json_set_value(u->max_unacked_bytes, json.max_unacked_bytes);
 
     return NGX_OK;
 }
@@ -569,6 +582,18 @@ ngx_kmp_out_upstream_republish_handle(ngx_pool_t *temp_pool, void *arg,
         goto retry;
     }
 
+    ngx_json_set_value(u->max_unacked_bytes, json.max_unacked_bytes);
+
+    if (json.initial_frame_id >= 0
+        && ngx_kmp_out_upstream_skip_to_frame(u, json.initial_frame_id)
+           != NGX_OK)
+    {
+        ngx_log_error(NGX_LOG_NOTICE, temp_pool->log, 0,
+            "ngx_kmp_out_upstream_republish_handle: skip to frame failed");
+        ngx_kmp_out_upstream_free_notify(u);
+        return NGX_OK;
+    }
+
     if (ngx_kmp_out_upstream_connect(u, &url.addrs[0]) != NGX_OK) {
         ngx_log_error(NGX_LOG_NOTICE, temp_pool->log, 0,
             "ngx_kmp_out_upstream_republish_handle: connect failed");
@@ -918,6 +943,10 @@ ngx_kmp_out_upstream_auto_ack(ngx_kmp_out_upstream_t *u, size_t left,
 
         if (kmp_header.packet_type == KMP_PACKET_FRAME) {
             u->auto_acked_frames++;
+
+            if (force) {
+                u->evicted_frames++;
+            }
         }
 
         size = kmp_header.header_size + kmp_header.data_size;
@@ -938,6 +967,68 @@ done:
 }
 
 
+static ngx_int_t
+ngx_kmp_out_upstream_skip_to_frame(ngx_kmp_out_upstream_t *u,
+    uint64_t frame_id)
+{
+    off_t                limit;
+    ngx_int_t            rc;
+    uint64_t             start;
+    kmp_packet_header_t  kmp_header;
+
+    /* Note: the kmp headers are walked, and not skipped by frame index,
+        so that media info packets are saved along the way */
+
+    if (frame_id < u->acked_frame_id) {
+        ngx_log_error(NGX_LOG_WARN, &u->log, 0,
+            "ngx_kmp_out_upstream_skip_to_frame: "
+            "frame %uL was already released, resuming from %uL",
+            frame_id, u->acked_frame_id);
+        return NGX_OK;
+    }
+
+    start = u->acked_frame_id;
+    limit = u->track->stats.last_frame_written;
+
+    while (u->acked_frame_id < frame_id) {
+
+        rc = ngx_kmp_out_upstream_read_packet(u, &kmp_header, limit);
+        if (rc == NGX_DECLINED) {
+            ngx_log_error(NGX_LOG_WARN, &u->log, 0,
+                "ngx_kmp_out_upstream_skip_to_frame: "
+                "frame %uL was not written yet, resuming from %uL",
+                frame_id, u->acked_frame_id);
+            break;
+        }
+
+        if (rc != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        rc = ngx_kmp_out_upstream_ack_packet(u, &kmp_header);
+        if (rc == NGX_DONE) {
+            break;
+        }
+
+        if (rc != NGX_OK) {
+            ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+                "ngx_kmp_out_upstream_skip_to_frame: ack packet failed");
+            u->no_republish = 1;
+            return NGX_ERROR;
+        }
+    }
+
+    u->skipped_frames += u->acked_frame_id - start;
+
+    ngx_log_error(NGX_LOG_INFO, &u->log, 0,
+        "ngx_kmp_out_upstream_skip_to_frame: "
+        "skipped %uL frames, resuming from %uL",
+        u->acked_frame_id - start, u->acked_frame_id);
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_kmp_out_upstream_ack_frames(ngx_kmp_out_upstream_t *u)
 {
@@ -1206,9 +1297,12 @@ ngx_kmp_out_upstream_send_buffered(ngx_kmp_out_upstream_t *u)
 {
     u_char                *end;
     u_char                *start;
+    off_t                  replayed;
+    uint64_t               acked_frames;
     ngx_pool_t            *pool = u->pool;
     ngx_chain_t           *cl;
     ngx_connection_t      *c;
+    ngx_kmp_out_track_t   *track = u->track;
     ngx_buf_queue_node_t  *cur;
 
     c = u->peer.connection;
@@ -1226,7 +1320,7 @@ ngx_kmp_out_upstream_send_buffered(ngx_kmp_out_upstream_t *u)
     ngx_json_str_set_escape(&u->local_addr);
 
     /* connect header */
-    u->connect = u->track->connect;
+    u->connect = track->connect;
     u->connect.header.data_size = u->connect_data.last - u->connect_data.start;
     u->connect.c.initial_frame_id = u->acked_frame_id;
     u->connect.c.initial_upstream_frame_id = u->acked_upstream_frame_id;
@@ -1276,15 +1370,17 @@ ngx_kmp_out_upstream_send_buffered(ngx_kmp_out_upstream_t *u)
     }
 
     /* media info / frames */
+    replayed = 0;
+
     for (cur = u->acked_reader.node; cur; cur = ngx_buf_queue_next(cur)) {
 
         start = ngx_buf_queue_start(cur);
 
-        if (start == u->track->active_buf.start) {
-            end = u->track->active_buf.pos;
+        if (start == track->active_buf.start) {
+            end = track->active_buf.pos;
 
         } else {
-            end = ngx_buf_queue_end(&u->track->buf_queue, cur);
+            end = ngx_buf_queue_end(&track->buf_queue, cur);
         }
 
         if (cur == u->acked_reader.node) {
@@ -1304,10 +1400,26 @@ ngx_kmp_out_upstream_send_buffered(ngx_kmp_out_upstream_t *u)
 
         *u->last = cl;
         u->last = &cl->next;
+
+        replayed += end - start;
     }
 
     *u->last = NULL;
 
+    if (u->connects++ > 0) {
+        acked_frames = u->acked_frame_id - track->connect.c.initial_frame_id;
+
+        u->replays++;
+        u->replayed_bytes += replayed;
+        if (track->stats.sent_frames > acked_frames) {
+            u->replayed_frames += track->stats.sent_frames - acked_frames;
+        }
+
+        ngx_log_error(NGX_LOG_INFO, &u->log, 0,
+            "ngx_kmp_out_upstream_send_buffered: "
+            "replaying %O bytes from frame %uL", replayed, u->acked_frame_id);
+    }
+
     return NGX_OK;
 }
 
@@ -1365,9 +1477,28 @@ ngx_int_t
 ngx_kmp_out_upstream_append_buffer(ngx_kmp_out_upstream_t *u,
     ngx_buf_t *active_buf)
 {
+    off_t         unacked;
     ngx_buf_t    *b;
     ngx_chain_t  *cl;
 
+    if (u->max_unacked_bytes > 0) {
+        unacked = (off_t) u->track->stats.written - u->acked_bytes;
+        if (unacked > u->max_unacked_bytes) {
+            ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+                "ngx_kmp_out_upstream_append_buffer: "
+                "unacked bytes %O exceed limit %O, evicting frames",
+                unacked, u->max_unacked_bytes);
+
+            if (ngx_kmp_out_upstream_auto_ack(u,
+                unacked - u->max_unacked_bytes, 1) < 0)
+            {
+                ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+                    "ngx_kmp_out_upstream_append_buffer: auto ack failed");
+                return NGX_ERROR;
+            }
+        }
+    }
+
     if (!u->last) {
 
         if (u->resume_from == ngx_kmp_out_resume_from_last_written) {
@@ -1392,6 +1523,21 @@ ngx_kmp_out_upstream_append_buffer(ngx_kmp_out_upstream_t *u,
         return NGX_OK;
     }
 
+    if (u->last != &u->busy) {
+
+        /* the data is shared by all upstreams, when it continues the last
+            pending buffer, extend it instead of adding a link per flush */
+
+        cl = (ngx_chain_t *) ((u_char *) u->last
+            - offsetof(ngx_chain_t, next));
+        b = cl->buf;
+
+        if (b->last == active_buf->pos) {
+            b->end = b->last = active_buf->last;
+            return NGX_OK;
+        }
+    }
+
     cl = u->free;
     if (cl != NULL) {
         u->free = cl->next;
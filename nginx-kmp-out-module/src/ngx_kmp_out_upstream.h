@@ -58,7 +58,15 @@ typedef struct {
     off_t                        acked_bytes;
     off_t                        sent_base;
     ngx_uint_t                   auto_acked_frames;
+    ngx_uint_t                   evicted_frames;
+    ngx_uint_t                   skipped_frames;
     ngx_kmp_out_resume_from_e    resume_from;
+    off_t                        max_unacked_bytes;
+
+    ngx_uint_t                   connects;
+    ngx_uint_t                   replays;
+    ngx_uint_t                   replayed_frames;
+    off_t                        replayed_bytes;
 
     unsigned                     required:1;
     unsigned                     sent_end:1;
@@ -20,6 +20,8 @@ typedef struct {
     ngx_flag_t  required;
     ngx_uint_t  resume_from;
     ngx_str_t   connect_data;
+    int64_t     initial_frame_id;
+    int64_t     max_unacked_bytes;
 } ngx_kmp_out_upstream_json_t;
 
 
@@ -73,14 +75,41 @@ static ngx_json_prop_t  ngx_kmp_out_upstream_json_connect_data = {
 };
 
 
+static ngx_json_prop_t  ngx_kmp_out_upstream_json_initial_frame_id = {
+    ngx_string("initial_frame_id"),
+    9997495207610514376ULL,
+    NGX_JSON_INT,
+    ngx_json_set_num_slot,
+    offsetof(ngx_kmp_out_upstream_json_t, initial_frame_id),
+    NULL
+};
+
+
+static ngx_json_prop_t  ngx_kmp_out_upstream_json_max_unacked_bytes = {
+    ngx_string("max_unacked_bytes"),
+    1517475387613912192ULL,
+    NGX_JSON_INT,
+    ngx_json_set_num_slot,
+    offsetof(ngx_kmp_out_upstream_json_t, max_unacked_bytes),
+    NULL
+};
+
+
 static ngx_json_prop_t  *ngx_kmp_out_upstream_json[] = {
-    &ngx_kmp_out_upstream_json_required,
     NULL,
-    &ngx_kmp_out_upstream_json_id,
-    &ngx_kmp_out_upstream_json_connect_data,
     NULL,
+    NULL,
+    &ngx_kmp_out_upstream_json_connect_data,
+    &ngx_kmp_out_upstream_json_max_unacked_bytes,
     &ngx_kmp_out_upstream_json_url,
     &ngx_kmp_out_upstream_json_resume_from,
+    &ngx_kmp_out_upstream_json_required,
+    NULL,
+    &ngx_kmp_out_upstream_json_id,
+    &ngx_kmp_out_upstream_json_initial_frame_id,
+    NULL,
+    NULL,
+    NULL,
 };
 
 
@@ -146,6 +175,12 @@ ngx_kmp_out_upstream_json_get_size(ngx_kmp_out_upstream_t *obj)
         sizeof(",\"acked_frames\":") - 1 + NGX_INT64_LEN +
         sizeof(",\"acked_bytes\":") - 1 + NGX_OFF_T_LEN +
         sizeof(",\"auto_acked_frames\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"evicted_frames\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"skipped_frames\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"max_unacked_bytes\":") - 1 + NGX_OFF_T_LEN +
+        sizeof(",\"replays\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"replayed_frames\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"replayed_bytes\":") - 1 + NGX_OFF_T_LEN +
         sizeof("}") - 1;
 
     return result;
@@ -186,6 +221,18 @@ ngx_kmp_out_upstream_json_write(u_char *p, ngx_kmp_out_upstream_t *obj)
     p = ngx_sprintf(p, "%O", (off_t) obj->acked_bytes);
     p = ngx_copy_fix(p, ",\"auto_acked_frames\":");
     p = ngx_sprintf(p, "%ui", (ngx_uint_t) obj->auto_acked_frames);
+    p = ngx_copy_fix(p, ",\"evicted_frames\":");
+    p = ngx_sprintf(p, "%ui", (ngx_uint_t) obj->evicted_frames);
+    p = ngx_copy_fix(p, ",\"skipped_frames\":");
+    p = ngx_sprintf(p, "%ui", (ngx_uint_t) obj->skipped_frames);
+    p = ngx_copy_fix(p, ",\"max_unacked_bytes\":");
+    p = ngx_sprintf(p, "%O", (off_t) obj->max_unacked_bytes);
+    p = ngx_copy_fix(p, ",\"replays\":");
+    p = ngx_sprintf(p, "%ui", (ngx_uint_t) obj->replays);
+    p = ngx_copy_fix(p, ",\"replayed_frames\":");
+    p = ngx_sprintf(p, "%ui", (ngx_uint_t) obj->replayed_frames);
+    p = ngx_copy_fix(p, ",\"replayed_bytes\":");
+    p = ngx_sprintf(p, "%O", (off_t) obj->replayed_bytes);
     *p++ = '}';
 
     return p;
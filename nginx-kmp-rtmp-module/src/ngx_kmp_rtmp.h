@@ -37,6 +37,7 @@ typedef struct {
     ngx_msec_t       write_meta_timeout;
     ngx_msec_t       min_process_delay;
     ngx_msec_t       max_process_delay;
+    size_t           drop_threshold;
     ngx_msec_t       onfi_period;
 
     ngx_str_t        dump_folder;
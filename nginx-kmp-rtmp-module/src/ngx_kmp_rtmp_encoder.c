@@ -1038,7 +1038,8 @@ ngx_kmp_rtmp_encoder_onfi_write(u_char *p, ngx_kmp_rtmp_stream_ctx_t *sc,
 ngx_int_t
 ngx_kmp_rtmp_encoder_frame_write(ngx_kmp_rtmp_stream_ctx_t *sc,
     ngx_kmp_rtmp_frame_t *frame, uint32_t codec_id,
-    ngx_kmp_rtmp_write_pt write, void *data)
+    ngx_kmp_rtmp_write_pt write, ngx_kmp_rtmp_write_pt write_ref,
+    void *data)
 {
     size_t                  chunk_left;
     size_t                  header_size;
@@ -1131,7 +1132,7 @@ ngx_kmp_rtmp_encoder_frame_write(ngx_kmp_rtmp_stream_ctx_t *sc,
     for ( ;; ) {
 
         if (chain.size > chunk_left) {
-            rc = write(data, chain.data, chunk_left);
+            rc = write_ref(data, chain.data, chunk_left);
             if (rc != NGX_OK) {
                 ngx_log_error(NGX_LOG_NOTICE, sc->log, 0,
                     "ngx_kmp_rtmp_encoder_frame_write: "
@@ -1154,7 +1155,7 @@ ngx_kmp_rtmp_encoder_frame_write(ngx_kmp_rtmp_stream_ctx_t *sc,
             continue;
         }
 
-        rc = write(data, chain.data, chain.size);
+        rc = write_ref(data, chain.data, chain.size);
         if (rc != NGX_OK) {
             ngx_log_error(NGX_LOG_NOTICE, sc->log, 0,
                 "ngx_kmp_rtmp_encoder_frame_write: write failed %i (4)", rc);
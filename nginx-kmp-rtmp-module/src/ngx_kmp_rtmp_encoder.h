@@ -113,8 +113,14 @@ size_t ngx_kmp_rtmp_encoder_onfi_get_size(ngx_kmp_rtmp_stream_ctx_t *sc,
 u_char *ngx_kmp_rtmp_encoder_onfi_write(u_char *p,
     ngx_kmp_rtmp_stream_ctx_t *sc, ngx_kmp_rtmp_onfi_t *onfi);
 
+/*
+ * write - called with the rtmp headers, the buffer can be reused on return
+ * write_ref - called with the frame payload, the buffer remains valid until
+ *      the frame is released
+ */
 ngx_int_t ngx_kmp_rtmp_encoder_frame_write(ngx_kmp_rtmp_stream_ctx_t *sc,
     ngx_kmp_rtmp_frame_t *frame, uint32_t codec_id,
-    ngx_kmp_rtmp_write_pt write, void *data);
+    ngx_kmp_rtmp_write_pt write, ngx_kmp_rtmp_write_pt write_ref,
+    void *data);
 
 #endif /* _NGX_KMP_RTMP_ENCODER_H_INCLUDED_ */
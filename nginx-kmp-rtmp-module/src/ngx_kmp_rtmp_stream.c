@@ -330,7 +330,8 @@ ngx_kmp_rtmp_stream_write_frame(ngx_kmp_rtmp_stream_t *stream,
     u = stream->upstream;
 
     rc = ngx_kmp_rtmp_encoder_frame_write(&stream->ctx, frame,
-        codec_id, ngx_kmp_rtmp_upstream_write, u);
+        codec_id, ngx_kmp_rtmp_upstream_write, ngx_kmp_rtmp_upstream_write_ref,
+        u);
     if (rc != NGX_OK) {
         return rc;
     }
@@ -35,6 +35,14 @@ struct ngx_kmp_rtmp_frame_part_s {
 };
 
 
+typedef struct {
+    ngx_buf_chain_t            *chain;
+    u_char                     *pos;
+    u_char                     *last;
+    size_t                      left;
+} ngx_kmp_rtmp_nal_reader_t;
+
+
 typedef struct {
     ngx_pool_t                 *pool;
     size_t                     *mem_left;
@@ -58,13 +66,20 @@ struct ngx_kmp_rtmp_track_s {
 
     ngx_kmp_in_ctx_t           *input;
     ngx_buf_queue_t             buf_queue;
+    ngx_uint_t                  refs;       /* buffers pending send */
 
     uint32_t                    media_type;
     kmp_media_info_t            media_info;
     ngx_str_t                   extra_data;
     size_t                      extra_data_size;
+    ngx_uint_t                  nal_length_size;
 
     ngx_kmp_rtmp_frame_list_t   frames;
+
+    ngx_uint_t                  dropped_frames;
+    size_t                      dropped_bytes;
+
+    unsigned                    skip_gop:1;
 };
 
 
@@ -400,6 +415,40 @@ ngx_kmp_rtmp_track_get_media_info(ngx_kmp_rtmp_track_t *track,
 }
 
 
+static void
+ngx_kmp_rtmp_track_init_nal_length_size(ngx_kmp_rtmp_track_t *track)
+{
+    u_char  *p;
+    size_t   len;
+
+    p = track->extra_data.data;
+    len = track->extra_data.len;
+
+    switch (track->media_info.codec_id) {
+
+    case KMP_CODEC_VIDEO_H264:
+        /* AVCDecoderConfigurationRecord.lengthSizeMinusOne */
+        if (len >= 5) {
+            track->nal_length_size = (p[4] & 0x03) + 1;
+            return;
+        }
+
+        break;
+
+    case KMP_CODEC_VIDEO_H265:
+        /* HEVCDecoderConfigurationRecord.lengthSizeMinusOne */
+        if (len >= 22) {
+            track->nal_length_size = (p[21] & 0x03) + 1;
+            return;
+        }
+
+        break;
+    }
+
+    track->nal_length_size = 0;
+}
+
+
 static ngx_int_t
 ngx_kmp_rtmp_track_add_media_info(void *data, ngx_kmp_in_evt_media_info_t *evt)
 {
@@ -428,6 +477,7 @@ ngx_kmp_rtmp_track_add_media_info(void *data, ngx_kmp_in_evt_media_info_t *evt)
     track->extra_data.len = evt->extra_data_size;
 
     if (evt->extra_data_size <= 0) {
+        track->nal_length_size = 0;
         return NGX_OK;
     }
 
@@ -445,6 +495,8 @@ ngx_kmp_rtmp_track_add_media_info(void *data, ngx_kmp_in_evt_media_info_t *evt)
         goto fatal;
     }
 
+    ngx_kmp_rtmp_track_init_nal_length_size(track);
+
     return NGX_OK;
 
 fatal:
@@ -522,6 +574,25 @@ ngx_kmp_rtmp_track_add_frame(void *data, ngx_kmp_in_evt_frame_t *evt)
 }
 
 
+static ngx_int_t
+ngx_kmp_rtmp_track_release_refs(ngx_kmp_rtmp_track_t *track)
+{
+    if (track->refs == 0) {
+        return NGX_OK;
+    }
+
+    if (ngx_kmp_rtmp_upstream_copy_refs(track->upstream, track) != NGX_OK) {
+        ngx_log_error(NGX_LOG_NOTICE, &track->log, 0,
+            "ngx_kmp_rtmp_track_release_refs: copy failed");
+        return NGX_ERROR;
+    }
+
+    track->refs = 0;
+
+    return NGX_OK;
+}
+
+
 static void
 ngx_kmp_rtmp_track_close(ngx_kmp_rtmp_track_t *track)
 {
@@ -530,10 +601,196 @@ ngx_kmp_rtmp_track_close(ngx_kmp_rtmp_track_t *track)
 
     ngx_kmp_rtmp_stream_detach_track(track->stream, track->media_type);
 
+    if (ngx_kmp_rtmp_track_release_refs(track) != NGX_OK) {
+        ngx_kmp_rtmp_upstream_finalize(track->upstream, "copy_refs_failed");
+    }
+
     ngx_buf_queue_delete(&track->buf_queue);
 }
 
 
+void
+ngx_kmp_rtmp_track_add_ref(ngx_kmp_rtmp_track_t *track)
+{
+    track->refs++;
+}
+
+
+void
+ngx_kmp_rtmp_track_ref_sent(ngx_kmp_rtmp_track_t *track, u_char *last)
+{
+    track->refs--;
+
+    /* frames are sent in order, the data before 'last' is no longer used */
+    ngx_buf_queue_free(&track->buf_queue, last - 1);
+}
+
+
+static ngx_int_t
+ngx_kmp_rtmp_nal_reader_read(ngx_kmp_rtmp_nal_reader_t *r, u_char *dst,
+    size_t size)
+{
+    size_t  n;
+
+    if (size > r->left) {
+        return NGX_ERROR;
+    }
+
+    r->left -= size;
+
+    while (size > 0) {
+
+        while (r->pos >= r->last) {
+            r->chain = r->chain->next;
+            if (r->chain == NULL) {
+                return NGX_ERROR;
+            }
+
+            r->pos = r->chain->data;
+            r->last = r->pos + r->chain->size;
+        }
+
+        n = ngx_min(size, (size_t) (r->last - r->pos));
+
+        if (dst != NULL) {
+            dst = ngx_cpymem(dst, r->pos, n);
+        }
+
+        r->pos += n;
+        size -= n;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_flag_t
+ngx_kmp_rtmp_track_frame_disposable(ngx_kmp_rtmp_track_t *track,
+    ngx_kmp_rtmp_frame_t *frame)
+{
+    u_char                     buf[4];
+    uint32_t                   size;
+    ngx_uint_t                 i, type, vcl;
+    ngx_kmp_rtmp_nal_reader_t  r;
+
+    if (track->nal_length_size <= 0 || (frame->flags & KMP_FRAME_FLAG_KEY)) {
+        return 0;
+    }
+
+    r.chain = frame->data;
+    r.pos = r.chain->data;
+    r.last = r.pos + r.chain->size;
+    r.left = frame->size;
+
+    vcl = 0;
+
+    /* a frame is disposable if all its slices are non-reference */
+
+    while (r.left > 0) {
+
+        if (ngx_kmp_rtmp_nal_reader_read(&r, buf, track->nal_length_size)
+            != NGX_OK)
+        {
+            return 0;
+        }
+
+        size = 0;
+        for (i = 0; i < track->nal_length_size; i++) {
+            size = (size << 8) | buf[i];
+        }
+
+        if (size <= 0 || ngx_kmp_rtmp_nal_reader_read(&r, buf, 1) != NGX_OK) {
+            return 0;
+        }
+
+        switch (track->media_info.codec_id) {
+
+        case KMP_CODEC_VIDEO_H264:
+            type = buf[0] & 0x1f;
+            if (type >= 1 && type <= 5) {
+                if (buf[0] & 0x60) {    /* nal_ref_idc */
+                    return 0;
+                }
+
+                vcl = 1;
+            }
+
+            break;
+
+        case KMP_CODEC_VIDEO_H265:
+            type = (buf[0] >> 1) & 0x3f;
+            if (type < 32) {
+                /* sub-layer non-reference types are even, up to 14 */
+                if (type > 14 || (type & 1)) {
+                    return 0;
+                }
+
+                vcl = 1;
+            }
+
+            break;
+
+        default:
+            return 0;
+        }
+
+        if (ngx_kmp_rtmp_nal_reader_read(&r, NULL, size - 1) != NGX_OK) {
+            return 0;
+        }
+    }
+
+    return vcl;
+}
+
+
+static ngx_flag_t
+ngx_kmp_rtmp_track_drop_frame(ngx_kmp_rtmp_track_t *track,
+    ngx_kmp_rtmp_frame_t *frame)
+{
+    size_t                    pending, threshold;
+    ngx_kmp_rtmp_upstream_t  *u;
+
+    u = track->upstream;
+    threshold = u->conf.drop_threshold;
+
+    if (track->media_type != KMP_MEDIA_VIDEO || threshold <= 0) {
+        return 0;
+    }
+
+    pending = ngx_kmp_rtmp_upstream_backlog(u);
+
+    if (track->skip_gop) {
+        if (!(frame->flags & KMP_FRAME_FLAG_KEY) || pending >= threshold) {
+            return 1;
+        }
+
+        ngx_log_error(NGX_LOG_NOTICE, &track->log, 0,
+            "ngx_kmp_rtmp_track_drop_frame: "
+            "resuming on key frame, pending: %uz", pending);
+
+        track->skip_gop = 0;
+        return 0;
+    }
+
+    if (pending >= 2 * threshold) {
+        ngx_log_error(NGX_LOG_NOTICE, &track->log, 0,
+            "ngx_kmp_rtmp_track_drop_frame: "
+            "skipping until next key frame, pending: %uz", pending);
+
+        track->skip_gop = 1;
+        return 1;
+    }
+
+    if (pending >= threshold
+        && ngx_kmp_rtmp_track_frame_disposable(track, frame))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+
 static ngx_int_t
 ngx_kmp_rtmp_track_write_frame(ngx_kmp_rtmp_track_t *track)
 {
@@ -554,15 +811,32 @@ ngx_kmp_rtmp_track_write_frame(ngx_kmp_rtmp_track_t *track)
         &stream->sn.str, track->media_type, frame->created,
         frame->size, frame->dts, frame->flags, frame->pts_delay);
 
-    rc = ngx_kmp_rtmp_stream_write_frame(stream, frame,
-        track->media_info.codec_id);
-    if (rc != NGX_OK) {
-        ngx_log_error(NGX_LOG_NOTICE, &track->log, 0,
-            "ngx_kmp_rtmp_track_write_frame: write failed");
-        return rc;
+    if (ngx_kmp_rtmp_track_drop_frame(track, frame)) {
+        ngx_log_debug2(NGX_LOG_DEBUG_STREAM, &track->log, 0,
+            "ngx_kmp_rtmp_track_write_frame: dropping frame, "
+            "stream: %V, dts: %L", &stream->sn.str, frame->dts);
+
+        track->dropped_frames++;
+        track->dropped_bytes += frame->size;
+
+    } else {
+        u->ref_track = track;
+
+        rc = ngx_kmp_rtmp_stream_write_frame(stream, frame,
+            track->media_info.codec_id);
+
+        u->ref_track = NULL;
+
+        if (rc != NGX_OK) {
+            ngx_log_error(NGX_LOG_NOTICE, &track->log, 0,
+                "ngx_kmp_rtmp_track_write_frame: write failed");
+            return rc;
+        }
     }
 
-    ngx_buf_queue_free(&track->buf_queue, frame->data->data);
+    if (track->refs == 0) {
+        ngx_buf_queue_free(&track->buf_queue, frame->data->data);
+    }
 
     ngx_kmp_rtmp_upstream_free_chain_list(u, frame->data, NULL);
     ngx_kmp_rtmp_frame_list_pop(&track->frames);
@@ -840,6 +1114,11 @@ ngx_kmp_rtmp_track_connect(ngx_kmp_rtmp_track_connect_t *connect)
 
         ngx_kmp_rtmp_track_remove_pending_frames(track);
 
+        if (ngx_kmp_rtmp_track_release_refs(track) != NGX_OK) {
+            reason = "copy_refs_failed";
+            goto fatal;
+        }
+
         ngx_buf_queue_delete(&track->buf_queue);
 
     } else {
@@ -45,6 +45,9 @@ ngx_int_t ngx_kmp_rtmp_track_process_frame(ngx_rbtree_node_t *node,
 
 ngx_int_t ngx_kmp_rtmp_track_process_expired(ngx_rbtree_node_t *node);
 
+void ngx_kmp_rtmp_track_add_ref(ngx_kmp_rtmp_track_t *track);
+void ngx_kmp_rtmp_track_ref_sent(ngx_kmp_rtmp_track_t *track, u_char *last);
+
 
 size_t ngx_kmp_rtmp_track_json_get_size(ngx_kmp_rtmp_track_t *track);
 
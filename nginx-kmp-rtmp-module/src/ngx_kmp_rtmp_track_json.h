@@ -18,6 +18,8 @@ ngx_kmp_rtmp_track_json_get_size(ngx_kmp_rtmp_track_t *obj)
     result =
         sizeof("{\"pending_frames\":") - 1 + NGX_INT_T_LEN +
         sizeof(",\"mem_used\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"dropped_frames\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"dropped_bytes\":") - 1 + NGX_SIZE_T_LEN +
         sizeof(",\"input\":") - 1 + ngx_kmp_in_json_get_size(obj->input) +
         sizeof("}") - 1;
 
@@ -33,6 +35,10 @@ ngx_kmp_rtmp_track_json_write(u_char *p, ngx_kmp_rtmp_track_t *obj)
     p = ngx_copy_fix(p, ",\"mem_used\":");
     p = ngx_sprintf(p, "%uz", (size_t)
         ngx_buf_queue_mem_used(&obj->buf_queue));
+    p = ngx_copy_fix(p, ",\"dropped_frames\":");
+    p = ngx_sprintf(p, "%ui", (ngx_uint_t) obj->dropped_frames);
+    p = ngx_copy_fix(p, ",\"dropped_bytes\":");
+    p = ngx_sprintf(p, "%uz", (size_t) obj->dropped_bytes);
     p = ngx_copy_fix(p, ",\"input\":");
     p = ngx_kmp_in_json_write(p, obj->input);
     *p++ = '}';
@@ -15,6 +15,12 @@
 
 #define NGX_KMP_RTMP_ISO8601_DATE_LEN  (sizeof("yyyy-mm-dd") - 1)
 
+/* smaller frame payloads are copied to the output buffer */
+#define NGX_KMP_RTMP_MIN_REF_SIZE      (512)
+
+#define ngx_kmp_rtmp_upstream_copy_tag                                       \
+    ((ngx_buf_tag_t) &ngx_kmp_rtmp_upstream_copy_refs)
+
 
 typedef struct {
     ngx_rbtree_t       rbtree;
@@ -94,11 +100,27 @@ ngx_kmp_rtmp_upstream_free_chain_list(ngx_kmp_rtmp_upstream_t *u,
 }
 
 
+static void
+ngx_kmp_rtmp_upstream_release_buf(ngx_kmp_rtmp_upstream_t *u, ngx_buf_t *b)
+{
+    if (b->tag == ngx_kmp_rtmp_upstream_copy_tag) {
+        u->mem_left += b->end - b->start;
+        ngx_free(b->start);
+
+    } else {
+        ngx_kmp_rtmp_track_ref_sent(b->tag, b->end);
+    }
+
+    b->tag = NULL;
+}
+
+
 static ngx_int_t
 ngx_kmp_rtmp_upstream_send(ngx_kmp_rtmp_upstream_t *u)
 {
     off_t              sent;
     u_char            *limit;
+    ngx_buf_t         *b;
     ngx_chain_t       *chain;
     ngx_chain_t       *next;
     ngx_chain_t       *cl;
@@ -118,6 +140,8 @@ ngx_kmp_rtmp_upstream_send(ngx_kmp_rtmp_upstream_t *u)
 
     sent = c->sent;
 
+    u->ref_bytes = 0;
+
     chain = c->send_chain(c, u->busy, 0);
     if (chain == NGX_CHAIN_ERROR) {
         ngx_log_error(NGX_LOG_NOTICE, c->log, 0,
@@ -127,19 +151,40 @@ ngx_kmp_rtmp_upstream_send(ngx_kmp_rtmp_upstream_t *u)
     }
 
     /* move sent buffers to free */
+    limit = NULL;
+
     for (cl = u->busy; cl && cl != chain; cl = next) {
         next = cl->next;
 
+        b = cl->buf;
+        if (b->tag == NULL) {
+            limit = b->last - 1;
+
+        } else {
+            ngx_kmp_rtmp_upstream_release_buf(u, b);
+        }
+
         cl->next = u->free;
         u->free = cl;
     }
 
     u->busy = chain;
+    u->busy_size -= (size_t) (c->sent - sent);
+    u->hs_backlog -= ngx_min(u->hs_backlog, (size_t) (c->sent - sent));
 
-    /* Note: u->free contains the last chain that was sent */
-    limit = chain ? chain->buf->pos : u->free->buf->last - 1;
+    /* Note: only untagged buffers point to u->buf_queue, frame payloads
+        point to the buf queue of the track */
 
-    ngx_buf_queue_free(&u->buf_queue, limit);
+    for (cl = chain; cl; cl = cl->next) {
+        if (cl->buf->tag == NULL) {
+            limit = cl->buf->pos;
+            break;
+        }
+    }
+
+    if (limit != NULL) {
+        ngx_buf_queue_free(&u->buf_queue, limit);
+    }
 
 #if (NGX_DEBUG)
     buffered = 0;
@@ -213,15 +258,12 @@ ngx_kmp_rtmp_alloc_chain_buf(ngx_kmp_rtmp_upstream_t *u)
 
 
 static ngx_int_t
-ngx_kmp_rtmp_upstream_append(ngx_kmp_rtmp_upstream_t *u)
+ngx_kmp_rtmp_upstream_add_buf(ngx_kmp_rtmp_upstream_t *u, u_char *pos,
+    u_char *last, ngx_buf_tag_t tag)
 {
     ngx_buf_t    *b;
     ngx_chain_t  *cl;
 
-    if (u->active_buf.last <= u->active_buf.pos) {
-        return NGX_OK;
-    }
-
     cl = u->free;
     if (cl != NULL) {
         u->free = cl->next;
@@ -230,21 +272,43 @@ ngx_kmp_rtmp_upstream_append(ngx_kmp_rtmp_upstream_t *u)
         cl = ngx_kmp_rtmp_alloc_chain_buf(u);
         if (cl == NULL) {
             ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
-                "ngx_kmp_rtmp_upstream_append: alloc chain buf failed");
+                "ngx_kmp_rtmp_upstream_add_buf: alloc chain buf failed");
             return NGX_ERROR;
         }
     }
 
     b = cl->buf;
 
-    b->start = b->pos = u->active_buf.pos;
-    b->end = b->last = u->active_buf.last;
+    b->start = b->pos = pos;
+    b->end = b->last = last;
+    b->tag = tag;
 
     *u->last = cl;
     u->last = &cl->next;
 
     cl->next = NULL;
 
+    u->busy_size += last - pos;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_kmp_rtmp_upstream_append(ngx_kmp_rtmp_upstream_t *u)
+{
+    if (u->active_buf.last <= u->active_buf.pos) {
+        return NGX_OK;
+    }
+
+    if (ngx_kmp_rtmp_upstream_add_buf(u, u->active_buf.pos,
+        u->active_buf.last, NULL) != NGX_OK)
+    {
+        ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+            "ngx_kmp_rtmp_upstream_append: add buf failed");
+        return NGX_ERROR;
+    }
+
     u->active_buf.pos = u->active_buf.last;
 
     return NGX_OK;
@@ -333,6 +397,136 @@ error:
 }
 
 
+ngx_int_t
+ngx_kmp_rtmp_upstream_write_ref(void *data, void *buf, size_t size)
+{
+    ngx_int_t                 rc;
+    ngx_connection_t         *c;
+    ngx_kmp_rtmp_upstream_t  *u;
+
+    u = data;
+
+    if (u->ref_track == NULL || size < NGX_KMP_RTMP_MIN_REF_SIZE) {
+        return ngx_kmp_rtmp_upstream_write(data, buf, size);
+    }
+
+    if (u->write_error) {
+        return NGX_ERROR;
+    }
+
+    /* the payload is sent from the track buffers, the pending headers
+        must be queued before it */
+
+    if (ngx_kmp_rtmp_upstream_append(u) != NGX_OK) {
+        ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+            "ngx_kmp_rtmp_upstream_write_ref: append failed");
+        goto error;
+    }
+
+    if (ngx_kmp_rtmp_upstream_add_buf(u, buf, (u_char *) buf + size,
+        (ngx_buf_tag_t) u->ref_track) != NGX_OK)
+    {
+        ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+            "ngx_kmp_rtmp_upstream_write_ref: add buf failed");
+        goto error;
+    }
+
+    ngx_kmp_rtmp_track_add_ref(u->ref_track);
+
+    u->written_bytes += size;
+    u->ref_bytes += size;
+
+    /* send once a full buffer was referenced, same as with copied data */
+
+    if (u->ref_bytes < u->buf_queue.used_size) {
+        if (!u->flush.timer_set) {
+            ngx_add_timer(&u->flush, u->conf.flush_timeout);
+        }
+
+        return NGX_OK;
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, &u->log, 0,
+        "ngx_kmp_rtmp_upstream_write_ref: resetting flush timer");
+
+    ngx_add_timer(&u->flush, u->conf.flush_timeout);
+
+    c = u->peer.connection;
+    if (c && c->write->ready) {
+        rc = ngx_kmp_rtmp_upstream_send(u);
+        if (rc != NGX_OK && rc != NGX_AGAIN) {
+            ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+                "ngx_kmp_rtmp_upstream_write_ref: send failed");
+            goto error;
+        }
+    }
+
+    return NGX_OK;
+
+error:
+
+    u->write_error = 1;
+    return NGX_ERROR;
+}
+
+
+ngx_int_t
+ngx_kmp_rtmp_upstream_copy_refs(ngx_kmp_rtmp_upstream_t *u,
+    ngx_kmp_rtmp_track_t *track)
+{
+    size_t        size;
+    u_char       *p;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    /* called before the buffers of the track are freed, while some of
+        its frames are still pending in the send chain */
+
+    for (cl = u->busy; cl; cl = cl->next) {
+
+        b = cl->buf;
+        if (b->tag != (ngx_buf_tag_t) track) {
+            continue;
+        }
+
+        size = b->last - b->pos;
+        if (u->mem_left < size) {
+            ngx_log_error(NGX_LOG_ERR, &u->log, 0,
+                "ngx_kmp_rtmp_upstream_copy_refs: memory limit exceeded");
+            goto failed;
+        }
+
+        p = ngx_alloc(size, &u->log);
+        if (p == NULL) {
+            ngx_log_error(NGX_LOG_NOTICE, &u->log, 0,
+                "ngx_kmp_rtmp_upstream_copy_refs: alloc failed");
+            goto failed;
+        }
+
+        u->mem_left -= size;
+
+        ngx_memcpy(p, b->pos, size);
+
+        b->start = b->pos = p;
+        b->end = b->last = p + size;
+        b->tag = ngx_kmp_rtmp_upstream_copy_tag;
+    }
+
+    return NGX_OK;
+
+failed:
+
+    /* the send chain can no longer be used */
+    u->write_error = 1;
+
+    if (u->peer.connection) {
+        u->peer.connection->error = 1;
+    }
+
+    return NGX_ERROR;
+}
+
+
 static ngx_int_t
 ngx_kmp_rtmp_upstream_flush(ngx_kmp_rtmp_upstream_t *u)
 {
@@ -680,6 +874,9 @@ ngx_kmp_rtmp_upstream_handshake_handler(ngx_kmp_rtmp_handshake_t *hs,
     c->read->handler =  ngx_kmp_rtmp_upstream_read_handler;
     c->write->handler = ngx_kmp_rtmp_upstream_write_handler;
 
+    u->hs_backlog = ngx_kmp_rtmp_upstream_pending(u);
+    u->hs_done = 1;
+
     rc = ngx_kmp_rtmp_upstream_send(u);
     if (rc != NGX_OK && rc != NGX_AGAIN) {
         ngx_kmp_rtmp_upstream_finalize(u, "send_failed");
@@ -1106,6 +1303,7 @@ void
 ngx_kmp_rtmp_upstream_free(ngx_kmp_rtmp_upstream_t *u, char *reason)
 {
     ngx_queue_t            *q;
+    ngx_chain_t            *cl;
     ngx_connection_t       *c;
     ngx_kmp_rtmp_stream_t  *stream;
 
@@ -1148,6 +1346,12 @@ ngx_kmp_rtmp_upstream_free(ngx_kmp_rtmp_upstream_t *u, char *reason)
         ngx_close_connection(c);
     }
 
+    for (cl = u->busy; cl; cl = cl->next) {
+        if (cl->buf->tag == ngx_kmp_rtmp_upstream_copy_tag) {
+            ngx_free(cl->buf->start);
+        }
+    }
+
     if (u->hs) {
         ngx_kmp_rtmp_handshake_free(u->hs);
     }
@@ -1536,6 +1740,7 @@ ngx_kmp_rtmp_upstream_conf_init(ngx_kmp_rtmp_upstream_conf_t *conf)
     conf->write_meta_timeout = NGX_CONF_UNSET_MSEC;
     conf->min_process_delay = NGX_CONF_UNSET_MSEC;
     conf->max_process_delay = NGX_CONF_UNSET_MSEC;
+    conf->drop_threshold = NGX_CONF_UNSET_SIZE;
     conf->onfi_period = NGX_CONF_UNSET_MSEC;
 }
 
@@ -1587,6 +1792,9 @@ ngx_kmp_rtmp_upstream_conf_merge(ngx_conf_t *cf,
     ngx_conf_merge_msec_value(conf->max_process_delay,
                               prev->max_process_delay, 1000);
 
+    ngx_conf_merge_size_value(conf->drop_threshold,
+                              prev->drop_threshold, conf->mem_limit / 4);
+
     ngx_conf_merge_msec_value(conf->onfi_period,
                               prev->onfi_period, 5000);
 
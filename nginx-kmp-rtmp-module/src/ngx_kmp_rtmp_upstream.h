@@ -66,6 +66,11 @@ struct ngx_kmp_rtmp_upstream_s {
     ngx_chain_t                    *free;
     ngx_chain_t                   **last;
     ngx_chain_t                    *busy;
+    size_t                          busy_size;
+    size_t                          hs_backlog;
+
+    ngx_kmp_rtmp_track_t           *ref_track;
+    size_t                          ref_bytes;
 
     ngx_buf_chain_t                *free_chains;
 
@@ -87,10 +92,21 @@ struct ngx_kmp_rtmp_upstream_s {
     ngx_fd_t                        dump_fd;
 
     unsigned                        write_error:1;
+    unsigned                        hs_done:1;
     unsigned                        freed:1;
 };
 
 
+/* bytes written to the upstream that were not sent yet */
+#define ngx_kmp_rtmp_upstream_pending(u)                                     \
+    ((u)->busy_size + ((u)->active_buf.last - (u)->active_buf.pos))
+
+/* pending bytes that were written after the handshake completed, the bytes
+    queued while connecting are not a sign of a slow upstream */
+#define ngx_kmp_rtmp_upstream_backlog(u)                                     \
+    ((u)->hs_done ? ngx_kmp_rtmp_upstream_pending(u) - (u)->hs_backlog : 0)
+
+
 ngx_int_t ngx_kmp_rtmp_upstream_get_or_create(ngx_pool_t *temp_pool,
     ngx_kmp_rtmp_upstream_conf_t *conf, ngx_json_value_t *value,
     ngx_kmp_rtmp_upstream_t **upstream, ngx_str_t *stream_name);
@@ -102,6 +118,9 @@ void ngx_kmp_rtmp_upstream_free_chain_list(ngx_kmp_rtmp_upstream_t *u,
     ngx_buf_chain_t *head, ngx_buf_chain_t *tail);
 
 ngx_int_t ngx_kmp_rtmp_upstream_write(void *data, void *buf, size_t size);
+ngx_int_t ngx_kmp_rtmp_upstream_write_ref(void *data, void *buf, size_t size);
+ngx_int_t ngx_kmp_rtmp_upstream_copy_refs(ngx_kmp_rtmp_upstream_t *u,
+    ngx_kmp_rtmp_track_t *track);
 u_char *ngx_kmp_rtmp_upstream_get_buf(ngx_kmp_rtmp_upstream_t *u, size_t size);
 
 void ngx_kmp_rtmp_upstream_stream_removed(ngx_kmp_rtmp_upstream_t *u);
@@ -293,6 +293,7 @@ ngx_kmp_rtmp_upstream_json_get_size(ngx_kmp_rtmp_upstream_t *obj)
         sizeof(",\"written_bytes\":") - 1 + NGX_SIZE_T_LEN +
         sizeof(",\"sent_bytes\":") - 1 + NGX_OFF_T_LEN +
         sizeof(",\"received_bytes\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"pending_bytes\":") - 1 + NGX_SIZE_T_LEN +
         sizeof(",\"streams\":") - 1 +
             ngx_kmp_rtmp_upstream_streams_json_get_size(obj) +
         sizeof("}") - 1;
@@ -327,6 +328,8 @@ ngx_kmp_rtmp_upstream_json_write(u_char *p, ngx_kmp_rtmp_upstream_t *obj)
         obj->peer.connection->sent : 0));
     p = ngx_copy_fix(p, ",\"received_bytes\":");
     p = ngx_sprintf(p, "%uz", (size_t) obj->received_bytes);
+    p = ngx_copy_fix(p, ",\"pending_bytes\":");
+    p = ngx_sprintf(p, "%uz", (size_t) ngx_kmp_rtmp_upstream_pending(obj));
     p = ngx_copy_fix(p, ",\"streams\":");
     p = ngx_kmp_rtmp_upstream_streams_json_write(p, obj);
     *p++ = '}';
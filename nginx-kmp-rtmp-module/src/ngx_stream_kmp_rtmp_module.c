@@ -219,6 +219,13 @@ static ngx_command_t  ngx_stream_kmp_rtmp_commands[] = {
       offsetof(ngx_stream_kmp_rtmp_srv_conf_t, out.max_process_delay),
       NULL },
 
+    { ngx_string("kmp_rtmp_out_drop_threshold"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_kmp_rtmp_srv_conf_t, out.drop_threshold),
+      NULL },
+
     { ngx_string("kmp_rtmp_out_onfi_period"),
       NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_msec_slot,
@@ -110,6 +110,24 @@ class KmpMediaFileReader(KmpReader):
         self.p.terminate()
 
 
+class KmpSocketInput(object):
+    def __init__(self, s):
+        self.s = s
+
+    def read(self, size):
+        # returns a short read on close / timeout (s.settimeout)
+        data = b''
+        while len(data) < size:
+            try:
+                chunk = self.s.recv(size - len(data))
+            except socket.timeout:
+                break
+            if len(chunk) == 0:
+                break
+            data += chunk
+        return data
+
+
 class KmpMemoryReader(KmpReaderBase):
     def __init__(self, reader, duration):
         self.packets = []
@@ -279,6 +297,13 @@ def kmpConnectPacket(channelId, trackId, initialFrameId = 0, initialOffset = 0,
         struct.pack('<QQLL', initialFrameId, 0, initialOffset, flags))
     return kmpCreatePacket(KMP_PACKET_CONNECT, header, data)
 
+def kmpGetConnectFrameId(data):
+    offset = KMP_PACKET_HEADER_SIZE + KMP_MAX_CHANNEL_ID_LEN + KMP_MAX_TRACK_ID_LEN
+    return struct.unpack('<Q', data[offset:(offset + 8)])[0]
+
+def kmpAckFramesPacket(frameId, upstreamFrameId = 0, offset = 0):
+    return kmpCreatePacket(KMP_PACKET_ACK_FRAMES, struct.pack('<QQLL', frameId, upstreamFrameId, offset, 0), b'')
+
 def kmpEndOfStreamPacket():
     return kmpCreatePacket(KMP_PACKET_END_OF_STREAM, b'', b'')
 
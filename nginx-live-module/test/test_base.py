@@ -125,6 +125,16 @@ def writeFile(path, data):
     with open(path, 'wb') as f:
         f.write(data)
 
+def readTsFile(inputFile, duration):
+    # remux the video stream of an mp4 test file to mpeg-ts (requires ffmpeg)
+    outputFile = '/tmp/%s-%s.ts' % (os.path.splitext(os.path.basename(inputFile))[0], duration)
+    if not os.path.isfile(outputFile):
+        subprocess.check_call(['ffmpeg', '-y', '-loglevel', 'error', '-i', inputFile,
+            '-t', str(duration), '-map', '0:v', '-c', 'copy', '-bsf:v', 'h264_mp4toannexb',
+            '-f', 'mpegts', outputFile])
+    with open(outputFile, 'rb') as f:
+        return f.read()
+
 def getFiller():
     return NginxLiveFiller(channel_id=FILLER_CHANNEL_ID, preset=FILLER_PRESET,
         timeline_id=FILLER_TIMELINE_ID)
@@ -0,0 +1,175 @@
+from test_base import *
+from threading import Event
+import json
+
+# mpegts -> kmp-out -> python kmp upstream
+#   resume - the upstream acks the first frames and drops the connection, the
+#       republish response skips more frames using initial_frame_id, only the
+#       frames after the skipped ones are expected to be replayed
+#   evict - the upstream never acks, max_unacked_bytes forces auto acks
+
+TS_PORT = 8003
+KMP_PORT = 8004
+
+KMP_OUT_API_URL = '%s/kmp_out_api/' % NGINX_LIVE_URL
+
+TS_DURATION = 10
+FIRST_CONN_FRAMES = 50
+ACKED_FRAMES = 10
+SKIPPED_FRAMES = 20
+MAX_UNACKED_BYTES = 128 * 1024
+
+def updateConf(conf):
+    appendConfDirective(conf, ['stream'], [['server'], [
+        ['listen', str(TS_PORT)],
+        ['ts'],
+        ['ts_stream_id', 'kmp_out_resume'],
+        ['ts_kmp', 'on'],
+        ['ts_kmp_ctrl_publish_url', 'http://127.0.0.1:8002/publish'],
+        ['ts_kmp_ctrl_republish_url', 'http://127.0.0.1:8002/republish'],
+        ['ts_kmp_flush_timeout', '100'],
+    ]])
+    appendConfDirective(conf, ['http', 'server'], [['location', '/kmp_out_api/'], [['kmp_out_api']]])
+
+def startMode(newMode):
+    global mode, connects, receivedFrames, tsSent, idle, done
+
+    mode = newMode
+    connects = []
+    receivedFrames = []
+    tsSent = Event()
+    idle = Event()
+    done = Event()
+
+def ctrlServer(s):
+    header = s.recv(4096)
+    req = json.loads(readRequestBody(s, header).decode('utf8'))
+
+    url = 'kmp://127.0.0.1:%s' % KMP_PORT
+    if req['event_type'] == 'publish':
+        upstream = {'id': 'u1', 'url': url}
+        if mode == 'evict':
+            upstream['max_unacked_bytes'] = MAX_UNACKED_BYTES
+        res = {'code': 'ok', 'channel_id': CHANNEL_ID, 'track_id': 'v1', 'upstreams': [upstream]}
+    else:
+        res = {'code': 'ok', 'url': url}
+        if mode == 'resume':
+            res['initial_frame_id'] = connects[0] + ACKED_FRAMES + SKIPPED_FRAMES
+
+    s.send(getHttpResponseRegular(json.dumps(res).encode('utf8'), headers={b'Content-Type': b'application/json'}))
+
+def kmpServer(s):
+    s.settimeout(2)
+    reader = KmpReader(KmpSocketInput(s))
+
+    assertEquals(reader.getPacketType(), KMP_PACKET_CONNECT)
+    initialFrameId = kmpGetConnectFrameId(reader.next())
+    connects.append(initialFrameId)
+
+    frames = 0
+    while reader.getPacketType() not in [None, KMP_PACKET_END_OF_STREAM]:
+        if reader.getPacketType() == KMP_PACKET_FRAME:
+            frames += 1
+
+        reader.next()
+
+        if mode == 'resume' and len(connects) == 1 and frames == FIRST_CONN_FRAMES:
+            # ack part of the frames and drop the connection
+            tsSent.wait()
+            s.send(kmpAckFramesPacket(initialFrameId + ACKED_FRAMES))
+            time.sleep(.5)
+            return
+
+    receivedFrames.append(frames)
+
+    if mode == 'resume':
+        s.send(kmpAckFramesPacket(initialFrameId + frames))
+        time.sleep(.5)
+
+    idle.set()
+    done.wait()
+
+    # drain until end of stream
+    reader.readPacket()
+    while reader.getPacketType() not in [None, KMP_PACKET_END_OF_STREAM]:
+        reader.next()
+
+def sendTs(tsData):
+    s = socket.create_connection(('127.0.0.1', TS_PORT))
+    cleanupStack.push(s.close)
+    socketSendRegular(s, tsData)
+    time.sleep(1)
+    return s
+
+def getTracks():
+    return requests.get(url=KMP_OUT_API_URL).json()['tracks']
+
+def getTrack():
+    tracks = list(getTracks().values())
+    assertEquals(len(tracks), 1)
+    return tracks[0]
+
+def endMode(ts):
+    ts.close()
+    done.set()
+
+    for i in range(100):
+        if len(getTracks()) == 0:
+            break
+        time.sleep(.1)
+
+    assertEquals(len(getTracks()), 0)
+
+def test(channelId=CHANNEL_ID):
+    tsData = readTsFile(TEST_VIDEO1, TS_DURATION)
+
+    startMode('resume')
+
+    TcpServer(8002, ctrlServer)
+    TcpServer(KMP_PORT, kmpServer)
+    cleanupStack.push(lambda: done.set())
+
+    # resume
+    ts = sendTs(tsData)
+    tsSent.set()
+    assert(idle.wait(30))
+
+    track = getTrack()
+    upstream = track['upstreams'][0]
+
+    sentFrames = track['sent_frames']
+    assertGreaterThan(sentFrames, FIRST_CONN_FRAMES)
+    resumeFrameId = connects[0] + ACKED_FRAMES + SKIPPED_FRAMES
+    unackedFrames = sentFrames - ACKED_FRAMES - SKIPPED_FRAMES
+
+    assertEquals(connects[1:], [resumeFrameId])
+    assertEquals(receivedFrames, [unackedFrames])
+
+    assertEquals(upstream['skipped_frames'], SKIPPED_FRAMES)
+    assertEquals(upstream['replays'], 1)
+    assertEquals(upstream['replayed_frames'], unackedFrames)
+    assertGreaterThan(upstream['replayed_bytes'], 0)
+    assertEquals(upstream['acked_frames'], sentFrames)
+    assertEquals(upstream['auto_acked_frames'], 0)
+    assertEquals(upstream['evicted_frames'], 0)
+
+    logTracker.assertContains(b'ngx_kmp_out_upstream_skip_to_frame: skipped %d frames, resuming from %d' % (SKIPPED_FRAMES, resumeFrameId))
+    logTracker.assertContains(b'ngx_kmp_out_upstream_send_buffered: replaying')
+
+    endMode(ts)
+
+    # evict
+    startMode('evict')
+
+    ts = sendTs(tsData)
+    assert(idle.wait(30))
+
+    upstream = getTrack()['upstreams'][0]
+
+    assertEquals(upstream['max_unacked_bytes'], MAX_UNACKED_BYTES)
+    assertGreaterThan(upstream['evicted_frames'], 0)
+    assertEquals(upstream['auto_acked_frames'], upstream['evicted_frames'])
+
+    logTracker.assertContains(b'exceed limit %d, evicting frames' % MAX_UNACKED_BYTES)
+
+    endMode(ts)
@@ -0,0 +1,201 @@
+from test_base import *
+from threading import Lock
+import hashlib
+import json
+
+# RTP/MP2T over udp -> kmp-out -> python kmp upstream
+#   each scenario is sent from a new socket (= new udp session), the session
+#   counters are printed when it times out, the kmp frames are collected on
+#   end of stream
+
+RTP_PORT = 8005
+RTP_NO_REORDER_PORT = 8006
+KMP_PORT = 8007
+
+TS_DURATION = 20
+TS_PACKETS_PER_DATAGRAM = 7
+
+RTP_PAYLOAD_MP2T = 33
+RTP_SSRC = 0x1234
+SEQ_BASE = 1000
+
+REORDER_WINDOW = 32         # default ts_udp_reorder_window
+MAX_LATE = 8                # NGX_STREAM_TS_UDP_MAX_LATE
+
+SWAPS = [50, 60, 70, 80, 90]
+DUP_AT = 120
+GAP_AT = 150
+GAP_SIZE = 3
+RESET_AT = 250
+JUMP_AT = 350
+JUMP_SIZE = 1000
+
+def updateConf(conf):
+    for port, window in [(RTP_PORT, None), (RTP_NO_REORDER_PORT, '0')]:
+        block = [
+            ['listen', '%s udp' % port],
+            ['ts'],
+            ['ts_stream_id', 'rtp'],
+            ['ts_timeout', '1s'],
+            ['ts_kmp', 'on'],
+            ['ts_kmp_ctrl_publish_url', 'http://127.0.0.1:8002/publish'],
+            ['ts_kmp_flush_timeout', '100'],
+        ]
+        if window is not None:
+            block.append(['ts_udp_reorder_window', window])
+        appendConfDirective(conf, ['stream'], [['server'], block])
+
+def ctrlServer(s):
+    header = s.recv(4096)
+    readRequestBody(s, header)
+
+    res = {'code': 'ok', 'channel_id': CHANNEL_ID, 'track_id': 'v1', 'upstreams': [{'url': 'kmp://127.0.0.1:%s' % KMP_PORT}]}
+    s.send(getHttpResponseRegular(json.dumps(res).encode('utf8'), headers={b'Content-Type': b'application/json'}))
+
+def kmpServer(s):
+    s.settimeout(5)
+    reader = KmpReader(KmpSocketInput(s))
+
+    assertEquals(reader.getPacketType(), KMP_PACKET_CONNECT)
+    initialFrameId = kmpGetConnectFrameId(reader.next())
+
+    frames = []
+    while reader.getPacketType() not in [None, KMP_PACKET_END_OF_STREAM]:
+        data = reader.next()
+        if kmpGetHeader(data)[0] != KMP_PACKET_FRAME:
+            continue
+
+        created, dts, flags, ptsDelay = kmpGetFrameHeader(data)
+        md5 = hashlib.md5(data[(KMP_PACKET_HEADER_SIZE + KMP_FRAME_HEADER_SIZE):]).hexdigest()
+        frames.append((dts, flags, ptsDelay, md5))
+
+    s.send(kmpAckFramesPacket(initialFrameId + len(frames)))
+    time.sleep(.5)
+
+    lock.acquire()
+    outputs.append(frames)
+    lock.release()
+
+class RtpSender:
+    def __init__(self, port, chunks):
+        self.s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.addr = ('127.0.0.1', port)
+        self.chunks = chunks
+        self.sent = 0
+
+    def send(self, seq, index):
+        header = struct.pack('>BBHLL', 0x80, RTP_PAYLOAD_MP2T, seq & 0xffff, index * 90, RTP_SSRC)
+        self.s.sendto(header + self.chunks[index], self.addr)
+        self.sent += 1
+        if self.sent % 10 == 0:
+            time.sleep(.001)    # avoid overflowing the socket buffer
+
+def sendRtp(port, chunks, swaps=[], dupAt=None, gapAt=None, resetAt=None, jumpAt=None):
+    sender = RtpSender(port, chunks)
+
+    seq = SEQ_BASE
+    i = 0
+    while i < len(chunks):
+        if i == gapAt:
+            # skip the datagrams, and let the gap timer expire on the next one
+            seq += GAP_SIZE
+            i += GAP_SIZE
+            sender.send(seq, i)
+            time.sleep(.2)
+        elif i in swaps:
+            sender.send(seq + 1, i + 1)
+            sender.send(seq, i)
+            seq += 1
+            i += 1
+        else:
+            if i == resetAt:
+                seq = SEQ_BASE      # sender restart
+            elif i == jumpAt:
+                seq += JUMP_SIZE
+            sender.send(seq, i)
+
+        if i == dupAt:
+            sender.send(seq - 5, i - 5)
+
+        seq += 1
+        i += 1
+
+    sender.s.close()
+    return sender.sent
+
+def waitForOutput(count):
+    for i in range(100):
+        if len(outputs) >= count:
+            break
+        time.sleep(.1)
+
+    assertEquals(len(outputs), count)
+    return outputs[-1]
+
+def assertCounters(received, reordered, lost, dropped):
+    logTracker.assertContains(b'ngx_stream_ts_udp_cleanup: received: %d, reordered: %d, lost: %d, dropped: %d' %
+        (received, reordered, lost, dropped))
+
+def assertValidFrames(frames):
+    assertGreaterThan(len(frames), 0)
+    assert(frames[0][1] & KMP_FRAME_FLAG_KEY)
+    for prev, cur in zip(frames, frames[1:]):
+        assertGreaterThan(cur[0], prev[0])
+
+def test(channelId=CHANNEL_ID):
+    global outputs, lock
+
+    tsData = readTsFile(TEST_VIDEO1, TS_DURATION)
+    size = 188 * TS_PACKETS_PER_DATAGRAM
+    chunks = [tsData[pos:(pos + size)] for pos in range(0, len(tsData), size)]
+    assertGreaterThan(len(chunks), JUMP_AT + REORDER_WINDOW)
+
+    outputs = []
+    lock = Lock()
+
+    TcpServer(8002, ctrlServer)
+    TcpServer(KMP_PORT, kmpServer)
+
+    # in order - reference output
+    received = sendRtp(RTP_PORT, chunks)
+    reference = waitForOutput(1)
+
+    logTracker.assertContains(b'ngx_stream_ts_udp_read: input is RTP/MP2T')
+    assertCounters(received, 0, 0, 0)
+    assertValidFrames(reference)
+
+    # swapped pairs + duplicate - no loss, same output
+    logTracker.init()
+    received = sendRtp(RTP_PORT, chunks, swaps=SWAPS, dupAt=DUP_AT)
+    frames = waitForOutput(2)
+
+    assertCounters(received, len(SWAPS), 0, 1)
+    assertEquals(frames, reference)
+
+    # gap + sequence reset + forward jump
+    logTracker.init()
+    received = sendRtp(RTP_PORT, chunks, gapAt=GAP_AT, resetAt=RESET_AT, jumpAt=JUMP_AT)
+    frames = waitForOutput(3)
+
+    # the datagram after the gap is reordered, the late ones before the
+    #   reset are dropped, the jump is counted as lost
+    assertCounters(received, 1, GAP_SIZE + JUMP_SIZE, REORDER_WINDOW - 1)
+    logTracker.assertContains(b'ngx_stream_ts_udp_gap_handler: skipped %d missing datagrams, seq: %d' %
+        (GAP_SIZE, SEQ_BASE + GAP_AT))
+    logTracker.assertContains(b'ngx_stream_ts_udp_read: sequence reset, seq: %d, expected: %d' %
+        (SEQ_BASE + REORDER_WINDOW - 1, SEQ_BASE + RESET_AT))
+    assertValidFrames(frames)
+    assertLessThan(len(frames), len(reference))
+
+    # reordering disabled - swap + gap + sequence reset
+    logTracker.init()
+    received = sendRtp(RTP_NO_REORDER_PORT, chunks, swaps=SWAPS[:1], gapAt=GAP_AT, resetAt=RESET_AT)
+    frames = waitForOutput(4)
+
+    # the second datagram of the swap is counted as lost, the first as dropped
+    assertCounters(received, 0, 1 + GAP_SIZE, 1 + MAX_LATE - 1)
+    logTracker.assertContains(b'ngx_stream_ts_udp_read: %d missing datagrams before seq %d' %
+        (GAP_SIZE, SEQ_BASE + GAP_AT + GAP_SIZE))
+    logTracker.assertContains(b'ngx_stream_ts_udp_read: sequence reset, seq: %d, expected: %d' %
+        (SEQ_BASE + MAX_LATE - 1, SEQ_BASE + RESET_AT))
+    assertValidFrames(frames)
@@ -48,6 +48,9 @@ typedef struct {
 typedef struct {
     ngx_chain_t                     *cl;
     u_char                          *pos;
+    u_char                          *prefix;    /* 4 byte start code */
+    ngx_chain_t                     *prefix_cl;
+    uint32_t                         offset;
     uint32_t                         size;
     u_char                           type;
 } ngx_ts_kmp_heavc_nalu_t;
@@ -406,18 +409,14 @@ ngx_ts_kmp_track_heavc_save_nalu(ngx_ts_kmp_track_t *ts_track,
     ngx_kmp_out_track_t            *track;
     ngx_ts_kmp_heavc_saved_nalu_t  *sn;
 
-    if (ngx_ts_kmp_track_heavc_get_ps_id(ts_track, nalu, &id) != NGX_OK) {
-        return NGX_ERROR;
-    }
-
     track = ts_track->track;
     heavc = ts_track->codec;
 
+    /* parameter sets are usually repeated unchanged on every key frame,
+        check for an identical copy before parsing the id */
+
     for (i = 0; i < heavc->nalus.nelts; i++) {
         sn = &heavc->nalus.elts[i];
-        if (sn->id != id) {
-            continue;
-        }
 
         if (nalu->size == sn->buf.last - sn->buf.pos
             && ngx_ts_kmp_compare_chain(sn->buf.pos, nalu->cl, nalu->pos,
@@ -425,9 +424,20 @@ ngx_ts_kmp_track_heavc_save_nalu(ngx_ts_kmp_track_t *ts_track,
         {
             ngx_log_debug2(NGX_LOG_DEBUG_CORE, &track->log, 0,
                 "ngx_ts_kmp_track_heavc_save_nalu: "
-                "no change in nalu, id: 0x%uxD, index: %ui", id, i);
+                "no change in nalu, id: 0x%uxD, index: %ui", sn->id, i);
             return NGX_OK;
         }
+    }
+
+    if (ngx_ts_kmp_track_heavc_get_ps_id(ts_track, nalu, &id) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < heavc->nalus.nelts; i++) {
+        sn = &heavc->nalus.elts[i];
+        if (sn->id != id) {
+            continue;
+        }
 
         ngx_log_error(NGX_LOG_INFO, &track->log, 0,
             "ngx_ts_kmp_track_heavc_save_nalu: "
@@ -570,6 +580,16 @@ ngx_ts_kmp_track_heavc_init_nalu_array(ngx_ts_kmp_track_t *ts_track,
                 nalu->pos = cl->next->buf->pos;
             }
 
+            if (zero_count >= 3 && p - 3 >= pos) {
+                nalu->prefix_cl = cl;
+                nalu->prefix = p - 3;
+
+            } else {
+                nalu->prefix = NULL;
+            }
+
+            nalu->offset = offset + 1;
+
             nalu->type = (*nalu->pos >> heavc->nal_type_shift)
                 & heavc->nal_type_mask;
             out->types |= 1ULL << nalu->type;
@@ -599,9 +619,12 @@ static ngx_int_t
 ngx_ts_kmp_track_heavc_write_frame(ngx_ts_kmp_track_t *ts_track,
     kmp_frame_packet_t *frame, ngx_ts_kmp_heavc_nalu_arr_t *nalus)
 {
+    u_char                   *run_pos;
     u_char                    len_buf[4];
     uint32_t                  i;
+    uint32_t                  run_size, run_end;
     uint64_t                  nal_skip_mask;
+    ngx_chain_t              *run_cl;
     ngx_ts_kmp_heavc_t       *heavc;
     ngx_kmp_out_track_t      *track;
     ngx_ts_kmp_heavc_nalu_t  *nalu;
@@ -617,6 +640,17 @@ ngx_ts_kmp_track_heavc_write_frame(ngx_ts_kmp_track_t *ts_track,
     heavc = ts_track->codec;
     nal_skip_mask = heavc->nal_skip_mask;
 
+    /*
+     * 4 byte start codes are overwritten in place with the nal length,
+     * the pes buffers are released once the handler returns. consecutive
+     * nals are then written as a single run, straight from the pes bufs.
+     */
+
+    run_cl = NULL;
+    run_pos = NULL;
+    run_size = 0;
+    run_end = 0;
+
     for (i = 0; i < nalus->nelts; i++) {
 
         nalu = &nalus->elts[i];
@@ -625,6 +659,39 @@ ngx_ts_kmp_track_heavc_write_frame(ngx_ts_kmp_track_t *ts_track,
             continue;
         }
 
+        if (nalu->prefix != NULL) {
+            ngx_ts_kmp_write_be32(nalu->prefix, nalu->size);
+
+            if (run_cl != NULL && run_end == nalu->offset - 4) {
+                run_size += 4 + nalu->size;
+
+            } else {
+                if (run_cl != NULL
+                    && ngx_ts_kmp_track_write_chain(track, run_cl, run_pos,
+                        run_size) != NGX_OK)
+                {
+                    return NGX_ERROR;
+                }
+
+                run_cl = nalu->prefix_cl;
+                run_pos = nalu->prefix;
+                run_size = 4 + nalu->size;
+            }
+
+            run_end = nalu->offset + nalu->size;
+            continue;
+        }
+
+        if (run_cl != NULL) {
+            if (ngx_ts_kmp_track_write_chain(track, run_cl, run_pos, run_size)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+
+            run_cl = NULL;
+        }
+
         ngx_ts_kmp_write_be32(len_buf, nalu->size);
 
         if (ngx_kmp_out_track_write_frame_data(track,
@@ -642,6 +709,14 @@ ngx_ts_kmp_track_heavc_write_frame(ngx_ts_kmp_track_t *ts_track,
         }
     }
 
+    if (run_cl != NULL) {
+        if (ngx_ts_kmp_track_write_chain(track, run_cl, run_pos, run_size)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
     if (ngx_kmp_out_track_write_frame_end(track, frame) != NGX_OK) {
         ngx_log_error(NGX_LOG_NOTICE, &track->log, 0,
             "ngx_ts_kmp_track_heavc_write_frame: end frame failed");
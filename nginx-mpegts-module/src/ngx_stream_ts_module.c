@@ -14,6 +14,20 @@
 
 #define NGX_STREAM_TS_MAX_HEADER  4096
 
+#define NGX_STREAM_TS_RTP_HEADER_SIZE  12
+#define NGX_STREAM_TS_RTP_VERSION      2
+#define NGX_STREAM_TS_RTP_MP2T         33
+
+#define NGX_STREAM_TS_UDP_SLOT_SIZE    2048
+
+/* min consecutive late datagrams that are treated as a sequence reset */
+#define NGX_STREAM_TS_UDP_MAX_LATE     8
+
+
+typedef struct {
+    ngx_addr_t                  *multicast_interface;
+} ngx_stream_ts_main_conf_t;
+
 
 typedef struct {
     ngx_array_t                 *handlers;  /* ngx_ts_init_handler_t */
@@ -23,18 +37,57 @@ typedef struct {
     size_t                       buffer_size;
     size_t                       mem_limit;
     ngx_str_t                    dump_folder;
+
+    ngx_uint_t                   reorder_window;
+    ngx_msec_t                   reorder_delay;
 } ngx_stream_ts_srv_conf_t;
 
 
+typedef struct {
+    u_char                      *data;
+    size_t                       len;
+    unsigned                     used:1;
+} ngx_stream_ts_udp_slot_t;
+
+
+typedef struct {
+    ngx_stream_ts_udp_slot_t    *slots;
+    ngx_uint_t                   nslots;
+    ngx_uint_t                   head;
+    ngx_uint_t                   pending;
+    uint16_t                     next_seq;
+    ngx_uint_t                   late;      /* consecutive late datagrams */
+    ngx_event_t                  gap;
+
+    ngx_uint_t                   received;
+    ngx_uint_t                   reordered;
+    ngx_uint_t                   lost;
+    ngx_uint_t                   dropped;
+
+    unsigned                     started:1;
+    unsigned                     rtp:1;
+    unsigned                     synced:1;
+} ngx_stream_ts_udp_t;
+
+
 typedef struct {
     ngx_ts_stream_t             *ts;
     u_char                      *buf;
+    ngx_stream_ts_udp_t         *udp;
 } ngx_stream_ts_ctx_t;
 
 
 static void ngx_stream_ts_handler(ngx_stream_session_t *s);
 static void ngx_stream_ts_read_handler(ngx_event_t *rev);
+static ngx_stream_ts_udp_t *ngx_stream_ts_udp_create(
+    ngx_stream_session_t *s);
+static ngx_int_t ngx_stream_ts_udp_read(ngx_stream_session_t *s, u_char *p,
+    size_t n);
+static ngx_int_t ngx_stream_ts_init_process(ngx_cycle_t *cycle);
 static char *ngx_stream_ts(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_stream_ts_multicast_interface(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
+static void *ngx_stream_ts_create_main_conf(ngx_conf_t *cf);
 static void *ngx_stream_ts_create_conf(ngx_conf_t *cf);
 static char *ngx_stream_ts_merge_conf(ngx_conf_t *cf, void *parent,
     void *child);
@@ -84,34 +137,55 @@ static ngx_command_t  ngx_stream_ts_commands[] = {
       offsetof(ngx_stream_ts_srv_conf_t, dump_folder),
       NULL },
 
+    { ngx_string("ts_udp_reorder_window"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_ts_srv_conf_t, reorder_window),
+      NULL },
+
+    { ngx_string("ts_udp_reorder_delay"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_ts_srv_conf_t, reorder_delay),
+      NULL },
+
+    { ngx_string("ts_multicast_interface"),
+      NGX_STREAM_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_stream_ts_multicast_interface,
+      NGX_STREAM_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
 
 static ngx_stream_module_t  ngx_stream_ts_module_ctx = {
-    NULL,                          /* preconfiguration */
-    NULL,                          /* postconfiguration */
+    NULL,                               /* preconfiguration */
+    NULL,                               /* postconfiguration */
 
-    NULL,                          /* create main configuration */
-    NULL,                          /* init main configuration */
+    ngx_stream_ts_create_main_conf,     /* create main configuration */
+    NULL,                               /* init main configuration */
 
-    ngx_stream_ts_create_conf,     /* create server configuration */
-    ngx_stream_ts_merge_conf       /* merge server configuration */
+    ngx_stream_ts_create_conf,          /* create server configuration */
+    ngx_stream_ts_merge_conf            /* merge server configuration */
 };
 
 
 ngx_module_t  ngx_stream_ts_module = {
     NGX_MODULE_V1,
-    &ngx_stream_ts_module_ctx,     /* module context */
-    ngx_stream_ts_commands,        /* module directives */
-    NGX_STREAM_MODULE,             /* module type */
-    NULL,                          /* init master */
-    NULL,                          /* init module */
-    NULL,                          /* init process */
-    NULL,                          /* init thread */
-    NULL,                          /* exit thread */
-    NULL,                          /* exit process */
-    NULL,                          /* exit master */
+    &ngx_stream_ts_module_ctx,          /* module context */
+    ngx_stream_ts_commands,             /* module directives */
+    NGX_STREAM_MODULE,                  /* module type */
+    NULL,                               /* init master */
+    NULL,                               /* init module */
+    ngx_stream_ts_init_process,         /* init process */
+    NULL,                               /* init thread */
+    NULL,                               /* exit thread */
+    NULL,                               /* exit process */
+    NULL,                               /* exit master */
     NGX_MODULE_V1_PADDING
 };
 
@@ -131,6 +205,7 @@ ngx_stream_ts_add_init_handler(ngx_conf_t *cf,
 static void
 ngx_stream_ts_handler(ngx_stream_session_t *s)
 {
+    ngx_int_t                  rc;
     ngx_chain_t                in;
     ngx_ts_stream_t           *ts;
     ngx_connection_t          *c;
@@ -184,15 +259,31 @@ ngx_stream_ts_handler(ngx_stream_session_t *s)
         return;
     }
 
+    if (c->type == SOCK_DGRAM) {
+        ctx->udp = ngx_stream_ts_udp_create(s);
+        if (ctx->udp == NULL) {
+            ngx_stream_finalize_session(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
+            return;
+        }
+    }
+
     if (c->buffer && c->buffer->pos <= c->buffer->last) {
         ngx_log_debug1(NGX_LOG_DEBUG_STREAM, c->log, 0,
             "stream ts add preread buffer: %uz",
             c->buffer->last - c->buffer->pos);
 
-        in.buf = c->buffer;
-        in.next = NULL;
+        if (ctx->udp) {
+            rc = ngx_stream_ts_udp_read(s, c->buffer->pos,
+                c->buffer->last - c->buffer->pos);
+
+        } else {
+            in.buf = c->buffer;
+            in.next = NULL;
+
+            rc = ngx_ts_read(ts, &in);
+        }
 
-        if (ngx_ts_read(ts, &in) != NGX_OK) {
+        if (rc != NGX_OK) {
             ngx_stream_finalize_session(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return;
         }
@@ -256,6 +347,16 @@ ngx_stream_ts_read_handler(ngx_event_t *rev)
             break;
         }
 
+        if (ctx->udp) {
+            if (ngx_stream_ts_udp_read(s, ctx->buf, n) != NGX_OK) {
+                ngx_stream_finalize_session(s,
+                    NGX_STREAM_INTERNAL_SERVER_ERROR);
+                return;
+            }
+
+            continue;
+        }
+
         b.pos = ctx->buf;
         b.last = b.pos + n;
 
@@ -274,6 +375,588 @@ ngx_stream_ts_read_handler(ngx_event_t *rev)
 }
 
 
+static ngx_int_t
+ngx_stream_ts_udp_read_buf(ngx_ts_stream_t *ts, u_char *p, size_t n)
+{
+    ngx_buf_t    b;
+    ngx_chain_t  in;
+
+    ngx_memzero(&b, sizeof(ngx_buf_t));
+
+    b.pos = p;
+    b.last = p + n;
+
+    in.buf = &b;
+    in.next = NULL;
+
+    return ngx_ts_read(ts, &in);
+}
+
+
+static ngx_int_t
+ngx_stream_ts_udp_advance(ngx_stream_ts_ctx_t *ctx)
+{
+    ngx_stream_ts_udp_t       *udp;
+    ngx_stream_ts_udp_slot_t  *slot;
+
+    udp = ctx->udp;
+
+    slot = &udp->slots[udp->head];
+
+    udp->head = (udp->head + 1) % udp->nslots;
+    udp->next_seq++;
+
+    if (!slot->used) {
+        udp->lost++;
+        return NGX_OK;
+    }
+
+    slot->used = 0;
+    udp->pending--;
+
+    return ngx_stream_ts_udp_read_buf(ctx->ts, slot->data, slot->len);
+}
+
+
+static ngx_int_t
+ngx_stream_ts_udp_flush(ngx_stream_ts_ctx_t *ctx)
+{
+    ngx_stream_ts_udp_t  *udp;
+
+    udp = ctx->udp;
+
+    while (udp->pending > 0 && udp->slots[udp->head].used) {
+        if (ngx_stream_ts_udp_advance(ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_stream_ts_udp_reset(ngx_stream_ts_ctx_t *ctx)
+{
+    ngx_stream_ts_udp_t  *udp;
+
+    udp = ctx->udp;
+
+    /* deliver the buffered datagrams, the missing ones are lost */
+
+    while (udp->pending > 0) {
+        if (ngx_stream_ts_udp_advance(ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    if (udp->gap.timer_set) {
+        ngx_del_timer(&udp->gap);
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_stream_ts_udp_gap_handler(ngx_event_t *ev)
+{
+    uint16_t                   seq;
+    ngx_uint_t                 lost;
+    ngx_stream_ts_ctx_t       *ctx;
+    ngx_stream_ts_udp_t       *udp;
+    ngx_stream_session_t      *s;
+    ngx_stream_ts_srv_conf_t  *tscf;
+
+    s = ev->data;
+
+    ctx = ngx_stream_get_module_ctx(s, ngx_stream_ts_module);
+    udp = ctx->udp;
+
+    /* the missing datagrams did not arrive in time, skip them */
+
+    seq = udp->next_seq;
+    lost = udp->lost;
+
+    while (udp->pending > 0 && !udp->slots[udp->head].used) {
+        (void) ngx_stream_ts_udp_advance(ctx);
+    }
+
+    ngx_log_error(NGX_LOG_WARN, s->connection->log, 0,
+        "ngx_stream_ts_udp_gap_handler: "
+        "skipped %ui missing datagrams, seq: %uD",
+        udp->lost - lost, (uint32_t) seq);
+
+    if (ngx_stream_ts_udp_flush(ctx) != NGX_OK) {
+        ngx_stream_finalize_session(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
+        return;
+    }
+
+    if (udp->pending > 0) {
+        tscf = ngx_stream_get_module_srv_conf(s, ngx_stream_ts_module);
+        ngx_add_timer(&udp->gap, tscf->reorder_delay);
+    }
+}
+
+
+static void
+ngx_stream_ts_udp_cleanup(void *data)
+{
+    ngx_stream_session_t  *s = data;
+
+    ngx_stream_ts_ctx_t  *ctx;
+    ngx_stream_ts_udp_t  *udp;
+
+    ctx = ngx_stream_get_module_ctx(s, ngx_stream_ts_module);
+    udp = ctx->udp;
+
+    if (udp->gap.timer_set) {
+        ngx_del_timer(&udp->gap);
+    }
+
+    ngx_log_error(NGX_LOG_INFO, s->connection->log, 0,
+        "ngx_stream_ts_udp_cleanup: received: %ui, reordered: %ui, "
+        "lost: %ui, dropped: %ui",
+        udp->received, udp->reordered, udp->lost, udp->dropped);
+}
+
+
+static ngx_stream_ts_udp_t *
+ngx_stream_ts_udp_create(ngx_stream_session_t *s)
+{
+    ngx_connection_t          *c;
+    ngx_pool_cleanup_t        *cln;
+    ngx_stream_ts_udp_t       *udp;
+    ngx_stream_ts_srv_conf_t  *tscf;
+
+    c = s->connection;
+
+    udp = ngx_pcalloc(c->pool, sizeof(ngx_stream_ts_udp_t));
+    if (udp == NULL) {
+        return NULL;
+    }
+
+    cln = ngx_pool_cleanup_add(c->pool, 0);
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    tscf = ngx_stream_get_module_srv_conf(s, ngx_stream_ts_module);
+
+    udp->nslots = tscf->reorder_window;
+
+    udp->gap.handler = ngx_stream_ts_udp_gap_handler;
+    udp->gap.data = s;
+    udp->gap.log = c->log;
+    udp->gap.cancelable = 1;
+
+    cln->handler = ngx_stream_ts_udp_cleanup;
+    cln->data = s;
+
+    return udp;
+}
+
+
+static ngx_int_t
+ngx_stream_ts_udp_read(ngx_stream_session_t *s, u_char *p, size_t n)
+{
+    u_char                    *data, *buf;
+    size_t                     size;
+    uint16_t                   seq, diff;
+    ngx_uint_t                 i;
+    ngx_stream_ts_ctx_t       *ctx;
+    ngx_stream_ts_udp_t       *udp;
+    ngx_stream_ts_srv_conf_t  *tscf;
+    ngx_stream_ts_udp_slot_t  *slot;
+
+    ctx = ngx_stream_get_module_ctx(s, ngx_stream_ts_module);
+    udp = ctx->udp;
+
+    udp->received++;
+
+    if (!udp->started) {
+        udp->started = 1;
+
+        /* TS packets start with a 0x47 sync byte, RTP with version 2 */
+        udp->rtp = n >= NGX_STREAM_TS_RTP_HEADER_SIZE
+            && (p[0] >> 6) == NGX_STREAM_TS_RTP_VERSION
+            && (p[1] & 0x7f) == NGX_STREAM_TS_RTP_MP2T;
+
+        ngx_log_error(NGX_LOG_INFO, s->connection->log, 0,
+            "ngx_stream_ts_udp_read: input is %s",
+            udp->rtp ? "RTP/MP2T" : "raw MPEG-TS");
+    }
+
+    if (!udp->rtp) {
+        return ngx_stream_ts_udp_read_buf(ctx->ts, p, n);
+    }
+
+    /*
+     * RTP header
+     * RFC 3550, 5.1 RTP Fixed Header Fields
+     */
+
+    if (n < NGX_STREAM_TS_RTP_HEADER_SIZE) {
+        goto invalid;
+    }
+
+    size = NGX_STREAM_TS_RTP_HEADER_SIZE + (p[0] & 0x0f) * 4;
+
+    if (p[0] & 0x10) {
+        /* header extension */
+        if (n < size + 4) {
+            goto invalid;
+        }
+
+        size += 4 + ((p[size + 2] << 8) | p[size + 3]) * 4;
+    }
+
+    if (p[0] & 0x20) {
+        /* padding */
+        if (p[n - 1] > n) {
+            goto invalid;
+        }
+
+        n -= p[n - 1];
+    }
+
+    if (n < size) {
+        goto invalid;
+    }
+
+    seq = (p[2] << 8) | p[3];
+
+    data = p + size;
+    size = n - size;
+
+    if (!udp->synced) {
+        udp->synced = 1;
+        udp->next_seq = seq;
+    }
+
+    diff = seq - udp->next_seq;
+
+    if (diff >= 0x8000) {
+
+        /* late or duplicate, a long run of them means that the sender
+            restarted or its sequence jumped backward */
+
+        if (++udp->late < ngx_max(udp->nslots, NGX_STREAM_TS_UDP_MAX_LATE)) {
+            udp->dropped++;
+            return NGX_OK;
+        }
+
+        ngx_log_error(NGX_LOG_WARN, s->connection->log, 0,
+            "ngx_stream_ts_udp_read: "
+            "sequence reset, seq: %uD, expected: %uD",
+            (uint32_t) seq, (uint32_t) udp->next_seq);
+
+        if (ngx_stream_ts_udp_reset(ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        udp->next_seq = seq;
+        diff = 0;
+    }
+
+    udp->late = 0;
+
+    if (diff == 0 && udp->pending == 0) {
+        /* in order, no need to buffer */
+        udp->next_seq++;
+        if (udp->nslots > 0) {
+            udp->head = (udp->head + 1) % udp->nslots;
+        }
+
+        return ngx_stream_ts_udp_read_buf(ctx->ts, data, size);
+    }
+
+    if (udp->nslots == 0) {
+        /* reordering disabled */
+        udp->lost += diff;
+        udp->next_seq = seq + 1;
+
+        ngx_log_error(NGX_LOG_WARN, s->connection->log, 0,
+            "ngx_stream_ts_udp_read: "
+            "%uD missing datagrams before seq %uD",
+            (uint32_t) diff, (uint32_t) seq);
+
+        return ngx_stream_ts_udp_read_buf(ctx->ts, data, size);
+    }
+
+    if (udp->slots == NULL) {
+        udp->slots = ngx_pcalloc(s->connection->pool,
+            sizeof(udp->slots[0]) * udp->nslots);
+        if (udp->slots == NULL) {
+            return NGX_ERROR;
+        }
+
+        buf = ngx_pnalloc(s->connection->pool,
+            NGX_STREAM_TS_UDP_SLOT_SIZE * udp->nslots);
+        if (buf == NULL) {
+            return NGX_ERROR;
+        }
+
+        for (i = 0; i < udp->nslots; i++) {
+            udp->slots[i].data = buf + i * NGX_STREAM_TS_UDP_SLOT_SIZE;
+        }
+    }
+
+    /* the window is full, give up on the oldest missing datagrams */
+
+    if (diff >= 2 * udp->nslots) {
+
+        /* the datagram is past the whole window, clear it in one step */
+
+        if (ngx_stream_ts_udp_reset(ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        udp->lost += (uint16_t) (seq - udp->next_seq);
+        udp->next_seq = seq;
+        diff = 0;
+    }
+
+    for (; diff >= udp->nslots; diff--) {
+        if (ngx_stream_ts_udp_advance(ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    slot = &udp->slots[(udp->head + diff) % udp->nslots];
+
+    if (slot->used || size > NGX_STREAM_TS_UDP_SLOT_SIZE) {
+        udp->dropped++;
+        return NGX_OK;
+    }
+
+    ngx_memcpy(slot->data, data, size);
+    slot->len = size;
+    slot->used = 1;
+
+    udp->pending++;
+
+    if (diff > 0) {
+        udp->reordered++;
+    }
+
+    if (ngx_stream_ts_udp_flush(ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (udp->pending == 0) {
+        if (udp->gap.timer_set) {
+            ngx_del_timer(&udp->gap);
+        }
+
+    } else if (!udp->gap.timer_set) {
+        tscf = ngx_stream_get_module_srv_conf(s, ngx_stream_ts_module);
+        ngx_add_timer(&udp->gap, tscf->reorder_delay);
+    }
+
+    return NGX_OK;
+
+invalid:
+
+    ngx_log_error(NGX_LOG_WARN, s->connection->log, 0,
+        "ngx_stream_ts_udp_read: invalid rtp packet, size: %uz", n);
+    udp->dropped++;
+    return NGX_OK;
+}
+
+
+static void
+ngx_stream_ts_multicast_join(ngx_cycle_t *cycle, ngx_listening_t *ls,
+    ngx_stream_ts_main_conf_t *tmcf)
+{
+    int                   level, name, rc;
+    void                 *value;
+    socklen_t             len;
+    ngx_flag_t            join;
+    struct ip_mreq        mreq;
+    struct sockaddr_in   *sin;
+#if (NGX_HAVE_INET6)
+    struct ipv6_mreq      mreq6;
+    struct sockaddr_in6  *sin6;
+#endif
+#if (defined IP_MULTICAST_ALL || defined IPV6_MULTICAST_ALL)
+    int                   all;
+#endif
+
+    /*
+     * with reuseport, all the sockets bound to the group receive a copy of
+     * each datagram - restrict the socket of each worker to the groups it
+     * joined, and join only in the first worker, so that the stream will
+     * be handled by a single session
+     */
+
+#if (NGX_HAVE_REUSEPORT)
+    if (ls->reuseport && ls->worker != ngx_worker) {
+        return;
+    }
+#endif
+
+    join = ngx_worker == 0;
+
+    switch (ls->sockaddr->sa_family) {
+
+#if (NGX_HAVE_INET6)
+    case AF_INET6:
+        sin6 = (struct sockaddr_in6 *) ls->sockaddr;
+        if (!IN6_IS_ADDR_MULTICAST(&sin6->sin6_addr)) {
+            return;
+        }
+
+#ifdef IPV6_MULTICAST_ALL
+        all = 0;
+        if (setsockopt(ls->fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL,
+                       (const void *) &all, sizeof(int))
+            == -1)
+        {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                "ngx_stream_ts_multicast_join: "
+                "setsockopt(IPV6_MULTICAST_ALL) %V failed", &ls->addr_text);
+        }
+#endif
+
+        mreq6.ipv6mr_multiaddr = sin6->sin6_addr;
+        mreq6.ipv6mr_interface = 0;
+
+        level = IPPROTO_IPV6;
+        name = IPV6_JOIN_GROUP;
+        value = &mreq6;
+        len = sizeof(mreq6);
+        break;
+#endif
+
+    case AF_INET:
+        sin = (struct sockaddr_in *) ls->sockaddr;
+        if (!IN_MULTICAST(ntohl(sin->sin_addr.s_addr))) {
+            return;
+        }
+
+#ifdef IP_MULTICAST_ALL
+        all = 0;
+        if (setsockopt(ls->fd, IPPROTO_IP, IP_MULTICAST_ALL,
+                       (const void *) &all, sizeof(int))
+            == -1)
+        {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                "ngx_stream_ts_multicast_join: "
+                "setsockopt(IP_MULTICAST_ALL) %V failed", &ls->addr_text);
+        }
+#endif
+
+        mreq.imr_multiaddr = sin->sin_addr;
+        if (tmcf->multicast_interface) {
+            sin = (struct sockaddr_in *) tmcf->multicast_interface->sockaddr;
+            mreq.imr_interface = sin->sin_addr;
+
+        } else {
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        }
+
+        level = IPPROTO_IP;
+        name = IP_ADD_MEMBERSHIP;
+        value = &mreq;
+        len = sizeof(mreq);
+        break;
+
+    default:
+        return;
+    }
+
+    if (!join) {
+        return;
+    }
+
+    rc = setsockopt(ls->fd, level, name, value, len);
+    if (rc == -1 && ngx_socket_errno != NGX_EADDRINUSE) {
+        /* EADDRINUSE - already joined by a previous worker generation */
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+            "ngx_stream_ts_multicast_join: join %V failed", &ls->addr_text);
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_INFO, cycle->log, 0,
+        "ngx_stream_ts_multicast_join: joined %V", &ls->addr_text);
+}
+
+
+static ngx_flag_t
+ngx_stream_ts_listening_is_ts(ngx_listening_t *ls)
+{
+    ngx_uint_t                   i;
+    ngx_stream_port_t           *port;
+    ngx_stream_in_addr_t        *addr;
+    ngx_stream_addr_conf_t      *addr_conf;
+    ngx_stream_core_srv_conf_t  *cscf;
+#if (NGX_HAVE_INET6)
+    ngx_stream_in6_addr_t       *addr6;
+#endif
+
+    port = ls->servers;
+    for (i = 0; i < port->naddrs; i++) {
+
+        switch (ls->sockaddr->sa_family) {
+
+#if (NGX_HAVE_INET6)
+        case AF_INET6:
+            addr6 = port->addrs;
+            addr_conf = &addr6[i].conf;
+            break;
+#endif
+
+        default:
+            addr = port->addrs;
+            addr_conf = &addr[i].conf;
+            break;
+        }
+
+#if (nginx_version >= 1025005)
+        cscf = addr_conf->default_server;
+#else
+        cscf = addr_conf->ctx->srv_conf[ngx_stream_core_module.ctx_index];
+#endif
+
+        if (cscf->handler == ngx_stream_ts_handler) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+static ngx_int_t
+ngx_stream_ts_init_process(ngx_cycle_t *cycle)
+{
+    ngx_uint_t                  i;
+    ngx_listening_t            *ls;
+    ngx_stream_ts_main_conf_t  *tmcf;
+
+    tmcf = ngx_stream_cycle_get_module_main_conf(cycle, ngx_stream_ts_module);
+    if (tmcf == NULL) {
+        return NGX_OK;
+    }
+
+    ls = cycle->listening.elts;
+    for (i = 0; i < cycle->listening.nelts; i++) {
+
+        if (ls[i].type != SOCK_DGRAM || ls[i].fd == (ngx_socket_t) -1
+            || ls[i].handler != ngx_stream_init_connection
+            || !ngx_stream_ts_listening_is_ts(&ls[i]))
+        {
+            continue;
+        }
+
+        ngx_stream_ts_multicast_join(cycle, &ls[i], tmcf);
+    }
+
+    return NGX_OK;
+}
+
+
 static char *
 ngx_stream_ts(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -286,6 +969,54 @@ ngx_stream_ts(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_stream_ts_multicast_interface(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf)
+{
+    ngx_stream_ts_main_conf_t  *tmcf = conf;
+
+    ngx_str_t   *value;
+    ngx_addr_t  *addr;
+
+    if (tmcf->multicast_interface != NULL) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    addr = ngx_palloc(cf->pool, sizeof(ngx_addr_t));
+    if (addr == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (ngx_parse_addr(cf->pool, addr, value[1].data, value[1].len)
+        != NGX_OK || addr->sockaddr->sa_family != AF_INET)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+            "invalid ipv4 address \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    tmcf->multicast_interface = addr;
+
+    return NGX_CONF_OK;
+}
+
+
+static void *
+ngx_stream_ts_create_main_conf(ngx_conf_t *cf)
+{
+    ngx_stream_ts_main_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_stream_ts_main_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    return conf;
+}
+
+
 static void *
 ngx_stream_ts_create_conf(ngx_conf_t *cf)
 {
@@ -302,6 +1033,9 @@ ngx_stream_ts_create_conf(ngx_conf_t *cf)
     conf->buffer_size = NGX_CONF_UNSET_SIZE;
     conf->mem_limit = NGX_CONF_UNSET_SIZE;
 
+    conf->reorder_window = NGX_CONF_UNSET_UINT;
+    conf->reorder_delay = NGX_CONF_UNSET_MSEC;
+
     return conf;
 }
 
@@ -324,5 +1058,8 @@ ngx_stream_ts_merge_conf(ngx_conf_t *cf, void *parent, void *child)
         5 * 1024 * 1024);
     ngx_conf_merge_str_value(conf->dump_folder, prev->dump_folder, "");
 
+    ngx_conf_merge_uint_value(conf->reorder_window, prev->reorder_window, 32);
+    ngx_conf_merge_msec_value(conf->reorder_delay, prev->reorder_delay, 50);
+
     return NGX_CONF_OK;
 }
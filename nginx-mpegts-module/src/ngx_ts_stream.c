@@ -11,8 +11,21 @@
 
 
 #define NGX_TS_PACKET_SIZE       188
+#define NGX_TS_SYNC_BYTE         0x47
 #define NGX_TS_CC_UNSET          ((u_char) -1)
 
+#define NGX_TS_PID_COUNT         8192
+
+/*
+ * pid table entry - 1-based program index in the high byte, 1-based es
+ * index in the low byte (zero for the PMT pid), zero for an unknown pid
+ */
+#define ngx_ts_pid_entry(prog, es)  (((prog) + 1) << 8 | (es))
+#define ngx_ts_pid_prog(e)          (((e) >> 8) - 1)
+#define ngx_ts_pid_es(e)            ((e) & 0xff)
+
+#define ngx_ts_packet_pid(p)     (((p)[1] & 0x1f) << 8 | (p)[2])
+
 #define NGX_TS_ISO8601_DATE_LEN  (sizeof("yyyy-mm-dd") - 1)
 
 
@@ -47,6 +60,7 @@ static ngx_int_t ngx_ts_byte_read16(ngx_ts_byte_read_t *br, uint16_t *v);
 
 static ssize_t ngx_ts_read_header(ngx_ts_stream_t *ts, u_char *p,
     ngx_ts_header_t *h);
+static void ngx_ts_sync(ngx_ts_stream_t *ts, ngx_buf_t *b);
 static ngx_int_t ngx_ts_read_packet(ngx_ts_stream_t *ts, ngx_buf_t *b);
 static ngx_int_t ngx_ts_read_pat(ngx_ts_stream_t *ts, ngx_ts_header_t *h,
     ngx_buf_t *b);
@@ -361,6 +375,7 @@ ngx_int_t
 ngx_ts_read(ngx_ts_stream_t *ts, ngx_chain_t *in)
 {
     size_t        n, size;
+    uint16_t      pid;
     ngx_buf_t    *b;
     ngx_chain_t  *cl;
 
@@ -376,6 +391,35 @@ ngx_ts_read(ngx_ts_stream_t *ts, ngx_chain_t *in)
             b = ts->buf;
 
             if (b == NULL) {
+
+                /* packet boundary */
+
+                if (*in->buf->pos != NGX_TS_SYNC_BYTE) {
+                    ngx_ts_sync(ts, in->buf);
+                    continue;
+                }
+
+                if (in->buf->last - in->buf->pos >= NGX_TS_PACKET_SIZE) {
+
+                    /*
+                     * the whole packet is available, drop packets of
+                     * unknown pids (e.g. null packets) without copying them
+                     */
+
+                    pid = ngx_ts_packet_pid(in->buf->pos);
+
+                    if (pid != 0
+                        && (ts->pids == NULL || ts->pids[pid] == 0))
+                    {
+                        ngx_log_debug1(NGX_LOG_DEBUG_CORE, ts->log, 0,
+                            "dropping unexpected TS packet pid:0x%04uxd",
+                            (unsigned) pid);
+
+                        in->buf->pos += NGX_TS_PACKET_SIZE;
+                        continue;
+                    }
+                }
+
                 if (ts->free) {
                     cl = ts->free;
                     ts->free = cl->next;
@@ -428,12 +472,46 @@ ngx_ts_read(ngx_ts_stream_t *ts, ngx_chain_t *in)
 }
 
 
+static void
+ngx_ts_sync(ngx_ts_stream_t *ts, ngx_buf_t *b)
+{
+    u_char  *p, *last;
+
+    /*
+     * sync lost - look for a sync byte that is followed by another sync
+     * byte one packet later, or by the end of the buffer.
+     * memchr is vectorized in most libc implementations.
+     */
+
+    last = b->last;
+
+    for (p = b->pos + 1; p < last; p++) {
+
+        p = memchr(p, NGX_TS_SYNC_BYTE, last - p);
+        if (p == NULL) {
+            p = last;
+            break;
+        }
+
+        if (last - p <= NGX_TS_PACKET_SIZE
+            || p[NGX_TS_PACKET_SIZE] == NGX_TS_SYNC_BYTE)
+        {
+            break;
+        }
+    }
+
+    ngx_log_error(NGX_LOG_WARN, ts->log, 0,
+        "TS sync lost, skipped %uz bytes", (size_t) (p - b->pos));
+
+    b->pos = p;
+}
+
+
 static ngx_int_t
 ngx_ts_read_packet(ngx_ts_stream_t *ts, ngx_buf_t *b)
 {
     ssize_t            n;
-    ngx_uint_t         i, j;
-    ngx_chain_t       *cl;
+    uint16_t           entry;
     ngx_ts_es_t       *es;
     ngx_ts_header_t    h;
     ngx_ts_program_t  *prog;
@@ -455,36 +533,25 @@ ngx_ts_read_packet(ngx_ts_stream_t *ts, ngx_buf_t *b)
         return ngx_ts_read_pat(ts, &h, b);
     }
 
-    for (i = 0; i < ts->nprogs; i++) {
-        prog = &ts->progs[i];
+    entry = ts->pids ? ts->pids[h.pid] : 0;
 
-        if (h.pid == prog->pid) {
-            return ngx_ts_read_pmt(ts, prog, &h, b);
-        }
+    if (entry == 0) {
+        ngx_log_debug1(NGX_LOG_DEBUG_CORE, ts->log, 0,
+                      "dropping unexpected TS packet pid:0x%04uxd",
+                      (unsigned) h.pid);
 
-        for (j = 0; j < prog->nes; j++) {
-            es = &prog->es[j];
-
-            if (h.pid == es->pid) {
-                return ngx_ts_read_pes(ts, prog, es, &h, b);
-            }
-        }
+        return ngx_ts_free_buf(ts, b);
     }
 
-    ngx_log_debug1(NGX_LOG_DEBUG_CORE, ts->log, 0,
-                  "dropping unexpected TS packet pid:0x%04uxd",
-                  (unsigned) h.pid);
+    prog = &ts->progs[ngx_ts_pid_prog(entry)];
 
-    cl = ngx_alloc_chain_link(ts->pool);
-    if (cl == NULL) {
-        return NGX_ERROR;
+    if (ngx_ts_pid_es(entry) == 0) {
+        return ngx_ts_read_pmt(ts, prog, &h, b);
     }
 
-    cl->buf = b;
-    cl->next = ts->free;
-    ts->free = cl;
+    es = &prog->es[ngx_ts_pid_es(entry) - 1];
 
-    return NGX_OK;
+    return ngx_ts_read_pes(ts, prog, es, &h, b);
 }
 
 
@@ -690,6 +757,22 @@ ngx_ts_read_pat(ngx_ts_stream_t *ts, ngx_ts_header_t *h, ngx_buf_t *b)
 
     ts->nprogs = prog - ts->progs;
 
+    if (ts->pids == NULL) {
+        ts->pids = ngx_pcalloc(ts->pool,
+                               NGX_TS_PID_COUNT * sizeof(uint16_t));
+        if (ts->pids == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    for (n = 0; n < ts->nprogs; n++) {
+        pid = ts->progs[n].pid;
+
+        if (pid != 0 && ts->pids[pid] == 0) {
+            ts->pids[pid] = ngx_ts_pid_entry(n, 0);
+        }
+    }
+
     if (ngx_ts_run_handlers(NGX_TS_PAT, ts, NULL, NULL, NULL) != NGX_OK) {
         return NGX_ERROR;
     }
@@ -859,6 +942,10 @@ ngx_ts_read_pmt(ngx_ts_stream_t *ts, ngx_ts_program_t *prog, ngx_ts_header_t *h,
 
         ngx_ts_bufs_init(es->bufs);
 
+        if (pid != 0 && ts->pids[pid] == 0) {
+            ts->pids[pid] = ngx_ts_pid_entry(prog - ts->progs, n + 1);
+        }
+
         ngx_log_debug3(NGX_LOG_DEBUG_CORE, ts->log, 0,
                        "ts es type:%ui, video:%d, pid:0x%04uxd",
                        (ngx_uint_t) type, es->video, (unsigned) pid);
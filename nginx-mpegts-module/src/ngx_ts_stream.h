@@ -88,6 +88,7 @@ typedef struct {
     ngx_buf_t                    *buf;
     ngx_chain_t                  *free;
     ngx_ts_bufs_t                 bufs;  /* PAT */
+    uint16_t                     *pids;  /* pid -> prog / es index */
     ngx_ts_handler_t             *handlers;
     void                         *data;
     ngx_str_t                     stream_id;
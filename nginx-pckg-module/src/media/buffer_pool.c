@@ -5,8 +5,9 @@
 
 // typedefs
 struct buffer_pool_s {
-    size_t size;
+    vod_pool_t* pool;
     void* head;
+    buffer_pool_stats_t stats;
 };
 
 typedef struct {
@@ -14,12 +15,35 @@ typedef struct {
     void* buffer;
 } buffer_pool_cleanup_t;
 
+static vod_status_t
+buffer_pool_add_buffers(buffer_pool_t* buffer_pool, vod_log_t* log, size_t count)
+{
+    u_char* cur_buffer;
+    size_t buffer_size = buffer_pool->stats.size;
+
+    cur_buffer = vod_alloc(buffer_pool->pool, buffer_size * count);
+    if (cur_buffer == NULL)
+    {
+        vod_log_debug0(VOD_LOG_DEBUG_LEVEL, log, 0,
+            "buffer_pool_add_buffers: vod_alloc failed");
+        return VOD_ALLOC_FAILED;
+    }
+
+    buffer_pool->stats.count += count;
+
+    for (; count > 0; count--, cur_buffer += buffer_size)
+    {
+        next_buffer(cur_buffer) = buffer_pool->head;
+        buffer_pool->head = cur_buffer;
+    }
+
+    return VOD_OK;
+}
+
 buffer_pool_t*
-buffer_pool_create(vod_pool_t* pool, vod_log_t* log, size_t buffer_size, size_t count)
+buffer_pool_create(vod_pool_t* pool, vod_log_t* log, size_t buffer_size, size_t count, size_t max_count)
 {
     buffer_pool_t* buffer_pool;
-    u_char* cur_buffer;
-    void* head;
 
     if ((buffer_size & 0x0f) != 0)
     {
@@ -28,36 +52,63 @@ buffer_pool_create(vod_pool_t* pool, vod_log_t* log, size_t buffer_size, size_t
         return NULL;
     }
 
+    if (max_count < count)
+    {
+        vod_log_error(VOD_LOG_ERR, log, 0,
+            "buffer_pool_create: max count %uz is smaller than count %uz", max_count, count);
+        return NULL;
+    }
+
     buffer_pool = vod_alloc(pool, sizeof(*buffer_pool));
     if (buffer_pool == NULL)
     {
         vod_log_debug0(VOD_LOG_DEBUG_LEVEL, log, 0,
-            "buffer_pool_create: vod_alloc failed (1)");
+            "buffer_pool_create: vod_alloc failed");
         return NULL;
     }
 
-    cur_buffer = vod_alloc(pool, buffer_size * count);
-    if (cur_buffer == NULL)
+    vod_memzero(buffer_pool, sizeof(*buffer_pool));
+
+    buffer_pool->pool = pool;
+    buffer_pool->stats.size = buffer_size;
+    buffer_pool->stats.max_count = max_count;
+
+    if (count > 0 && buffer_pool_add_buffers(buffer_pool, log, count) != VOD_OK)
     {
-        vod_log_debug0(VOD_LOG_DEBUG_LEVEL, log, 0,
-            "buffer_pool_create: vod_alloc failed (2)");
         return NULL;
     }
 
-    head = NULL;
-    for (; count > 0; count--, cur_buffer += buffer_size)
+    return buffer_pool;
+}
+
+buffer_pool_stats_t*
+buffer_pool_get_stats(buffer_pool_t* buffer_pool)
+{
+    return &buffer_pool->stats;
+}
+
+// grow the pool when it runs dry, doubling the number of buffers up to max_count.
+// the buffers are allocated from the pool the buffer pool was created on, so that
+// they outlive the request that triggered the allocation
+static void
+buffer_pool_grow(buffer_pool_t* buffer_pool, vod_log_t* log)
+{
+    size_t count;
+
+    count = buffer_pool->stats.max_count - buffer_pool->stats.count;
+    if (count == 0)
     {
-        next_buffer(cur_buffer) = head;
-        head = cur_buffer;
+        return;
     }
 
-    buffer_pool->size = buffer_size;
-    buffer_pool->head = head;
+    if (buffer_pool->stats.count > 0 && count > buffer_pool->stats.count)
+    {
+        count = buffer_pool->stats.count;
+    }
 
-    return buffer_pool;
+    (void)buffer_pool_add_buffers(buffer_pool, log, count);
 }
 
-
 static void
 buffer_pool_buffer_cleanup(void *data)
 {
@@ -67,6 +118,7 @@ buffer_pool_buffer_cleanup(void *data)
 
     next_buffer(buffer) = buffer_pool->head;
     buffer_pool->head = buffer;
+    buffer_pool->stats.in_use--;
 }
 
 void*
@@ -83,8 +135,13 @@ buffer_pool_alloc(request_context_t* request_context, buffer_pool_t* buffer_pool
 
     if (buffer_pool->head == NULL)
     {
-        *buffer_size = buffer_pool->size;
-        return vod_alloc(request_context->pool, *buffer_size);
+        buffer_pool_grow(buffer_pool, request_context->log);
+        if (buffer_pool->head == NULL)
+        {
+            buffer_pool->stats.misses++;
+            *buffer_size = buffer_pool->stats.size;
+            return vod_alloc(request_context->pool, *buffer_size);
+        }
     }
 
     cln = vod_pool_cleanup_add(request_context->pool, sizeof(buffer_pool_cleanup_t));
@@ -104,7 +161,14 @@ buffer_pool_alloc(request_context_t* request_context, buffer_pool_t* buffer_pool
     buf_cln->buffer = result;
     buf_cln->buffer_pool = buffer_pool;
 
-    *buffer_size = buffer_pool->size;
+    buffer_pool->stats.hits++;
+    buffer_pool->stats.in_use++;
+    if (buffer_pool->stats.in_use > buffer_pool->stats.max_in_use)
+    {
+        buffer_pool->stats.max_in_use = buffer_pool->stats.in_use;
+    }
+
+    *buffer_size = buffer_pool->stats.size;
 
     return result;
 }
@@ -4,8 +4,20 @@
 // includes
 #include "common.h"
 
+// typedefs
+typedef struct {
+    size_t size;
+    size_t count;
+    size_t max_count;
+    size_t in_use;
+    size_t max_in_use;
+    uint64_t hits;
+    uint64_t misses;
+} buffer_pool_stats_t;
+
 // functions
-buffer_pool_t* buffer_pool_create(vod_pool_t* pool, vod_log_t* log, size_t buffer_size, size_t count);
+buffer_pool_t* buffer_pool_create(vod_pool_t* pool, vod_log_t* log, size_t buffer_size, size_t count, size_t max_count);
 void* buffer_pool_alloc(request_context_t* reqeust_context, buffer_pool_t* buffer_pool, size_t* buffer_size);
+buffer_pool_stats_t* buffer_pool_get_stats(buffer_pool_t* buffer_pool);
 
 #endif // __BUFFER_POOL_H__
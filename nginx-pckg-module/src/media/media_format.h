@@ -161,6 +161,12 @@ typedef struct {
     uint32_t k3;
 } media_bitrate_estimator_t;
 
+// byte range relative to the muxer output (end is exclusive)
+typedef struct {
+    off_t start;
+    off_t end;
+} media_range_t;
+
 
 size_t media_segment_track_get_total_size(media_segment_track_t* track);
 
@@ -61,6 +61,10 @@ struct mp4_muxer_state_s {
     frames_source_t* frames_source;
     void* frames_source_context;
     bool_t first_time;
+
+    // output range
+    uint64_t skip_size;
+    uint64_t size_left;
 };
 
 
@@ -682,6 +686,8 @@ mp4_muxer_init_state(
     state->cur_frame = NULL;
     state->selected_stream = NULL;
     state->first_time = TRUE;
+    state->skip_size = 0;
+    state->size_left = ULLONG_MAX;
 
     index = 0;
     for (cur_stream = state->first_stream; cur_stream < state->last_stream; cur_stream++, index++)
@@ -1252,7 +1258,33 @@ mp4_muxer_process_frames(mp4_muxer_state_t* state)
 
         processed_data = TRUE;
 
-        if (state->reuse_buffers)
+        // trim the data to the requested range
+        if (state->skip_size > 0)
+        {
+            if (read_size <= state->skip_size)
+            {
+                state->skip_size -= read_size;
+                read_size = 0;
+            }
+            else
+            {
+                read_buffer += state->skip_size;
+                read_size -= state->skip_size;
+                state->skip_size = 0;
+            }
+        }
+
+        if (read_size > state->size_left)
+        {
+            read_size = state->size_left;
+        }
+        state->size_left -= read_size;
+
+        if (read_size == 0)
+        {
+            // nothing to write, the data is outside the requested range
+        }
+        else if (state->reuse_buffers)
         {
             rc = selected_stream->write_callback(selected_stream->write_context, read_buffer, read_size);
             if (rc != VOD_OK)
@@ -1291,6 +1323,21 @@ mp4_muxer_process_frames(mp4_muxer_state_t* state)
             last_stream = selected_stream;
         }
 
+        if (state->size_left == 0)
+        {
+            // reached the end of the requested range
+            if (write_buffer_size != 0)
+            {
+                rc = last_stream->write_callback(last_stream->write_context, write_buffer, write_buffer_size);
+                if (rc != VOD_OK)
+                {
+                    return rc;
+                }
+            }
+
+            break;
+        }
+
         if (!frame_done)
         {
             continue;
@@ -1331,6 +1378,18 @@ mp4_muxer_process_frames(mp4_muxer_state_t* state)
     return VOD_OK;
 }
 
+vod_status_t
+mp4_muxer_set_range(mp4_muxer_state_t* state, media_range_t* range)
+{
+    // the offsets of all frames are known in advance, so the range is applied exactly -
+    // data before the range start is skipped without being written, and processing stops
+    // once the range end is reached
+    state->skip_size = range->start;
+    state->size_left = range->end - range->start;
+
+    return VOD_OK;
+}
+
 void
 mp4_muxer_get_bitrate_estimator(
     media_info_t** media_infos,
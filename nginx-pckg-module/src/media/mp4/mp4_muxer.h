@@ -30,6 +30,8 @@ vod_status_t mp4_muxer_init_fragment(
 
 vod_status_t mp4_muxer_process_frames(mp4_muxer_state_t* state);
 
+vod_status_t mp4_muxer_set_range(mp4_muxer_state_t* state, media_range_t* range);
+
 void mp4_muxer_get_bitrate_estimator(
     media_info_t** media_infos,
     uint32_t count,
@@ -24,6 +24,14 @@ struct id3_context_s {
     id3_track_t* cur_track;
 };
 
+typedef struct {
+    vod_list_part_t* cur_frame_part;
+    input_frame_t* cur_frame;
+    input_frame_t* last_part_frame;
+    uint64_t next_frame_time_offset;
+    unsigned cc;
+} mpegts_muxer_stream_pos_t;
+
 // forward decls
 static vod_status_t mpegts_muxer_start_frame(mpegts_muxer_state_t* state);
 static vod_status_t mpegts_muxer_simulate_get_segment_size(mpegts_muxer_state_t* state, size_t* result);
@@ -259,6 +267,11 @@ mpegts_muxer_init_base(
     state->cur_frame = NULL;
     state->first_time = TRUE;
 
+    // ranges can be served only when the encoder state can be reconstructed from the simulation,
+    // this requires that every frame will be written in full packets
+    state->range_supported = *simulation_supported && !conf->interleave_frames && conf->align_frames;
+    state->range_end = VOD_MAX_OFF_T_VALUE;
+
     state->segment = media_segment;
 
     // init the packetizer streams and get the packet ids / stream ids
@@ -463,22 +476,15 @@ mpegts_muxer_init_segment(
 
         mpegts_muxer_simulation_reset(state);
     }
-
-    rc = mpegts_muxer_start_frame(state);
-    if (rc != VOD_OK)
-    {
-        if (rc != VOD_NOT_FOUND)
-        {
-            return rc;
-        }
-
-        *processor_state = NULL;        // no frames, nothing to do
-    }
     else
     {
-        *processor_state = state;
+        state->range_supported = FALSE;
     }
 
+    // Note: the first frame is started on the first call to process, in order to allow
+    //        the caller to set an output range
+    *processor_state = state;
+
     return VOD_OK;
 }
 
@@ -632,6 +638,20 @@ mpegts_muxer_process(mpegts_muxer_state_t* state)
     bool_t wrote_data = FALSE;
     bool_t frame_done;
 
+    if (state->cur_frame == NULL)
+    {
+        rc = mpegts_muxer_start_frame(state);
+        if (rc != VOD_OK)
+        {
+            if (rc != VOD_NOT_FOUND)
+            {
+                return rc;
+            }
+
+            return write_buffer_queue_flush(&state->queue);        // no frames
+        }
+    }
+
     for (;;)
     {
         // read some data from the frame
@@ -683,6 +703,11 @@ mpegts_muxer_process(mpegts_muxer_state_t* state)
             return rc;
         }
 
+        if (state->queue.cur_offset >= state->range_end)
+        {
+            break;        // all the data of the requested range was written
+        }
+
         rc = mpegts_muxer_start_frame(state);
         if (rc != VOD_OK)
         {
@@ -838,6 +863,228 @@ mpegts_muxer_simulation_reset(mpegts_muxer_state_t* state)
     state->cur_frame = NULL;
 }
 
+bool_t
+mpegts_muxer_range_supported(mpegts_muxer_state_t* state)
+{
+    return state->range_supported;
+}
+
+
+static bool_t
+mpegts_muxer_simulation_is_sync_point(mpegts_muxer_state_t* state)
+{
+    mpegts_muxer_stream_state_t* cur_stream;
+    uint64_t buffer_dts;
+
+    // a sync point is a position in which all packets are closed and no frames are buffered,
+    // the state of the real encoders in this position can be reproduced from the simulation
+    for (cur_stream = state->first_stream; cur_stream < state->last_stream; cur_stream++)
+    {
+        if (cur_stream->mpegts_encoder_state.temp_packet_size > 0)
+        {
+            return FALSE;
+        }
+
+        if (cur_stream->filter_context.context[MEDIA_FILTER_BUFFER] != NULL &&
+            buffer_filter_get_dts(&cur_stream->filter_context, &buffer_dts))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+static void
+mpegts_muxer_simulation_save_pos(mpegts_muxer_state_t* state, mpegts_muxer_stream_pos_t* pos)
+{
+    mpegts_muxer_stream_state_t* cur_stream;
+
+    for (cur_stream = state->first_stream; cur_stream < state->last_stream; cur_stream++, pos++)
+    {
+        pos->cur_frame_part = cur_stream->cur_frame_part;
+        pos->cur_frame = cur_stream->cur_frame;
+        pos->last_part_frame = cur_stream->last_part_frame;
+        pos->next_frame_time_offset = cur_stream->next_frame_time_offset;
+        pos->cc = cur_stream->mpegts_encoder_state.cc;
+    }
+}
+
+
+static vod_status_t
+mpegts_muxer_skip_frames(mpegts_muxer_stream_state_t* stream, input_frame_t* end_frame)
+{
+    vod_list_part_t* part;
+    input_frame_t* cur_frame;
+    input_frame_t* last_frame;
+    u_char* read_buffer;
+    uint32_t read_size;
+    vod_status_t rc;
+    bool_t frame_done;
+
+    // advance the frames source past the frames that precede the range
+    for (part = stream->first_frame_part; part != NULL; part = part->next)
+    {
+        cur_frame = part->elts;
+        last_frame = cur_frame + part->nelts;
+        for (;; cur_frame++)
+        {
+            if (cur_frame == end_frame)
+            {
+                return VOD_OK;
+            }
+
+            if (cur_frame >= last_frame)
+            {
+                break;
+            }
+
+            rc = stream->frames_source->start_frame(stream->frames_source_context, cur_frame);
+            if (rc != VOD_OK)
+            {
+                return rc;
+            }
+
+            do
+            {
+                rc = stream->frames_source->read(stream->frames_source_context, &read_buffer, &read_size, &frame_done);
+                if (rc != VOD_OK)
+                {
+                    return rc;
+                }
+            } while (!frame_done);
+        }
+    }
+
+    return VOD_OK;
+}
+
+
+vod_status_t
+mpegts_muxer_set_range(mpegts_muxer_state_t* state, media_range_t* range)
+{
+    mpegts_muxer_stream_state_t* selected_stream;
+    mpegts_muxer_stream_state_t* cur_stream;
+    mpegts_muxer_stream_pos_t* sync_pos;
+    mpegts_muxer_stream_pos_t* cur_pos;
+    mpegts_muxer_stream_pos_t* pos;
+    input_frame_t* cur_frame;
+    uint64_t cur_frame_dts;
+    off_t range_start;
+    off_t sync_offset;
+    vod_status_t rc;
+    size_t stream_count;
+
+    if (!state->range_supported || state->cur_frame != NULL)
+    {
+        vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+            "mpegts_muxer_set_range: range not supported");
+        return VOD_UNEXPECTED;
+    }
+
+    stream_count = state->last_stream - state->first_stream;
+
+    sync_pos = vod_alloc(state->request_context->pool, sizeof(sync_pos[0]) * stream_count * 2);
+    if (sync_pos == NULL)
+    {
+        vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+            "mpegts_muxer_set_range: vod_alloc failed");
+        return VOD_ALLOC_FAILED;
+    }
+
+    cur_pos = sync_pos + stream_count;
+
+    // the range is relative to the muxer output, while the queue offsets include the PAT/PMT
+    range_start = range->start + 2 * MPEGTS_PACKET_SIZE;
+
+    // run the simulation to find the last sync point that precedes the range start
+    mpegts_encoder_simulated_start_segment(&state->queue);
+
+    mpegts_muxer_simulation_save_pos(state, sync_pos);
+    sync_offset = state->queue.cur_offset;
+
+    for (;;)
+    {
+        mpegts_muxer_simulation_save_pos(state, cur_pos);
+
+        rc = mpegts_muxer_choose_stream(state, &selected_stream);
+        if (rc != VOD_OK)
+        {
+            if (rc == VOD_NOT_FOUND)
+            {
+                break;        // done
+            }
+            return rc;
+        }
+
+        cur_frame = selected_stream->cur_frame;
+        selected_stream->cur_frame++;
+        cur_frame_dts = selected_stream->next_frame_time_offset;
+        selected_stream->next_frame_time_offset += cur_frame->duration;
+
+        mpegts_muxer_simulation_flush_delayed_streams(state, selected_stream, cur_frame_dts);
+
+        if (mpegts_muxer_simulation_is_sync_point(state))
+        {
+            if (state->queue.cur_offset > range_start)
+            {
+                break;
+            }
+
+            // Note: the stream positions are taken before the frame was selected,
+            //        while the continuity counters include the delayed flush
+            for (cur_stream = state->first_stream, pos = cur_pos; cur_stream < state->last_stream; cur_stream++, pos++)
+            {
+                pos->cc = cur_stream->mpegts_encoder_state.cc;
+            }
+
+            vod_memcpy(sync_pos, cur_pos, sizeof(sync_pos[0]) * stream_count);
+            sync_offset = state->queue.cur_offset;
+        }
+
+        mpegts_muxer_simulation_write_frame(
+            selected_stream,
+            cur_frame,
+            cur_frame_dts,
+            selected_stream->cur_frame >= selected_stream->last_part_frame &&
+                selected_stream->cur_frame_part->next == NULL);
+    }
+
+    vod_log_debug2(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+        "mpegts_muxer_set_range: requested offset %O, sync offset %O",
+        range_start, sync_offset);
+
+    // restore the state of the sync point
+    for (cur_stream = state->first_stream, pos = sync_pos; cur_stream < state->last_stream; cur_stream++, pos++)
+    {
+        rc = mpegts_muxer_skip_frames(cur_stream, pos->cur_frame);
+        if (rc != VOD_OK)
+        {
+            return rc;
+        }
+
+        cur_stream->cur_frame_part = pos->cur_frame_part;
+        cur_stream->cur_frame = pos->cur_frame;
+        cur_stream->last_part_frame = pos->last_part_frame;
+        cur_stream->next_frame_time_offset = pos->next_frame_time_offset;
+
+        cur_stream->mpegts_encoder_state.cc = pos->cc;
+        cur_stream->mpegts_encoder_state.temp_packet_size = 0;
+        cur_stream->mpegts_encoder_state.last_queue_offset = sync_offset;
+        cur_stream->mpegts_encoder_state.send_queue_offset = VOD_MAX_OFF_T_VALUE;
+    }
+
+    state->queue.cur_offset = sync_offset;
+    state->queue.last_writer_context = NULL;
+
+    state->range_end = range->end + 2 * MPEGTS_PACKET_SIZE;
+
+    range->start = sync_offset - 2 * MPEGTS_PACKET_SIZE;
+
+    return VOD_OK;
+}
+
 void
 mpegts_muxer_get_bitrate_estimator(
     mpegts_muxer_conf_t* conf,
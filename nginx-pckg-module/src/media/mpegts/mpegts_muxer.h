@@ -70,6 +70,10 @@ typedef struct {
     frames_source_t* frames_source;
     void* frames_source_context;
     bool_t first_time;
+
+    // output range
+    bool_t range_supported;
+    off_t range_end;
 } mpegts_muxer_state_t;
 
 // functions
@@ -87,6 +91,10 @@ vod_status_t mpegts_muxer_init_segment(
 
 vod_status_t mpegts_muxer_process(mpegts_muxer_state_t* state);
 
+bool_t mpegts_muxer_range_supported(mpegts_muxer_state_t* state);
+
+vod_status_t mpegts_muxer_set_range(mpegts_muxer_state_t* state, media_range_t* range);
+
 void mpegts_muxer_get_bitrate_estimator(
     mpegts_muxer_conf_t* conf,
     media_info_t** media_infos,
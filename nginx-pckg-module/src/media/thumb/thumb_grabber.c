@@ -10,6 +10,12 @@
 #define vod_abs_diff(val1, val2)                                            \
     ((val2) > (val1) ? (val2) - (val1) : (val1) - (val2))
 
+#define THUMB_GRABBER_MAX_CACHED_CONTEXTS (8)
+
+// when the output is smaller than the input by at least this factor, the decoder
+// is configured to trade quality for speed (the artifacts are not visible after scaling)
+#define THUMB_GRABBER_FAST_DECODE_RATIO (2)
+
 // typedefs
 typedef struct
 {
@@ -25,6 +31,7 @@ typedef struct
     AVFrame* decoded_frame;
     AVPacket* output_packet;
     void* resize_buffer;
+    bool_t rendered;
 
     // frame state
     frames_source_t* frames_source;
@@ -33,6 +40,7 @@ typedef struct
     vod_list_part_t* cur_frame_part;
     input_frame_t* cur_frame;
     input_frame_t* last_frame;
+    input_frame_t* target_frame;
     bool_t first_time;
     bool_t frame_started;
     uint64_t dts;
@@ -50,10 +58,20 @@ typedef struct {
     const char* name;
 } codec_id_mapping_t;
 
+typedef struct {
+    AVCodecContext* contexts[THUMB_GRABBER_MAX_CACHED_CONTEXTS];
+    uint32_t count;
+} thumb_grabber_context_cache_t;
+
 // globals
 static const AVCodec* decoder_codec[VOD_CODEC_ID_COUNT];
 static const AVCodec* encoder_codec = NULL;
 
+// Note: the codec contexts are acquired when a request starts, and released when its pool is destroyed,
+//        both happen on the main thread, so the caches do not require locking
+static thumb_grabber_context_cache_t decoder_cache;
+static thumb_grabber_context_cache_t encoder_cache;
+
 static codec_id_mapping_t codec_mappings[] = {
     { VOD_CODEC_ID_AVC, AV_CODEC_ID_H264, "h264" },
     { VOD_CODEC_ID_HEVC, AV_CODEC_ID_H265, "h265" },
@@ -99,6 +117,67 @@ thumb_grabber_process_init(vod_log_t* log)
 }
 
 
+static AVCodecContext*
+thumb_grabber_context_cache_get(
+    thumb_grabber_context_cache_t* cache,
+    const AVCodec* codec,
+    uint32_t width,
+    uint32_t height,
+    vod_str_t* extra_data)
+{
+    AVCodecContext** cur;
+    AVCodecContext** last;
+    AVCodecContext* result;
+
+    last = cache->contexts + cache->count;
+    for (cur = cache->contexts; cur < last; cur++)
+    {
+        result = *cur;
+        if (result->codec != codec ||
+            result->width != (int)width ||
+            result->height != (int)height)
+        {
+            continue;
+        }
+
+        if (extra_data != NULL &&
+            (result->extradata_size != (int)extra_data->len ||
+            vod_memcmp(result->extradata, extra_data->data, extra_data->len) != 0))
+        {
+            continue;
+        }
+
+        // remove from the cache
+        cache->count--;
+        *cur = cache->contexts[cache->count];
+        return result;
+    }
+
+    return NULL;
+}
+
+
+static void
+thumb_grabber_context_cache_put(thumb_grabber_context_cache_t* cache, AVCodecContext** context)
+{
+    if (*context == NULL)
+    {
+        return;
+    }
+
+    if (cache->count >= THUMB_GRABBER_MAX_CACHED_CONTEXTS)
+    {
+        // evict the oldest context
+        avcodec_free_context(&cache->contexts[0]);
+        cache->count--;
+        vod_memmove(cache->contexts, cache->contexts + 1, sizeof(cache->contexts[0]) * cache->count);
+    }
+
+    cache->contexts[cache->count++] = *context;
+    *context = NULL;
+}
+
+
 static void
 thumb_grabber_free_state(void* context)
 {
@@ -110,10 +189,55 @@ thumb_grabber_free_state(void* context)
         av_freep(state->resize_buffer);
     }
     av_frame_free(&state->decoded_frame);
-    avcodec_close(state->encoder);
-    av_free(state->encoder);
-    avcodec_close(state->decoder);
-    av_free(state->decoder);
+
+    if (state->rendered)
+    {
+        // the contexts are in a clean state, keep them for the next request
+        avcodec_flush_buffers(state->decoder);
+        thumb_grabber_context_cache_put(&decoder_cache, &state->decoder);
+        thumb_grabber_context_cache_put(&encoder_cache, &state->encoder);
+    }
+
+    avcodec_free_context(&state->encoder);
+    avcodec_free_context(&state->decoder);
+}
+
+
+static int
+thumb_grabber_get_lowres(const AVCodec* codec, media_info_t* media_info, uint32_t output_width, uint32_t output_height)
+{
+    int lowres;
+
+    // use the largest factor that keeps the decoded frame larger than the output
+    for (lowres = 0; lowres < codec->max_lowres; lowres++)
+    {
+        if ((media_info->u.video.width >> (lowres + 1)) < output_width ||
+            (media_info->u.video.height >> (lowres + 1)) < output_height)
+        {
+            break;
+        }
+    }
+
+    return lowres;
+}
+
+
+static void
+thumb_grabber_set_decode_options(AVCodecContext* decoder, media_info_t* media_info, uint32_t output_width, uint32_t output_height)
+{
+    if (output_width * THUMB_GRABBER_FAST_DECODE_RATIO <= media_info->u.video.width &&
+        output_height * THUMB_GRABBER_FAST_DECODE_RATIO <= media_info->u.video.height)
+    {
+        decoder->skip_loop_filter = AVDISCARD_ALL;
+        decoder->flags2 |= AV_CODEC_FLAG2_FAST;
+    }
+    else
+    {
+        decoder->skip_loop_filter = AVDISCARD_DEFAULT;
+        decoder->flags2 &= ~AV_CODEC_FLAG2_FAST;
+    }
+
+    decoder->skip_frame = AVDISCARD_DEFAULT;
 }
 
 
@@ -121,12 +245,43 @@ static vod_status_t
 thumb_grabber_init_decoder(
     request_context_t* request_context,
     media_info_t* media_info,
+    uint32_t output_width,
+    uint32_t output_height,
     AVCodecContext** result)
 {
+    const AVCodec* codec;
     AVCodecContext* decoder;
+    int lowres;
     int avrc;
 
-    decoder = avcodec_alloc_context3(decoder_codec[media_info->codec_id]);
+    codec = decoder_codec[media_info->codec_id];
+
+    lowres = thumb_grabber_get_lowres(codec, media_info, output_width, output_height);
+
+    decoder = thumb_grabber_context_cache_get(
+        &decoder_cache,
+        codec,
+        media_info->u.video.width,
+        media_info->u.video.height,
+        &media_info->extra_data);
+    if (decoder != NULL && decoder->lowres != lowres)
+    {
+        // the lowres factor cannot be changed after the decoder is opened
+        avcodec_free_context(&decoder);
+    }
+
+    if (decoder != NULL)
+    {
+        vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+            "thumb_grabber_init_decoder: reusing cached decoder");
+        decoder->time_base.den = media_info->timescale;
+        decoder->pkt_timebase = decoder->time_base;
+        thumb_grabber_set_decode_options(decoder, media_info, output_width, output_height);
+        *result = decoder;
+        return VOD_OK;
+    }
+
+    decoder = avcodec_alloc_context3(codec);
     if (decoder == NULL)
     {
         vod_log_error(VOD_LOG_ERR, request_context->log, 0,
@@ -134,16 +289,33 @@ thumb_grabber_init_decoder(
         return VOD_ALLOC_FAILED;
     }
 
+    *result = decoder;
+
+    // Note: the extra data is copied since the decoder may outlive the request
+    if (media_info->extra_data.len > 0)
+    {
+        decoder->extradata = av_mallocz(media_info->extra_data.len + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (decoder->extradata == NULL)
+        {
+            vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+                "thumb_grabber_init_decoder: av_mallocz failed");
+            return VOD_ALLOC_FAILED;
+        }
+
+        vod_memcpy(decoder->extradata, media_info->extra_data.data, media_info->extra_data.len);
+        decoder->extradata_size = media_info->extra_data.len;
+    }
+
     decoder->codec_tag = media_info->format;
     decoder->time_base.num = 1;
     decoder->time_base.den = media_info->timescale;
     decoder->pkt_timebase = decoder->time_base;
-    decoder->extradata = media_info->extra_data.data;
-    decoder->extradata_size = media_info->extra_data.len;
     decoder->width = media_info->u.video.width;
     decoder->height = media_info->u.video.height;
+    decoder->lowres = lowres;
+    thumb_grabber_set_decode_options(decoder, media_info, output_width, output_height);
 
-    avrc = avcodec_open2(decoder, decoder_codec[media_info->codec_id], NULL);
+    avrc = avcodec_open2(decoder, codec, NULL);
     if (avrc < 0)
     {
         vod_log_error(VOD_LOG_ERR, request_context->log, 0,
@@ -151,8 +323,6 @@ thumb_grabber_init_decoder(
         return VOD_UNEXPECTED;
     }
 
-    *result = decoder;
-
     return VOD_OK;
 }
 
@@ -167,6 +337,15 @@ thumb_grabber_init_encoder(
     AVCodecContext* encoder;
     int avrc;
 
+    encoder = thumb_grabber_context_cache_get(&encoder_cache, encoder_codec, width, height, NULL);
+    if (encoder != NULL)
+    {
+        vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+            "thumb_grabber_init_encoder: reusing cached encoder");
+        *result = encoder;
+        return VOD_OK;
+    }
+
     encoder = avcodec_alloc_context3(encoder_codec);
     if (encoder == NULL)
     {
@@ -194,12 +373,18 @@ thumb_grabber_init_encoder(
 }
 
 
-static uint32_t
-thumb_grabber_get_max_frame_size(media_segment_track_t* track)
+static void
+thumb_grabber_scan_frames(
+    thumb_grabber_state_t* state,
+    media_segment_track_t* track)
 {
     vod_list_part_t* part;
     input_frame_t* cur_frame;
     input_frame_t* last_frame;
+    uint64_t min_diff = ULLONG_MAX;
+    uint64_t diff;
+    int64_t pts;
+    int64_t dts = track->start_dts;
     uint32_t max_frame_size = 0;
 
     part = &track->frames.part;
@@ -223,10 +408,21 @@ thumb_grabber_get_max_frame_size(media_segment_track_t* track)
             max_frame_size = cur_frame->size;
         }
 
+        // find the frame that is closest to the requested time, the frames that follow it
+        // in decode order are not needed
+        pts = dts + cur_frame->pts_delay;
+        diff = vod_abs_diff(pts, state->time);
+        if (diff < min_diff)
+        {
+            min_diff = diff;
+            state->target_frame = cur_frame;
+        }
+
+        dts += cur_frame->duration;
         cur_frame++;
     }
 
-    return max_frame_size;
+    state->max_frame_size = max_frame_size;
 }
 
 vod_status_t
@@ -270,6 +466,8 @@ thumb_grabber_init_state(
     }
 
     state->time = params->time;
+    state->target_frame = NULL;
+    thumb_grabber_scan_frames(state, track);
 
     // clear all ffmpeg members, so that they will be initialized in case init fails
     state->decoded_frame = NULL;
@@ -277,6 +475,7 @@ thumb_grabber_init_state(
     state->decoder = NULL;
     state->encoder = NULL;
     state->output_packet = NULL;
+    state->rendered = FALSE;
 
     // add to the cleanup pool
     cln = vod_pool_cleanup_add(request_context->pool, 0);
@@ -290,12 +489,6 @@ thumb_grabber_init_state(
     cln->handler = thumb_grabber_free_state;
     cln->data = state;
 
-    rc = thumb_grabber_init_decoder(request_context, media_info, &state->decoder);
-    if (rc != VOD_OK)
-    {
-        return rc;
-    }
-
     if (params->width != 0)
     {
         output_width = params->width;
@@ -329,6 +522,12 @@ thumb_grabber_init_state(
         return VOD_BAD_REQUEST;
     }
 
+    rc = thumb_grabber_init_decoder(request_context, media_info, output_width, output_height, &state->decoder);
+    if (rc != VOD_OK)
+    {
+        return rc;
+    }
+
     // TODO: postpone the initialization of the encoder to after a frame is decoded
 
     rc = thumb_grabber_init_encoder(request_context, output_width, output_height, &state->encoder);
@@ -337,6 +536,16 @@ thumb_grabber_init_state(
         return rc;
     }
 
+    // Note: allocating the frame buffer in advance, since the rendering may run on a different thread,
+    //        where the request pool cannot be used
+    state->frame_buffer = vod_alloc(request_context->pool, state->max_frame_size + VOD_BUFFER_PADDING_SIZE);
+    if (state->frame_buffer == NULL)
+    {
+        vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+            "thumb_grabber_init_state: vod_alloc failed (2)");
+        return VOD_ALLOC_FAILED;
+    }
+
     state->output_packet = av_packet_alloc();
     if (state->output_packet == NULL)
     {
@@ -353,8 +562,6 @@ thumb_grabber_init_state(
     state->cur_frame_part = &track->frames.part;
     state->cur_frame = track->frames.part.elts;
     state->last_frame = state->cur_frame + track->frames.part.nelts;
-    state->max_frame_size = thumb_grabber_get_max_frame_size(track);
-    state->frame_buffer = NULL;
     state->cur_frame_pos = 0;
     state->first_time = TRUE;
     state->frame_started = FALSE;
@@ -496,7 +703,9 @@ thumb_grabber_resize_frame(thumb_grabber_state_t* state)
     sws_ctx = sws_getContext(
         input_frame->width, input_frame->height, input_frame->format,
         output_frame->width, output_frame->height, output_frame->format,
-        SWS_BICUBIC, NULL, NULL, NULL);
+        output_frame->width * THUMB_GRABBER_FAST_DECODE_RATIO <= input_frame->width ?
+            SWS_AREA : SWS_BICUBIC,
+        NULL, NULL, NULL);
     if (sws_ctx == NULL)
     {
         vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
@@ -536,15 +745,17 @@ end:
 #endif // VOD_HAVE_LIB_SW_SCALE
 
 static vod_status_t
-thumb_grabber_write_frame(thumb_grabber_state_t* state)
+thumb_grabber_encode_frame(thumb_grabber_state_t* state)
 {
+#if (VOD_HAVE_LIB_SW_SCALE)
     vod_status_t rc;
+#endif // VOD_HAVE_LIB_SW_SCALE
     int avrc;
 
     if (state->decoded_frame == NULL)
     {
         vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
-            "thumb_grabber_write_frame: no frames were decoded");
+            "thumb_grabber_encode_frame: no frames were decoded");
         return VOD_UNEXPECTED;
     }
 
@@ -564,7 +775,7 @@ thumb_grabber_write_frame(thumb_grabber_state_t* state)
     if (avrc < 0)
     {
         vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
-            "thumb_grabber_write_frame: avcodec_send_frame failed %d", avrc);
+            "thumb_grabber_encode_frame: avcodec_send_frame failed %d", avrc);
         return VOD_UNEXPECTED;
     }
 
@@ -572,21 +783,18 @@ thumb_grabber_write_frame(thumb_grabber_state_t* state)
     if (avrc < 0)
     {
         vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
-            "thumb_grabber_write_frame: avcodec_receive_packet failed %d", avrc);
+            "thumb_grabber_encode_frame: avcodec_receive_packet failed %d", avrc);
         return VOD_UNEXPECTED;
     }
 
-    rc = state->write_callback(state->write_context, state->output_packet->data, state->output_packet->size);
-    if (rc != VOD_OK)
-    {
-        return rc;
-    }
+    state->rendered = TRUE;
 
     return VOD_OK;
 }
 
+// Note: this function does not use the request pool / write callback, and can be called from a worker thread
 vod_status_t
-thumb_grabber_process(void* context)
+thumb_grabber_render(void* context)
 {
     thumb_grabber_state_t* state = context;
     u_char* read_buffer;
@@ -611,7 +819,7 @@ thumb_grabber_process(void* context)
                         return rc;
                     }
 
-                    return thumb_grabber_write_frame(state);
+                    return thumb_grabber_encode_frame(state);
                 }
 
                 state->cur_frame = state->cur_frame_part->elts;
@@ -646,7 +854,7 @@ thumb_grabber_process(void* context)
             if (!processed_data && !state->first_time)
             {
                 vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
-                    "thumb_grabber_process: no data was handled, probably a truncated file");
+                    "thumb_grabber_render: no data was handled, probably a truncated file");
                 return VOD_BAD_DATA;
             }
 
@@ -659,19 +867,6 @@ thumb_grabber_process(void* context)
         if (!frame_done)
         {
             // didn't finish the frame, append to the frame buffer
-            if (state->frame_buffer == NULL)
-            {
-                state->frame_buffer = vod_alloc(
-                    state->request_context->pool,
-                    state->max_frame_size + VOD_BUFFER_PADDING_SIZE);
-                if (state->frame_buffer == NULL)
-                {
-                    vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
-                        "thumb_grabber_process: vod_alloc failed");
-                    return VOD_ALLOC_FAILED;
-                }
-            }
-
             vod_memcpy(state->frame_buffer + state->cur_frame_pos, read_buffer, read_size);
             state->cur_frame_pos += read_size;
             continue;
@@ -685,15 +880,54 @@ thumb_grabber_process(void* context)
             read_buffer = state->frame_buffer;
         }
 
-        // decode the frame
+        // decode the frame, non-reference frames can be discarded, unless it's the target frame
+        state->decoder->skip_frame = state->cur_frame == state->target_frame ?
+            AVDISCARD_DEFAULT : AVDISCARD_NONREF;
+
         rc = thumb_grabber_decode_frame(state, read_buffer);
         if (rc != VOD_OK)
         {
             return rc;
         }
 
+        if (state->cur_frame == state->target_frame)
+        {
+            // the following frames are not needed for decoding the target frame
+            rc = thumb_grabber_decode_flush(state);
+            if (rc != VOD_OK)
+            {
+                return rc;
+            }
+
+            return thumb_grabber_encode_frame(state);
+        }
+
         // move to the next frame
         state->cur_frame++;
         state->frame_started = FALSE;
     }
 }
+
+void
+thumb_grabber_get_output(void* context, vod_str_t* result)
+{
+    thumb_grabber_state_t* state = context;
+
+    result->data = state->output_packet->data;
+    result->len = state->output_packet->size;
+}
+
+vod_status_t
+thumb_grabber_process(void* context)
+{
+    thumb_grabber_state_t* state = context;
+    vod_status_t rc;
+
+    rc = thumb_grabber_render(state);
+    if (rc != VOD_OK)
+    {
+        return rc;
+    }
+
+    return state->write_callback(state->write_context, state->output_packet->data, state->output_packet->size);
+}
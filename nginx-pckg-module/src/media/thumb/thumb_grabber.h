@@ -24,4 +24,8 @@ vod_status_t thumb_grabber_init_state(
 
 vod_status_t thumb_grabber_process(void* context);
 
+vod_status_t thumb_grabber_render(void* context);
+
+void thumb_grabber_get_output(void* context, vod_str_t* result);
+
 #endif //__THUMB_GRABBER_H__
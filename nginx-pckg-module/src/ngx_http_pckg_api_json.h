@@ -0,0 +1,57 @@
+/* auto-generated by generate_json_header.py */
+
+#ifndef ngx_copy_fix
+#define ngx_copy_fix(dst, src)   ngx_copy(dst, (src), sizeof(src) - 1)
+#endif
+
+#ifndef ngx_copy_str
+#define ngx_copy_str(dst, src)   ngx_copy(dst, (src).data, (src).len)
+#endif
+
+/* ngx_http_pckg_api_json writer */
+
+static size_t
+ngx_http_pckg_api_json_get_size(void *obj)
+{
+    size_t  result;
+
+    result =
+        sizeof("{\"version\":\"") - 1 +
+            ngx_json_str_get_size(&ngx_pckg_version) +
+        sizeof("\",\"nginx_version\":\"") - 1 +
+            ngx_json_str_get_size(&ngx_pckg_nginx_version) +
+        sizeof("\",\"compiler\":\"") - 1 +
+            ngx_json_str_get_size(&ngx_pckg_compiler) +
+        sizeof("\",\"built\":\"") - 1 + ngx_json_str_get_size(&ngx_pckg_built)
+            +
+        sizeof("\",\"pid\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"uptime\":") - 1 + NGX_INT_T_LEN +
+        sizeof(",\"core\":") - 1 + ngx_http_pckg_core_json_get_size(obj) +
+        sizeof("}") - 1;
+
+    return result;
+}
+
+
+static u_char *
+ngx_http_pckg_api_json_write(u_char *p, void *obj)
+{
+    p = ngx_copy_fix(p, "{\"version\":\"");
+    p = ngx_json_str_write(p, &ngx_pckg_version);
+    p = ngx_copy_fix(p, "\",\"nginx_version\":\"");
+    p = ngx_json_str_write(p, &ngx_pckg_nginx_version);
+    p = ngx_copy_fix(p, "\",\"compiler\":\"");
+    p = ngx_json_str_write(p, &ngx_pckg_compiler);
+    p = ngx_copy_fix(p, "\",\"built\":\"");
+    p = ngx_json_str_write(p, &ngx_pckg_built);
+    p = ngx_copy_fix(p, "\",\"pid\":");
+    p = ngx_sprintf(p, "%ui", (ngx_uint_t) ngx_getpid());
+    p = ngx_copy_fix(p, ",\"uptime\":");
+    p = ngx_sprintf(p, "%i", (ngx_int_t) (ngx_cached_time->sec -
+        ngx_pckg_start_time));
+    p = ngx_copy_fix(p, ",\"core\":");
+    p = ngx_http_pckg_core_json_write(p, obj);
+    *p++ = '}';
+
+    return p;
+}
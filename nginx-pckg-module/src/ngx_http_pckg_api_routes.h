@@ -0,0 +1,16 @@
+/* auto-generated by generate_routes_header.py */
+
+#ifndef _NGX_HTTP_PCKG_API_ROUTES_H_INCLUDED_
+#define _NGX_HTTP_PCKG_API_ROUTES_H_INCLUDED_
+
+static ngx_http_api_route_node_t  ngx_http_pckg_api_route = {
+    NULL,
+    &ngx_http_pckg_api_get,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+};
+
+
+#endif /* _NGX_HTTP_PCKG_API_ROUTES_H_INCLUDED_ */
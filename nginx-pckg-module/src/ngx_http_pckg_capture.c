@@ -1,6 +1,9 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_http.h>
+#if (NGX_THREADS)
+#include <ngx_thread_pool.h>
+#endif
 
 #include "ngx_http_pckg_utils.h"
 
@@ -11,24 +14,62 @@ static ngx_int_t ngx_http_pckg_capture_init_process(ngx_cycle_t *cycle);
 
 static ngx_int_t ngx_http_pckg_capture_preconfiguration(ngx_conf_t *cf);
 
+static void *ngx_http_pckg_capture_create_main_conf(ngx_conf_t *cf);
+static char *ngx_http_pckg_capture_init_main_conf(ngx_conf_t *cf, void *conf);
+
 static void *ngx_http_pckg_capture_create_loc_conf(ngx_conf_t *cf);
 static char *ngx_http_pckg_capture_merge_loc_conf(ngx_conf_t *cf, void *parent,
     void *child);
 
+#if (NGX_THREADS)
+static char *ngx_http_pckg_capture_thread_pool(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
+#endif
+
+
+typedef struct {
+    size_t                  cache_size;
+} ngx_http_pckg_capture_main_conf_t;
+
 
 typedef struct {
     ngx_flag_t              enable;
     ngx_flag_t              redirect;
     ngx_uint_t              granularity;
+#if (NGX_THREADS)
+    ngx_thread_pool_t      *thread_pool;
+#endif
 } ngx_http_pckg_capture_loc_conf_t;
 
 
 typedef struct {
     ngx_str_t               uri_suffix;
     thumb_grabber_params_t  params;
+    void                   *state;
+    ngx_str_t               cache_key;
+#if (NGX_THREADS)
+    vod_status_t            rc;
+#endif
 } ngx_http_pckg_capture_ctx_t;
 
 
+typedef struct {
+    ngx_str_node_t          sn;       /* must be first */
+    ngx_queue_t             queue;
+    ngx_str_t               data;
+    size_t                  size;
+} ngx_http_pckg_capture_cache_node_t;
+
+
+typedef struct {
+    ngx_rbtree_t            rbtree;
+    ngx_rbtree_node_t       sentinel;
+    ngx_queue_t             queue;
+    size_t                  size;
+    size_t                  max_size;
+} ngx_http_pckg_capture_cache_t;
+
+
 static ngx_conf_enum_t  ngx_http_pckg_capture_granularity[] = {
     { ngx_string("frame"),  NGX_KSMP_FLAG_MEDIA_MIN_GOP },
     { ngx_string("key"),    NGX_KSMP_FLAG_MEDIA_CLOSEST_KEY },
@@ -59,6 +100,23 @@ static ngx_command_t  ngx_http_pckg_capture_commands[] = {
       offsetof(ngx_http_pckg_capture_loc_conf_t, granularity),
       &ngx_http_pckg_capture_granularity },
 
+#if (NGX_THREADS)
+    { ngx_string("pckg_capture_thread_pool"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS
+        |NGX_CONF_TAKE1,
+      ngx_http_pckg_capture_thread_pool,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+#endif
+
+    { ngx_string("pckg_capture_cache_size"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_pckg_capture_main_conf_t, cache_size),
+      NULL },
+
       ngx_null_command
 };
 
@@ -67,8 +125,8 @@ static ngx_http_module_t  ngx_http_pckg_capture_module_ctx = {
     ngx_http_pckg_capture_preconfiguration, /* preconfiguration */
     NULL,                                   /* postconfiguration */
 
-    NULL,                                   /* create main configuration */
-    NULL,                                   /* init main configuration */
+    ngx_http_pckg_capture_create_main_conf, /* create main configuration */
+    ngx_http_pckg_capture_init_main_conf,   /* init main configuration */
 
     NULL,                                   /* create server configuration */
     NULL,                                   /* merge server configuration */
@@ -100,50 +158,31 @@ static ngx_str_t  ngx_http_pckg_capture_content_type =
 static ngx_str_t  ngx_http_pckg_capture_ext = ngx_string(".jpg");
 
 
-static ngx_int_t
-ngx_http_pckg_capture_init_process(ngx_cycle_t *cycle)
-{
-    thumb_grabber_process_init(cycle->log);
-
-    return NGX_OK;
-}
+/* per process cache of captured frames */
+static ngx_http_pckg_capture_cache_t  ngx_http_pckg_capture_cache;
 
 
 static ngx_int_t
-ngx_http_pckg_capture_init_frame_processor(ngx_http_request_t *r,
-    media_segment_t *segment, ngx_http_pckg_frame_processor_t *processor)
+ngx_http_pckg_capture_init_process(ngx_cycle_t *cycle)
 {
-    vod_status_t                  rc;
-    segment_writer_t             *writer;
-    media_segment_track_t        *track;
-    ngx_http_pckg_core_ctx_t     *ctx;
-    ngx_http_pckg_capture_ctx_t  *cctx;
+    ngx_http_pckg_capture_cache_t      *cache;
+    ngx_http_pckg_capture_main_conf_t  *cmcf;
 
-    ctx = ngx_http_get_module_ctx(r, ngx_http_pckg_core_module);
-    cctx = ngx_http_get_module_ctx(r, ngx_http_pckg_capture_module);
-
-    writer = &ctx->segment_writer;
-    cctx->params.time = ctx->channel->segment_index->time;
-
-    track = segment->tracks;
+    thumb_grabber_process_init(cycle->log);
 
-    if (track->frame_count <= 0) {
-        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-            "ngx_http_pckg_capture_init_frame_processor: "
-            "segment %uD not found", segment->segment_index);
-        return NGX_HTTP_NOT_FOUND;
+    cmcf = ngx_http_cycle_get_module_main_conf(cycle,
+        ngx_http_pckg_capture_module);
+    if (cmcf == NULL) {
+        return NGX_OK;
     }
 
-    rc = thumb_grabber_init_state(&ctx->request_context, track,
-        &cctx->params, writer->write_tail, writer->context, &processor->ctx);
-    if (rc != VOD_OK) {
-        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
-            "ngx_http_pckg_capture_init_frame_processor: init failed %i", rc);
-        return ngx_http_pckg_status_to_ngx_error(r, rc);
-    }
+    cache = &ngx_http_pckg_capture_cache;
 
-    processor->process = thumb_grabber_process;
-    processor->content_type = ngx_http_pckg_capture_content_type;
+    ngx_rbtree_init(&cache->rbtree, &cache->sentinel,
+        ngx_str_rbtree_insert_value);
+    ngx_queue_init(&cache->queue);
+    cache->size = 0;
+    cache->max_size = cmcf->cache_size;
 
     return NGX_OK;
 }
@@ -204,6 +243,338 @@ ngx_http_pckg_capture_parse_dims(ngx_http_request_t *r, u_char *cur,
 }
 #endif
 
+
+static ngx_int_t
+ngx_http_pckg_capture_cache_init_key(ngx_http_request_t *r)
+{
+    u_char                            *p;
+    size_t                             size;
+    ngx_pckg_channel_t                *channel;
+    ngx_http_pckg_core_ctx_t          *ctx;
+    ngx_http_pckg_capture_ctx_t       *cctx;
+    ngx_http_pckg_capture_loc_conf_t  *clcf;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_pckg_core_module);
+    cctx = ngx_http_get_module_ctx(r, ngx_http_pckg_capture_module);
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_pckg_capture_module);
+
+    channel = ctx->channel;
+
+    size = channel->id.len + ctx->params.variant_ids.len
+        + NGX_INT64_LEN + 3 * NGX_INT_T_LEN + sizeof("////") - 1;
+
+    p = ngx_pnalloc(r->pool, size);
+    if (p == NULL) {
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_capture_cache_init_key: alloc failed");
+        return NGX_ERROR;
+    }
+
+    cctx->cache_key.data = p;
+    cctx->cache_key.len = ngx_sprintf(p, "%V/%V/%L/%uD/%uD/%ui",
+        &channel->id, &ctx->params.variant_ids, cctx->params.time,
+        cctx->params.width, cctx->params.height, clcf->granularity) - p;
+
+    return NGX_OK;
+}
+
+
+static ngx_http_pckg_capture_cache_node_t *
+ngx_http_pckg_capture_cache_lookup(ngx_str_t *key)
+{
+    uint32_t                             hash;
+    ngx_http_pckg_capture_cache_t       *cache;
+    ngx_http_pckg_capture_cache_node_t  *node;
+
+    cache = &ngx_http_pckg_capture_cache;
+
+    hash = ngx_crc32_short(key->data, key->len);
+
+    node = (ngx_http_pckg_capture_cache_node_t *)
+        ngx_str_rbtree_lookup(&cache->rbtree, key, hash);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    /* move to the head of the lru */
+    ngx_queue_remove(&node->queue);
+    ngx_queue_insert_head(&cache->queue, &node->queue);
+
+    return node;
+}
+
+
+static void
+ngx_http_pckg_capture_cache_free(ngx_http_pckg_capture_cache_node_t *node)
+{
+    ngx_http_pckg_capture_cache_t  *cache;
+
+    cache = &ngx_http_pckg_capture_cache;
+
+    ngx_rbtree_delete(&cache->rbtree, &node->sn.node);
+    ngx_queue_remove(&node->queue);
+    cache->size -= node->size;
+
+    ngx_free(node);
+}
+
+
+static void
+ngx_http_pckg_capture_cache_insert(ngx_str_t *key, ngx_str_t *data,
+    ngx_log_t *log)
+{
+    u_char                              *p;
+    size_t                               size;
+    ngx_queue_t                         *q;
+    ngx_http_pckg_capture_cache_t       *cache;
+    ngx_http_pckg_capture_cache_node_t  *node;
+
+    cache = &ngx_http_pckg_capture_cache;
+
+    size = sizeof(*node) + key->len + data->len;
+    if (size > cache->max_size) {
+        return;
+    }
+
+    if (ngx_http_pckg_capture_cache_lookup(key) != NULL) {
+        return;
+    }
+
+    /* evict the least recently used entries */
+    while (cache->size + size > cache->max_size) {
+        q = ngx_queue_last(&cache->queue);
+        node = ngx_queue_data(q, ngx_http_pckg_capture_cache_node_t, queue);
+        ngx_http_pckg_capture_cache_free(node);
+    }
+
+    node = ngx_alloc(size, log);
+    if (node == NULL) {
+        return;
+    }
+
+    p = (u_char *) (node + 1);
+
+    node->sn.str.data = p;
+    node->sn.str.len = key->len;
+    p = ngx_copy(p, key->data, key->len);
+
+    node->data.data = p;
+    node->data.len = data->len;
+    ngx_memcpy(p, data->data, data->len);
+
+    node->size = size;
+    node->sn.node.key = ngx_crc32_short(key->data, key->len);
+
+    ngx_rbtree_insert(&cache->rbtree, &node->sn.node);
+    ngx_queue_insert_head(&cache->queue, &node->queue);
+    cache->size += size;
+}
+
+
+static ngx_int_t
+ngx_http_pckg_capture_send(ngx_http_request_t *r, ngx_str_t *output)
+{
+    ngx_int_t  rc;
+
+    rc = ngx_http_pckg_send_header(r, output->len,
+        &ngx_http_pckg_capture_content_type, -1,
+        NGX_HTTP_PCKG_EXPIRES_STATIC);
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    return ngx_http_pckg_send_response(r, output);
+}
+
+
+static ngx_int_t
+ngx_http_pckg_capture_send_frame(ngx_http_request_t *r, vod_status_t rc)
+{
+    ngx_str_t                     output;
+    ngx_http_pckg_capture_ctx_t  *cctx;
+
+    if (rc != VOD_OK) {
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_capture_send_frame: render failed %i", rc);
+        return ngx_http_pckg_status_to_ngx_error(r, rc);
+    }
+
+    cctx = ngx_http_get_module_ctx(r, ngx_http_pckg_capture_module);
+
+    thumb_grabber_get_output(cctx->state, &output);
+
+    if (cctx->cache_key.len > 0) {
+        ngx_http_pckg_capture_cache_insert(&cctx->cache_key, &output,
+            r->connection->log);
+    }
+
+    return ngx_http_pckg_capture_send(r, &output);
+}
+
+
+#if (NGX_THREADS)
+
+static void
+ngx_http_pckg_capture_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_http_pckg_capture_ctx_t  *cctx = data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, log, 0,
+        "ngx_http_pckg_capture_thread_handler: called");
+
+    cctx->rc = thumb_grabber_render(cctx->state);
+}
+
+
+static void
+ngx_http_pckg_capture_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_int_t                     rc;
+    ngx_connection_t             *c;
+    ngx_http_request_t           *r;
+    ngx_http_pckg_capture_ctx_t  *cctx;
+
+    r = ev->data;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+        "ngx_http_pckg_capture_thread_event_handler: called");
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    cctx = ngx_http_get_module_ctx(r, ngx_http_pckg_capture_module);
+
+    rc = ngx_http_pckg_capture_send_frame(r, cctx->rc);
+
+    ngx_http_finalize_request(r, rc);
+
+    ngx_http_run_posted_requests(c);
+}
+
+
+static ngx_int_t
+ngx_http_pckg_capture_post_task(ngx_http_request_t *r, ngx_thread_pool_t *tp)
+{
+    ngx_thread_task_t            *task;
+    ngx_http_pckg_capture_ctx_t  *cctx;
+
+    cctx = ngx_http_get_module_ctx(r, ngx_http_pckg_capture_module);
+
+    task = ngx_thread_task_alloc(r->pool, 0);
+    if (task == NULL) {
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_capture_post_task: alloc failed");
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    task->ctx = cctx;
+    task->handler = ngx_http_pckg_capture_thread_handler;
+    task->event.data = r;
+    task->event.handler = ngx_http_pckg_capture_thread_event_handler;
+
+    /* Note: the size of the queue is limited by the max_queue param
+        of the thread_pool directive */
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+            "ngx_http_pckg_capture_post_task: post task failed");
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    r->main->blocked++;
+    r->aio = 1;
+
+    r->main->count++;
+    return NGX_DONE;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_pckg_capture_write_frame(ngx_http_request_t *r)
+{
+    ngx_str_t                            output;
+    vod_status_t                         rc;
+    media_segment_t                     *segment;
+    media_segment_track_t               *track;
+    ngx_http_pckg_core_ctx_t            *ctx;
+    ngx_http_pckg_capture_ctx_t         *cctx;
+    ngx_http_pckg_capture_cache_node_t  *node;
+#if (NGX_THREADS)
+    ngx_http_pckg_capture_loc_conf_t    *clcf;
+#endif
+
+    rc = ngx_http_pckg_media_segment(r, &segment);
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_pckg_core_module);
+    cctx = ngx_http_get_module_ctx(r, ngx_http_pckg_capture_module);
+
+    cctx->params.time = ctx->channel->segment_index->time;
+
+    track = segment->tracks;
+
+    if (track->frame_count <= 0) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+            "ngx_http_pckg_capture_write_frame: "
+            "segment %uD not found", segment->segment_index);
+        return NGX_HTTP_NOT_FOUND;
+    }
+
+    if (ngx_http_pckg_capture_cache.max_size > 0) {
+        if (ngx_http_pckg_capture_cache_init_key(r) != NGX_OK) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        node = ngx_http_pckg_capture_cache_lookup(&cctx->cache_key);
+        if (node != NULL) {
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                "ngx_http_pckg_capture_write_frame: cache hit, key: %V",
+                &cctx->cache_key);
+
+            /* Note: copying the data, since the node may get evicted
+                before the response is sent */
+            output.len = node->data.len;
+            output.data = ngx_pnalloc(r->pool, output.len);
+            if (output.data == NULL) {
+                ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+                    "ngx_http_pckg_capture_write_frame: alloc failed");
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+
+            ngx_memcpy(output.data, node->data.data, output.len);
+
+            return ngx_http_pckg_capture_send(r, &output);
+        }
+    }
+
+    rc = thumb_grabber_init_state(&ctx->request_context, track,
+        &cctx->params, NULL, NULL, &cctx->state);
+    if (rc != VOD_OK) {
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_capture_write_frame: init failed %i", rc);
+        return ngx_http_pckg_status_to_ngx_error(r, rc);
+    }
+
+#if (NGX_THREADS)
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_pckg_capture_module);
+
+    if (clcf->thread_pool != NULL) {
+        return ngx_http_pckg_capture_post_task(r, clcf->thread_pool);
+    }
+#endif
+
+    rc = thumb_grabber_render(cctx->state);
+
+    return ngx_http_pckg_capture_send_frame(r, rc);
+}
+
+
 static ngx_int_t
 ngx_http_pckg_capture_parse_uri(ngx_http_request_t *r,
     u_char *cur, u_char *end, ngx_pckg_ksmp_req_t *result)
@@ -369,8 +740,8 @@ static ngx_http_pckg_request_handler_t  ngx_http_pckg_redirect_handler = {
 
 static ngx_http_pckg_request_handler_t  ngx_http_pckg_capture_handler = {
     NULL,
-    ngx_http_pckg_core_write_segment,
-    ngx_http_pckg_capture_init_frame_processor,
+    ngx_http_pckg_capture_write_frame,
+    NULL,
 };
 
 
@@ -441,6 +812,35 @@ ngx_http_pckg_capture_preconfiguration(ngx_conf_t *cf)
 }
 
 
+static void *
+ngx_http_pckg_capture_create_main_conf(ngx_conf_t *cf)
+{
+    ngx_http_pckg_capture_main_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_pckg_capture_main_conf_t));
+    if (conf == NULL) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cf->log, 0,
+            "ngx_http_pckg_capture_create_main_conf: ngx_pcalloc failed");
+        return NULL;
+    }
+
+    conf->cache_size = NGX_CONF_UNSET_SIZE;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_pckg_capture_init_main_conf(ngx_conf_t *cf, void *conf)
+{
+    ngx_http_pckg_capture_main_conf_t  *cmcf = conf;
+
+    ngx_conf_init_size_value(cmcf->cache_size, 0);
+
+    return NGX_CONF_OK;
+}
+
+
 static void *
 ngx_http_pckg_capture_create_loc_conf(ngx_conf_t *cf)
 {
@@ -456,6 +856,9 @@ ngx_http_pckg_capture_create_loc_conf(ngx_conf_t *cf)
     conf->enable = NGX_CONF_UNSET;
     conf->redirect = NGX_CONF_UNSET;
     conf->granularity = NGX_CONF_UNSET_UINT;
+#if (NGX_THREADS)
+    conf->thread_pool = NGX_CONF_UNSET_PTR;
+#endif
 
     return conf;
 }
@@ -475,5 +878,46 @@ ngx_http_pckg_capture_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
                               prev->granularity,
                               NGX_KSMP_FLAG_MEDIA_MIN_GOP);
 
+#if (NGX_THREADS)
+    ngx_conf_merge_ptr_value(conf->thread_pool, prev->thread_pool, NULL);
+#endif
+
+    return NGX_CONF_OK;
+}
+
+
+#if (NGX_THREADS)
+static char *
+ngx_http_pckg_capture_thread_pool(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf)
+{
+    ngx_http_pckg_capture_loc_conf_t  *clcf = conf;
+
+    ngx_str_t  *value, name;
+
+    if (clcf->thread_pool != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (cf->args->nelts > 1) {
+        name = value[1];
+
+        if (name.len == 3 && ngx_strncmp(name.data, "off", 3) == 0) {
+            clcf->thread_pool = NULL;
+            return NGX_CONF_OK;
+        }
+
+    } else {
+        ngx_str_set(&name, "default");
+    }
+
+    clcf->thread_pool = ngx_thread_pool_add(cf, &name);
+    if (clcf->thread_pool == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
     return NGX_CONF_OK;
 }
+#endif
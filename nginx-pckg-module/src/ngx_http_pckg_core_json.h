@@ -0,0 +1,232 @@
+/* auto-generated by generate_json_header.py */
+
+#ifndef ngx_copy_fix
+#define ngx_copy_fix(dst, src)   ngx_copy(dst, (src), sizeof(src) - 1)
+#endif
+
+#ifndef ngx_copy_str
+#define ngx_copy_str(dst, src)   ngx_copy(dst, (src).data, (src).len)
+#endif
+
+/* ngx_http_pckg_buffer_pool_json writer */
+
+static size_t
+ngx_http_pckg_buffer_pool_json_get_size(buffer_pool_stats_t *obj)
+{
+    size_t  result;
+
+    result =
+        sizeof("{\"size\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"count\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"max_count\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"in_use\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"max_in_use\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"hits\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"misses\":") - 1 + NGX_INT64_LEN +
+        sizeof("}") - 1;
+
+    return result;
+}
+
+
+static u_char *
+ngx_http_pckg_buffer_pool_json_write(u_char *p, buffer_pool_stats_t *obj)
+{
+    p = ngx_copy_fix(p, "{\"size\":");
+    p = ngx_sprintf(p, "%uz", (size_t) obj->size);
+    p = ngx_copy_fix(p, ",\"count\":");
+    p = ngx_sprintf(p, "%uz", (size_t) obj->count);
+    p = ngx_copy_fix(p, ",\"max_count\":");
+    p = ngx_sprintf(p, "%uz", (size_t) obj->max_count);
+    p = ngx_copy_fix(p, ",\"in_use\":");
+    p = ngx_sprintf(p, "%uz", (size_t) obj->in_use);
+    p = ngx_copy_fix(p, ",\"max_in_use\":");
+    p = ngx_sprintf(p, "%uz", (size_t) obj->max_in_use);
+    p = ngx_copy_fix(p, ",\"hits\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->hits);
+    p = ngx_copy_fix(p, ",\"misses\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->misses);
+    *p++ = '}';
+
+    return p;
+}
+
+
+/* ngx_http_pckg_format_stats_json writer */
+
+static size_t
+ngx_http_pckg_format_stats_json_get_size(ngx_http_pckg_core_format_stats_t
+    *obj)
+{
+    size_t  result;
+
+    result =
+        sizeof("{\"count\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"bytes\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"max_size\":") - 1 + NGX_SIZE_T_LEN +
+        sizeof(",\"size_64k\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"size_256k\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"size_1m\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"size_4m\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"size_16m\":") - 1 + NGX_INT64_LEN +
+        sizeof(",\"size_larger\":") - 1 + NGX_INT64_LEN +
+        sizeof("}") - 1;
+
+    return result;
+}
+
+
+static u_char *
+ngx_http_pckg_format_stats_json_write(u_char *p,
+    ngx_http_pckg_core_format_stats_t *obj)
+{
+    p = ngx_copy_fix(p, "{\"count\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->count);
+    p = ngx_copy_fix(p, ",\"bytes\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->bytes);
+    p = ngx_copy_fix(p, ",\"max_size\":");
+    p = ngx_sprintf(p, "%uz", (size_t) obj->max_size);
+    p = ngx_copy_fix(p, ",\"size_64k\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->sizes[NGX_HTTP_PCKG_SIZE_64K]);
+    p = ngx_copy_fix(p, ",\"size_256k\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->sizes[NGX_HTTP_PCKG_SIZE_256K]);
+    p = ngx_copy_fix(p, ",\"size_1m\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->sizes[NGX_HTTP_PCKG_SIZE_1M]);
+    p = ngx_copy_fix(p, ",\"size_4m\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->sizes[NGX_HTTP_PCKG_SIZE_4M]);
+    p = ngx_copy_fix(p, ",\"size_16m\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t) obj->sizes[NGX_HTTP_PCKG_SIZE_16M]);
+    p = ngx_copy_fix(p, ",\"size_larger\":");
+    p = ngx_sprintf(p, "%uL", (uint64_t)
+        obj->sizes[NGX_HTTP_PCKG_SIZE_LARGER]);
+    *p++ = '}';
+
+    return p;
+}
+
+
+/* ngx_http_pckg_formats_json writer */
+
+static size_t
+ngx_http_pckg_formats_json_get_size(ngx_http_pckg_core_main_conf_t *obj)
+{
+    size_t                              result;
+    ngx_queue_t                        *q;
+    ngx_http_pckg_core_format_stats_t  *cur;
+
+    result =
+        sizeof("{") - 1 +
+        sizeof("}") - 1;
+
+    for (q = ngx_queue_head(&obj->formats);
+        q != ngx_queue_sentinel(&obj->formats);
+        q = ngx_queue_next(q))
+    {
+        cur = ngx_queue_data(q, ngx_http_pckg_core_format_stats_t, queue);
+        result += cur->content_type.s.len + cur->content_type.escape;
+        result += ngx_http_pckg_format_stats_json_get_size(cur) +
+            sizeof(",\"\":") - 1;
+    }
+
+    return result;
+}
+
+
+static u_char *
+ngx_http_pckg_formats_json_write(u_char *p, ngx_http_pckg_core_main_conf_t
+    *obj)
+{
+    ngx_queue_t                        *q;
+    ngx_http_pckg_core_format_stats_t  *cur;
+
+    *p++ = '{';
+
+    for (q = ngx_queue_head(&obj->formats);
+        q != ngx_queue_sentinel(&obj->formats);
+        q = ngx_queue_next(q))
+    {
+        cur = ngx_queue_data(q, ngx_http_pckg_core_format_stats_t, queue);
+
+        if (p[-1] != '{') {
+            *p++ = ',';
+        }
+
+        *p++ = '"';
+        p = ngx_json_str_write_escape(p, &cur->content_type.s,
+            cur->content_type.escape);
+        *p++ = '"';
+        *p++ = ':';
+        p = ngx_http_pckg_format_stats_json_write(p, cur);
+    }
+
+    *p++ = '}';
+
+    return p;
+}
+
+
+/* ngx_http_pckg_core_json writer */
+
+size_t
+ngx_http_pckg_core_json_get_size(void *obj)
+{
+    size_t                           result;
+    ngx_uint_t                       n;
+    buffer_pool_stats_t             *cur;
+    ngx_http_pckg_core_main_conf_t  *pmcf;
+
+    pmcf = ngx_http_cycle_get_module_main_conf(ngx_cycle,
+        ngx_http_pckg_core_module);
+    if (!pmcf) {
+        return sizeof("null") - 1;
+    }
+
+    result =
+        sizeof("{\"buffer_pools\":[") - 1 +
+        sizeof("],\"formats\":") - 1 +
+            ngx_http_pckg_formats_json_get_size(pmcf) +
+        sizeof("}") - 1;
+
+    for (n = 0; n < pmcf->buffer_pools.nelts; n++) {
+        cur = ((buffer_pool_stats_t **) pmcf->buffer_pools.elts)[n];
+
+        result += ngx_http_pckg_buffer_pool_json_get_size(cur) + sizeof(",") -
+            1;
+    }
+
+    return result;
+}
+
+
+u_char *
+ngx_http_pckg_core_json_write(u_char *p, void *obj)
+{
+    ngx_uint_t                       n;
+    buffer_pool_stats_t             *cur;
+    ngx_http_pckg_core_main_conf_t  *pmcf;
+
+    pmcf = ngx_http_cycle_get_module_main_conf(ngx_cycle,
+        ngx_http_pckg_core_module);
+    if (!pmcf) {
+        p = ngx_copy_fix(p, "null");
+        return p;
+    }
+
+    p = ngx_copy_fix(p, "{\"buffer_pools\":[");
+
+    for (n = 0; n < pmcf->buffer_pools.nelts; n++) {
+        cur = ((buffer_pool_stats_t **) pmcf->buffer_pools.elts)[n];
+
+        if (p[-1] != '[') {
+            *p++ = ',';
+        }
+
+        p = ngx_http_pckg_buffer_pool_json_write(p, cur);
+    }
+
+    p = ngx_copy_fix(p, "],\"formats\":");
+    p = ngx_http_pckg_formats_json_write(p, pmcf);
+    *p++ = '}';
+
+    return p;
+}
@@ -5,6 +5,8 @@
 #include "ngx_http_pckg_utils.h"
 #include "media/buffer_pool.h"
 
+#include <ngx_json_str.h>
+
 
 #define NGX_HTTP_PCKG_DEFAULT_LAST_MODIFIED  (1262304000)   /* 1/1/2010 */
 
@@ -73,9 +75,33 @@ typedef struct {
     ngx_hash_t               handlers_hash;
     ngx_hash_keys_arrays_t  *handlers_keys;
     ngx_array_t              init_handlers; /* ngx_http_handler_pt */
+    ngx_array_t              buffer_pools;  /* buffer_pool_stats_t * */
+    ngx_queue_t              formats;
 } ngx_http_pckg_core_main_conf_t;
 
 
+enum {
+    NGX_HTTP_PCKG_SIZE_64K,
+    NGX_HTTP_PCKG_SIZE_256K,
+    NGX_HTTP_PCKG_SIZE_1M,
+    NGX_HTTP_PCKG_SIZE_4M,
+    NGX_HTTP_PCKG_SIZE_16M,
+    NGX_HTTP_PCKG_SIZE_LARGER,
+
+    NGX_HTTP_PCKG_SIZE_COUNT
+};
+
+
+typedef struct {
+    ngx_queue_t              queue;
+    ngx_json_str_t           content_type;
+    uint64_t                 count;
+    uint64_t                 bytes;
+    size_t                   max_size;
+    uint64_t                 sizes[NGX_HTTP_PCKG_SIZE_COUNT];
+} ngx_http_pckg_core_format_stats_t;
+
+
 typedef struct {
     ngx_log_t               *log;
     u_char                  *pos;
@@ -270,7 +296,7 @@ static ngx_command_t  ngx_http_pckg_core_commands[] = {
       NULL },
 
     { ngx_string("pckg_output_buffer_pool"),
-      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE23,
       ngx_http_pckg_core_buffer_pool_slot,
       NGX_HTTP_LOC_CONF_OFFSET,
       offsetof(ngx_http_pckg_core_loc_conf_t, output_buffer_pool),
@@ -318,6 +344,9 @@ ngx_module_t  ngx_http_pckg_core_module = {
 };
 
 
+#include "ngx_http_pckg_core_json.h"
+
+
 static ngx_http_variable_t  ngx_http_pckg_core_vars[] = {
 
     { ngx_string("pckg_channel_id"), NULL, ngx_http_pckg_core_ctx_variable,
@@ -664,7 +693,7 @@ ngx_http_pckg_core_post_handler(ngx_http_request_t *sr, void *data,
         }
 
         rc = ctx->handler->handler(r);
-        if (rc != NGX_OK && rc < NGX_HTTP_SPECIAL_RESPONSE) {
+        if (rc != NGX_OK && rc != NGX_DONE && rc < NGX_HTTP_SPECIAL_RESPONSE) {
             ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
                 "ngx_http_pckg_core_post_handler: handler failed %i", rc);
         }
@@ -1057,12 +1086,47 @@ static frames_source_t  ngx_http_pckg_source = {
 
 /* segment writer */
 
+static vod_status_t
+ngx_http_pckg_writer_flush(ngx_http_pckg_writer_ctx_t *ctx)
+{
+    ngx_int_t            rc;
+    ngx_chain_t         *cl, *next;
+    ngx_http_request_t  *r;
+
+    if (ctx->out.buf == NULL) {
+        return VOD_OK;
+    }
+
+    r = ctx->r;
+
+    rc = ngx_http_output_filter(r, &ctx->out);
+    if (rc != NGX_OK && rc != NGX_AGAIN) {
+        /* either the connection dropped, or some allocation failed
+           in case the connection dropped, the error code doesn't matter */
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_writer_flush: output filter failed %i", rc);
+        return VOD_ALLOC_FAILED;
+    }
+
+    /* the write filter copies the links, return them to the pool */
+    for (cl = ctx->out.next; cl != NULL; cl = next) {
+        next = cl->next;
+        ngx_free_chain(r->pool, cl);
+    }
+
+    ctx->out.buf = NULL;
+    ctx->out.next = NULL;
+    ctx->last = &ctx->out;
+    ctx->buf_count = 0;
+
+    return VOD_OK;
+}
+
+
 static vod_status_t
 ngx_http_pckg_writer_tail(void *arg, u_char *buffer, uint32_t size)
 {
     ngx_buf_t                   *b;
-    ngx_int_t                    rc;
-    ngx_chain_t                  out;
     ngx_chain_t                 *chain;
     ngx_http_request_t          *r;
     ngx_http_pckg_writer_ctx_t  *ctx;
@@ -1074,6 +1138,28 @@ ngx_http_pckg_writer_tail(void *arg, u_char *buffer, uint32_t size)
     ctx = arg;
     r = ctx->r;
 
+    /* trim the buffer to the requested range */
+    if (ctx->skip_size > 0) {
+        if ((off_t) size <= ctx->skip_size) {
+            ctx->skip_size -= size;
+            return VOD_OK;
+        }
+
+        buffer += ctx->skip_size;
+        size -= ctx->skip_size;
+        ctx->skip_size = 0;
+    }
+
+    if ((off_t) size > ctx->size_left) {
+        if (ctx->size_left <= 0) {
+            return VOD_OK;
+        }
+
+        size = ctx->size_left;
+    }
+
+    ctx->size_left -= size;
+
     b = ngx_calloc_buf(r->pool);
     if (b == NULL) {
         ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -1085,42 +1171,35 @@ ngx_http_pckg_writer_tail(void *arg, u_char *buffer, uint32_t size)
     b->last = buffer + size;
     b->temporary = 1;
 
-    if (r->header_sent) {
+    /* Note: the buffers passed to the writer remain valid until the request
+        completes (they point to the ksmp response / to buffers allocated on
+        the request pool), so the output filter can be called on batches of
+        buffers - the payloads are sent from their original location
+        using a single writev */
 
-        /* headers already sent, output the chunk */
-        out.buf = b;
-        out.next = NULL;
+    if (ctx->last->buf != NULL) {
 
-        rc = ngx_http_output_filter(r, &out);
-        if (rc != NGX_OK && rc != NGX_AGAIN) {
-            /* either the connection dropped, or some allocation failed
-               in case the connection dropped, the error code doesn't matter */
-            ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
-                "ngx_http_pckg_writer_tail: output filter failed %i", rc);
+        chain = ngx_alloc_chain_link(r->pool);
+        if (chain == NULL) {
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                "ngx_http_pckg_writer_tail: alloc chain failed");
             return VOD_ALLOC_FAILED;
         }
 
-    } else {
-
-        /* headers not sent yet, add the buffer to the chain */
-        if (ctx->last->buf != NULL) {
+        chain->next = NULL;
+        ctx->last->next = chain;
+        ctx->last = chain;
+    }
 
-            chain = ngx_alloc_chain_link(r->pool);
-            if (chain == NULL) {
-                ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                    "ngx_http_pckg_writer_tail: alloc chain failed");
-                return VOD_ALLOC_FAILED;
-            }
+    ctx->last->buf = b;
+    ctx->buf_count++;
 
-            ctx->last->next = chain;
-            ctx->last = chain;
-        }
+    ctx->total_size += size;
 
-        ctx->last->buf = b;
+    if (r->header_sent && ctx->buf_count >= NGX_IOVS_PREALLOCATE) {
+        return ngx_http_pckg_writer_flush(ctx);
     }
 
-    ctx->total_size += size;
-
     return VOD_OK;
 }
 
@@ -1183,6 +1262,8 @@ ngx_http_pckg_writer_init(ngx_http_request_t *r)
 
     ctx->segment_writer_ctx.r = r;
     ctx->segment_writer_ctx.last = &ctx->segment_writer_ctx.out;
+    ctx->segment_writer_ctx.skip_size = 0;
+    ctx->segment_writer_ctx.size_left = NGX_MAX_OFF_T_VALUE;
 
     ctx->segment_writer.write_tail = ngx_http_pckg_writer_tail;
     ctx->segment_writer.write_head = ngx_http_pckg_writer_head;
@@ -1212,7 +1293,11 @@ ngx_http_pckg_writer_close(ngx_http_request_t *r)
 
     if (r->header_sent) {
 
-        /* everything already sent, just signal completion and return */
+        /* send the pending buffers and signal completion */
+
+        if (ngx_http_pckg_writer_flush(&ctx->segment_writer_ctx) != VOD_OK) {
+            return NGX_ERROR;
+        }
 
         if (ctx->segment_writer_ctx.total_size != ctx->content_length &&
             (ctx->size_limit == 0 ||
@@ -1268,7 +1353,7 @@ ngx_http_pckg_writer_close(ngx_http_request_t *r)
 }
 
 
-static ngx_int_t
+ngx_int_t
 ngx_http_pckg_media_segment(ngx_http_request_t *r, media_segment_t **segment)
 {
     ngx_uint_t                      i, n;
@@ -1423,11 +1508,173 @@ ngx_http_pckg_media_init_segment(ngx_http_request_t *r,
 }
 
 
+static ngx_int_t
+ngx_http_pckg_core_init_range(ngx_http_request_t *r,
+    ngx_http_pckg_frame_processor_t *processor)
+{
+    off_t                      start, end;
+    off_t                      skip, header_size;
+    u_char                    *p;
+    vod_status_t               rc;
+    media_range_t              range;
+    ngx_table_elt_t           *content_range;
+    ngx_http_pckg_core_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_pckg_core_module);
+
+    if (ngx_http_pckg_range_parse(&r->headers_in.range->value,
+        ctx->content_length, &start, &end) != NGX_OK)
+    {
+        /* let the range filter handle it */
+        return NGX_DECLINED;
+    }
+
+    header_size = processor->output.len;
+    skip = start;
+
+    if (end <= header_size) {
+        /* the range is fully contained in the header */
+        processor->ctx = NULL;
+
+    } else {
+        range.start = start > header_size ? start - header_size : 0;
+        range.end = end - header_size;
+
+        rc = processor->set_range(processor->ctx, &range);
+        if (rc != VOD_OK) {
+            ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+                "ngx_http_pckg_core_init_range: set range failed %i", rc);
+            return ngx_http_pckg_status_to_ngx_error(r, rc);
+        }
+
+        /* Note: the muxer may start writing before the requested offset,
+            the writer skips the extra bytes */
+        if (start > header_size) {
+            processor->output.len = 0;
+            skip = start - header_size - range.start;
+        }
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+        "ngx_http_pckg_core_init_range: start: %O, end: %O, skip: %O",
+        start, end, skip);
+
+    ctx->segment_writer_ctx.skip_size = skip;
+    ctx->segment_writer_ctx.size_left = end - start;
+
+    /* add the content range header */
+    content_range = ngx_list_push(&r->headers_out.headers);
+    if (content_range == NULL) {
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_core_init_range: push failed");
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    p = ngx_pnalloc(r->pool, sizeof("bytes -/") - 1 + 3 * NGX_OFF_T_LEN);
+    if (p == NULL) {
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_core_init_range: alloc failed");
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    content_range->hash = 1;
+    ngx_str_set(&content_range->key, "Content-Range");
+    content_range->value.data = p;
+    content_range->value.len = ngx_sprintf(p, "bytes %O-%O/%O",
+        start, end - 1, (off_t) ctx->content_length) - p;
+#if (nginx_version >= 1023000)
+    content_range->next = NULL;
+#endif
+
+    r->headers_out.content_range = content_range;
+    r->allow_ranges = 0;
+
+    ctx->content_length = end - start;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_pckg_core_update_format_stats(ngx_http_request_t *r,
+    ngx_str_t *content_type, size_t size)
+{
+    ngx_uint_t                          index;
+    ngx_queue_t                        *q;
+    ngx_http_pckg_core_main_conf_t     *pmcf;
+    ngx_http_pckg_core_format_stats_t  *stats;
+
+    pmcf = ngx_http_get_module_main_conf(r, ngx_http_pckg_core_module);
+
+    for (q = ngx_queue_head(&pmcf->formats);
+        q != ngx_queue_sentinel(&pmcf->formats);
+        q = ngx_queue_next(q))
+    {
+        stats = ngx_queue_data(q, ngx_http_pckg_core_format_stats_t, queue);
+
+        if (stats->content_type.s.len == content_type->len
+            && ngx_memcmp(stats->content_type.s.data, content_type->data,
+                content_type->len) == 0)
+        {
+            goto found;
+        }
+    }
+
+    /* the stats are kept for the lifetime of the worker, the number of
+        distinct content types is bounded by the registered handlers */
+
+    stats = ngx_pcalloc(ngx_cycle->pool, sizeof(*stats) + content_type->len);
+    if (stats == NULL) {
+        ngx_log_error(NGX_LOG_NOTICE, r->connection->log, 0,
+            "ngx_http_pckg_core_update_format_stats: alloc failed");
+        return;
+    }
+
+    stats->content_type.s.data = (u_char *) (stats + 1);
+    stats->content_type.s.len = content_type->len;
+    ngx_memcpy(stats->content_type.s.data, content_type->data,
+        content_type->len);
+    ngx_json_str_set_escape(&stats->content_type);
+
+    ngx_queue_insert_tail(&pmcf->formats, &stats->queue);
+
+found:
+
+    if (size <= 64 * 1024) {
+        index = NGX_HTTP_PCKG_SIZE_64K;
+
+    } else if (size <= 256 * 1024) {
+        index = NGX_HTTP_PCKG_SIZE_256K;
+
+    } else if (size <= 1024 * 1024) {
+        index = NGX_HTTP_PCKG_SIZE_1M;
+
+    } else if (size <= 4 * 1024 * 1024) {
+        index = NGX_HTTP_PCKG_SIZE_4M;
+
+    } else if (size <= 16 * 1024 * 1024) {
+        index = NGX_HTTP_PCKG_SIZE_16M;
+
+    } else {
+        index = NGX_HTTP_PCKG_SIZE_LARGER;
+    }
+
+    stats->count++;
+    stats->bytes += size;
+    stats->sizes[index]++;
+
+    if (size > stats->max_size) {
+        stats->max_size = size;
+    }
+}
+
+
 ngx_int_t
 ngx_http_pckg_core_write_segment(ngx_http_request_t *r)
 {
     off_t                             range_start;
     off_t                             range_end;
+    size_t                            size;
     vod_status_t                      rc;
     media_segment_t                  *segment;
     ngx_http_pckg_core_ctx_t         *ctx;
@@ -1472,6 +1719,16 @@ ngx_http_pckg_core_write_segment(ngx_http_request_t *r)
 
         ctx->content_length = processor.response_size;
 
+        /* in case of range request, mux only the requested frames */
+        if (r->headers_in.range != NULL && processor.set_range != NULL &&
+            !r->header_only && r->method != NGX_HTTP_HEAD)
+        {
+            rc = ngx_http_pckg_core_init_range(r, &processor);
+            if (rc != NGX_OK && rc != NGX_DECLINED) {
+                return rc;
+            }
+        }
+
         /* send the response header */
         rc = ngx_http_pckg_send_header(r, ctx->content_length, NULL, -1,
             NGX_HTTP_PCKG_EXPIRES_STATIC);
@@ -1487,6 +1744,7 @@ ngx_http_pckg_core_write_segment(ngx_http_request_t *r)
 
         /* in case of range request, get the end offset */
         if (r->headers_in.range != NULL &&
+            r->headers_out.content_range == NULL &&
             ngx_http_pckg_range_parse(&r->headers_in.range->value,
                 ctx->content_length, &range_start, &range_end) == NGX_OK)
         {
@@ -1509,7 +1767,7 @@ ngx_http_pckg_core_write_segment(ngx_http_request_t *r)
         if (ctx->size_limit != 0 &&
             processor.output.len >= ctx->size_limit && r->header_sent)
         {
-            return NGX_OK;
+            processor.ctx = NULL;
         }
     }
 
@@ -1529,6 +1787,22 @@ ngx_http_pckg_core_write_segment(ngx_http_request_t *r)
         return rc;
     }
 
+    /* in case of a 206 response, count only the range that was sent -
+        the range filter updates the content length of single ranges */
+    if (r->headers_out.status == NGX_HTTP_PARTIAL_CONTENT
+        && r->headers_out.content_length_n >= 0)
+    {
+        size = r->headers_out.content_length_n;
+
+    } else if (processor.response_size != 0) {
+        size = processor.response_size;
+
+    } else {
+        size = ctx->segment_writer_ctx.total_size;
+    }
+
+    ngx_http_pckg_core_update_format_stats(r, &processor.content_type, size);
+
     return NGX_OK;
 }
 
@@ -1583,10 +1857,13 @@ ngx_http_pckg_core_buffer_pool_slot(ngx_conf_t *cf, ngx_command_t *cmd,
 {
     char  *p = conf;
 
-    ssize_t          buffer_size;
-    ngx_int_t        count;
-    ngx_str_t       *value;
-    buffer_pool_t  **buffer_pool;
+    ssize_t                          buffer_size;
+    ngx_int_t                        count;
+    ngx_int_t                        max_count;
+    ngx_str_t                       *value;
+    buffer_pool_t                  **buffer_pool;
+    buffer_pool_stats_t            **stats;
+    ngx_http_pckg_core_main_conf_t  *pmcf;
 
     buffer_pool = (buffer_pool_t **) (p + cmd->offset);
     if (*buffer_pool != NULL) {
@@ -1605,11 +1882,31 @@ ngx_http_pckg_core_buffer_pool_slot(ngx_conf_t *cf, ngx_command_t *cmd,
         return "invalid count";
     }
 
-    *buffer_pool = buffer_pool_create(cf->pool, cf->log, buffer_size, count);
+    if (cf->args->nelts > 3) {
+        max_count = ngx_atoi(value[3].data, value[3].len);
+        if (max_count == NGX_ERROR) {
+            return "invalid max count";
+        }
+
+    } else {
+        max_count = count;
+    }
+
+    *buffer_pool = buffer_pool_create(cf->pool, cf->log, buffer_size, count,
+        max_count);
     if (*buffer_pool == NULL) {
         return NGX_CONF_ERROR;
     }
 
+    pmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_pckg_core_module);
+
+    stats = ngx_array_push(&pmcf->buffer_pools);
+    if (stats == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    *stats = buffer_pool_get_stats(*buffer_pool);
+
     return NGX_CONF_OK;
 }
 
@@ -2235,6 +2532,15 @@ ngx_http_pckg_core_create_main_conf(ngx_conf_t *cf)
         return NULL;
     }
 
+    if (ngx_array_init(&conf->buffer_pools, cf->pool, 1,
+                       sizeof(buffer_pool_stats_t *))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    ngx_queue_init(&conf->formats);
+
     return conf;
 }
 
@@ -35,6 +35,9 @@ enum {
 
 typedef vod_status_t (*ngx_http_pckg_frame_processor_pt)(void *context);
 
+typedef vod_status_t (*ngx_http_pckg_frame_range_pt)(void *context,
+    media_range_t *range);
+
 
 typedef struct {
 
@@ -53,6 +56,7 @@ typedef struct {
 
 typedef struct {
     ngx_http_pckg_frame_processor_pt   process;
+    ngx_http_pckg_frame_range_pt       set_range;   /* optional */
     void                              *ctx;
     ngx_str_t                          output;
     size_t                             response_size;
@@ -103,7 +107,10 @@ typedef struct {
     ngx_http_request_t               *r;
     ngx_chain_t                       out;
     ngx_chain_t                      *last;
+    ngx_uint_t                        buf_count;
     size_t                            total_size;
+    off_t                             skip_size;
+    off_t                             size_left;
 } ngx_http_pckg_writer_ctx_t;
 
 
@@ -139,10 +146,18 @@ ngx_int_t ngx_http_pckg_core_add_init_handler(ngx_conf_t *cf,
 
 ngx_int_t ngx_http_pckg_core_write_segment(ngx_http_request_t *r);
 
+ngx_int_t ngx_http_pckg_media_segment(ngx_http_request_t *r,
+    media_segment_t **segment);
+
 ngx_int_t ngx_http_pckg_media_init_segment(ngx_http_request_t *r,
     media_init_segment_t *result);
 
 
+size_t ngx_http_pckg_core_json_get_size(void *obj);
+
+u_char *ngx_http_pckg_core_json_write(u_char *p, void *obj);
+
+
 extern ngx_module_t  ngx_http_pckg_core_module;
 
 extern ngx_str_t  ngx_http_pckg_prefix_manifest;
@@ -399,6 +399,12 @@ ngx_http_pckg_fmp4_init_frame_processor(ngx_http_request_t *r,
         mp4_muxer_process_frames;
     processor->ctx = muxer_state;
 
+    if (!reuse_input_buffers) {
+        /* no encryption, the output offsets are known in advance */
+        processor->set_range = (ngx_http_pckg_frame_range_pt)
+            mp4_muxer_set_range;
+    }
+
 #if (NGX_HAVE_OPENSSL_EVP)
     if (scheme == NGX_HTTP_PCKG_ENC_AES_128) {
         processor->response_size = aes_round_up_to_block(
@@ -220,6 +220,12 @@ ngx_http_pckg_mpegts_init_frame_processor(ngx_http_request_t *r,
         mpegts_muxer_process;
     processor->ctx = state;
 
+    if (enc_params.type == HLS_ENC_NONE && mpegts_muxer_range_supported(state))
+    {
+        processor->set_range = (ngx_http_pckg_frame_range_pt)
+            mpegts_muxer_set_range;
+    }
+
     processor->content_type = ngx_http_pckg_mpegts_content_type;
 
     return NGX_OK;
@@ -755,7 +755,8 @@ ngx_http_pckg_send_header(ngx_http_request_t *r, off_t content_length_n,
         r->headers_out.content_type_len = content_type->len;
     }
 
-    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.status = r->headers_out.content_range != NULL ?
+        NGX_HTTP_PARTIAL_CONTENT : NGX_HTTP_OK;
     r->headers_out.content_length_n = content_length_n;
 
     /* last modified */
@@ -171,6 +171,14 @@ ngx_rtmp_kmp_track_send_media_info(ngx_kmp_out_track_t *track,
             media_info->codec_id = KMP_CODEC_VIDEO_H265;
             break;
 
+        case NGX_RTMP_CODEC_FOURCC_VP09:
+            media_info->codec_id = KMP_CODEC_VIDEO_VP9;
+            break;
+
+        case NGX_RTMP_CODEC_FOURCC_AV01:
+            media_info->codec_id = KMP_CODEC_VIDEO_AV1;
+            break;
+
         default:
             /* KMP video codec ids match NGX_RTMP_VIDEO_XXX */
             media_info->codec_id = codec_ctx->video_codec_id;
@@ -342,14 +350,34 @@ ngx_rtmp_kmp_track_init_frame(ngx_kmp_out_track_t *track,
                 has_pts_delay = packet_type == NGX_RTMP_PKT_TYPE_CODED_FRAMES;
                 break;
 
-            default:
+            case NGX_RTMP_CODEC_FOURCC_VP09:
+            case NGX_RTMP_CODEC_FOURCC_AV01:
                 has_pts_delay = 0;
+                break;
+
+            default:
+                ngx_log_debug1(NGX_LOG_DEBUG_RTMP, &track->log, 0,
+                    "ngx_rtmp_kmp_track_init_frame: "
+                    "unsupported codec fourcc 0x%uxD", codec_id);
+                frame->header.data_size = 0;
+                return NGX_OK;
             }
 
-            if (packet_type == NGX_RTMP_PKT_TYPE_SEQUENCE_START) {
+            switch (packet_type) {
+
+            case NGX_RTMP_PKT_TYPE_SEQUENCE_START:
                 *sequence_header = 1;
-            }
+                break;
 
+            case NGX_RTMP_PKT_TYPE_CODED_FRAMES:
+            case NGX_RTMP_PKT_TYPE_CODED_FRAMES_X:
+                break;
+
+            default:
+                /* sequence end / metadata - nothing to forward */
+                frame->header.data_size = 0;
+                return NGX_OK;
+            }
         }
 
         if ((frame_info >> 4) == NGX_RTMP_KEY_FRAME) {
@@ -533,7 +561,9 @@ ngx_rtmp_kmp_track_av(ngx_kmp_out_track_t *track, ngx_rtmp_header_t *h,
         ctx->published = 1;
     }
 
-    /* send the frame */
+    /* send the frame - the chain points to the chunk receive buffers,
+        the only copy made is into the track buf queue, which has to keep
+        the data until it is acked by all upstreams */
     if (ngx_kmp_out_track_write_frame(track, &frame, in, p) != NGX_OK) {
         ngx_log_error(NGX_LOG_NOTICE, &track->log, 0,
             "ngx_rtmp_kmp_track_av: write frame failed");
@@ -160,6 +160,12 @@ ngx_rtmp_get_video_codec_name_from_fourcc(ngx_uint_t id)
     case NGX_RTMP_CODEC_FOURCC_HVC1:
         return "HVC1";
 
+    case NGX_RTMP_CODEC_FOURCC_VP09:
+        return "VP09";
+
+    case NGX_RTMP_CODEC_FOURCC_AV01:
+        return "AV01";
+
     default:
         return "";
     }
@@ -480,6 +486,12 @@ ngx_rtmp_codec_parse_extended_header(ngx_rtmp_session_t *s, ngx_chain_t *in,
 
         break;
 
+    case NGX_RTMP_CODEC_FOURCC_VP09:
+    case NGX_RTMP_CODEC_FOURCC_AV01:
+        /* vpcC / av1C carry no dimensions, they are taken from the metadata,
+            the record is saved as is */
+        break;
+
     default:
         ngx_log_debug3(NGX_LOG_DEBUG_RTMP, s->connection->log, 0,
             "ngx_rtmp_codec_parse_extended_header: "
@@ -57,6 +57,8 @@ enum {
 
 #define NGX_RTMP_CODEC_FOURCC_HEV1  (0x31766568)
 #define NGX_RTMP_CODEC_FOURCC_HVC1  (0x31637668)
+#define NGX_RTMP_CODEC_FOURCC_VP09  (0x39307076)
+#define NGX_RTMP_CODEC_FOURCC_AV01  (0x31307661)
 
 
 u_char *ngx_rtmp_get_audio_codec_name(ngx_uint_t id);
@@ -104,7 +106,9 @@ ngx_rtmp_is_codec_header(ngx_uint_t codec_id, ngx_chain_t *in)
 
     case NGX_RTMP_CODEC_FOURCC_HEV1:
     case NGX_RTMP_CODEC_FOURCC_HVC1:
-        /* HEVCDecoderConfigurationRecord configurationVersion byte */
+    case NGX_RTMP_CODEC_FOURCC_VP09:
+    case NGX_RTMP_CODEC_FOURCC_AV01:
+        /* enhanced rtmp - packet type in the low nibble of the first byte */
         return in->buf->pos < in->buf->last
             && (in->buf->pos[0] & 0xf) == NGX_RTMP_PKT_TYPE_SEQUENCE_START;
 
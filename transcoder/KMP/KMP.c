@@ -20,6 +20,7 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <netinet/tcp.h>
+#include <libavutil/avstring.h>
 
 inline __attribute__((always_inline)) int checkReturn(int retval)
 {
@@ -55,6 +56,86 @@ static ssize_t KMP_send( KMP_session_t *context,const void *buf, size_t len)
     }
     return 0;
 }
+
+static int KMP_flush( KMP_session_t *context)
+{
+    KMP_writer_t *writer=&context->writer;
+    struct iovec *iov=writer->iov;
+    int iovcnt=writer->iovcnt;
+    writer->iovcnt=0;
+    writer->scratchUsed=0;
+
+    if(context->socket <= 0) {
+       LOGGER(CATEGORY_KMP,AV_LOG_FATAL,"Socket invalid error as %d",context->socket);
+       return AVERROR(EBADFD);
+    }
+    while (iovcnt>0) {
+        ssize_t valwritten = writev(context->socket ,iov ,iovcnt);
+        if (valwritten<=0) {
+            if (errno==EAGAIN || errno==EWOULDBLOCK) {
+                if(context->non_blocking) {
+                    struct timespec tv;
+                    tv.tv_sec=0;
+                    tv.tv_nsec=250*1000000;//wait 250ms
+                    nanosleep(&tv,NULL);
+                    continue;
+                }
+            }
+            LOGGER(CATEGORY_KMP,AV_LOG_FATAL,"incomplete writev, returned %d errno=%d",(int)valwritten,errno);
+            return AVERROR(errno);
+        }
+        // skip the parts that were fully written, and advance into a partially written one
+        while (iovcnt>0 && (size_t)valwritten>=iov->iov_len) {
+            valwritten-=iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt>0) {
+            iov->iov_base=(uint8_t*)iov->iov_base+valwritten;
+            iov->iov_len-=valwritten;
+        }
+    }
+    return 0;
+}
+
+// buf must stay valid until the next KMP_flush
+static int KMP_write_ref( KMP_session_t *context,const void *buf, size_t len)
+{
+    KMP_writer_t *writer=&context->writer;
+    if (len==0) {
+        return 0;
+    }
+    if (writer->iovcnt>=KMP_WRITER_MAX_IOV) {
+        _S(KMP_flush(context));
+    }
+    writer->iov[writer->iovcnt].iov_base=(void*)buf;
+    writer->iov[writer->iovcnt].iov_len=len;
+    writer->iovcnt++;
+    return 0;
+}
+
+static int KMP_write_copy( KMP_session_t *context,const void *buf, size_t len)
+{
+    KMP_writer_t *writer=&context->writer;
+    if (len>KMP_WRITER_SCRATCH_SIZE) {
+        return KMP_write_ref(context,buf,len);
+    }
+    if (writer->scratchUsed+len>KMP_WRITER_SCRATCH_SIZE) {
+        _S(KMP_flush(context));
+    }
+    uint8_t *dst=writer->scratch+writer->scratchUsed;
+    memcpy(dst,buf,len);
+    writer->scratchUsed+=len;
+
+    // extend the last part when it ends where the copy starts
+    struct iovec *last=writer->iovcnt>0 ? &writer->iov[writer->iovcnt-1] : NULL;
+    if (last!=NULL && (uint8_t*)last->iov_base+last->iov_len==dst) {
+        last->iov_len+=len;
+        return 0;
+    }
+    return KMP_write_ref(context,dst,len);
+}
+
 int KMP_init( KMP_session_t *context)
 {
     context->socket=0;
@@ -64,6 +145,8 @@ int KMP_init( KMP_session_t *context)
     memset(&context->address,0,sizeof(context->address));
     context->sessionName[0]=0;
     context->input_is_annex_b=false;
+    context->writer.iovcnt=0;
+    context->writer.scratchUsed=0;
     return 0;
 }
 
@@ -164,6 +247,10 @@ static kmp_codec_id get_video_codec(AVCodecParameters *apar)
             return KMP_CODEC_VIDEO_H264;
         case AV_CODEC_ID_HEVC:
             return KMP_CODEC_VIDEO_HEVC;
+        case AV_CODEC_ID_VP9:
+            return KMP_CODEC_VIDEO_VP9;
+        case AV_CODEC_ID_AV1:
+            return KMP_CODEC_VIDEO_AV1;
         default:
             return (kmp_codec_id)apar->codec_id;
     }
@@ -239,14 +326,17 @@ int KMP_send_mediainfo( KMP_session_t *context,transcode_mediaInfo_t* mediaInfo
     }
 
 
-    _S(KMP_send(context , &header , sizeof(header) ));
-    _S(KMP_send(context , &media_info , sizeof(media_info) ));
-    if (header.data_size>0) {
-        _S(KMP_send(context , actualExtraData!=NULL  ?  actualExtraData : codecpar->extradata, header.data_size ));
-        av_free(actualExtraData);
+    int ret=0;
+    if ((ret=KMP_write_copy(context , &header , sizeof(header) ))>=0 &&
+        (ret=KMP_write_copy(context , &media_info , sizeof(media_info) ))>=0 &&
+        (ret=KMP_write_ref(context , actualExtraData!=NULL  ?  actualExtraData : codecpar->extradata, header.data_size ))>=0) {
+        ret=KMP_flush(context);
     }
+    context->writer.iovcnt=0;
+    context->writer.scratchUsed=0;
+    av_free(actualExtraData);
 
-    return 0;
+    return ret;
 }
 
 
@@ -314,8 +404,8 @@ uint32_t kk_avc_parse_nal_units(KMP_session_t *context, const uint8_t *buf_in, i
 
         if (context!=NULL) {
             uint32_t size=htonl(nNalSize);
-            _S(KMP_send(context, &size, sizeof(uint32_t)));
-            _S(KMP_send(context, nal_start, nNalSize));
+            _S(KMP_write_copy(context, &size, sizeof(uint32_t)));
+            _S(KMP_write_ref(context, nal_start, nNalSize));
         }
         written += sizeof(uint32_t) + nNalSize;
         nal_start = nal_end;
@@ -364,15 +454,23 @@ int KMP_send_packet( KMP_session_t *context,AVPacket* packet)
     sample.created=packet->pos;
     sample.flags=((packet->flags& AV_PKT_FLAG_KEY)==AV_PKT_FLAG_KEY)? KMP_FRAME_FLAG_KEY : 0;
 
-    _S(KMP_send(context, &packetHeader, sizeof(packetHeader)));
-    _S(KMP_send(context, &sample, sizeof(sample)));
-    if (context->input_is_annex_b) {
-        _S(kk_avc_parse_nal_units(context,packet->data, packet->size));
-    } else {
-        //print_mp4_units(packet->data,packet->size);
-        _S(KMP_send(context, packet->data, packet->size));
+    // the whole frame goes out in a single writev, the payload is not copied
+    int ret=0;
+    if ((ret=KMP_write_copy(context, &packetHeader, sizeof(packetHeader)))>=0 &&
+        (ret=KMP_write_copy(context, &sample, sizeof(sample)))>=0) {
+        if (context->input_is_annex_b) {
+            ret=(int)kk_avc_parse_nal_units(context,packet->data, packet->size);
+        } else {
+            //print_mp4_units(packet->data,packet->size);
+            ret=KMP_write_ref(context, packet->data, packet->size);
+        }
     }
-    return 0;
+    if (ret>=0) {
+        ret=KMP_flush(context);
+    }
+    context->writer.iovcnt=0;
+    context->writer.scratchUsed=0;
+    return ret<0 ? ret : 0;
 }
 
 int KMP_send_eof( KMP_session_t *context)
@@ -387,22 +485,69 @@ int KMP_send_eof( KMP_session_t *context)
     return 0;
 }
 
+static void KMP_build_ack(kmp_ack_frames_packet_t *pkt,kmp_frame_position_t *cur_pos)
+{
+    pkt->header.packet_type=KMP_PACKET_ACK_FRAMES;
+    pkt->header.data_size=0;
+    pkt->header.reserved=0;
+    pkt->header.header_size=sizeof(kmp_ack_frames_packet_t);
+    pkt->frame_id=cur_pos->frame_id;
+    pkt->transcoded_frame_id = cur_pos->transcoded_frame_id;
+    pkt->offset = cur_pos->offset;
+    pkt->padding=0;
+}
+
 int KMP_send_ack( KMP_session_t *context,kmp_frame_position_t *cur_pos)
 {
     LOGGER(CATEGORY_KMP,AV_LOG_DEBUG,"[%s] send KMP_send_ack %lld offset %ld",context->sessionName,cur_pos->frame_id,cur_pos->offset);
     kmp_ack_frames_packet_t pkt;
-    pkt.header.packet_type=KMP_PACKET_ACK_FRAMES;
-    pkt.header.data_size=0;
-    pkt.header.reserved=0;
-    pkt.header.header_size=sizeof(kmp_ack_frames_packet_t);
-    pkt.frame_id=cur_pos->frame_id;
-    pkt.transcoded_frame_id = cur_pos->transcoded_frame_id;
-    pkt.offset = cur_pos->offset;
-    pkt.padding=0;
+    KMP_build_ack(&pkt,cur_pos);
     _S(KMP_send(context, &pkt, sizeof(pkt)));
     return 0;
 }
 
+void KMP_ack_writer_init( KMP_ack_writer_t *writer)
+{
+    writer->sent=0;
+    writer->pending=false;
+}
+
+bool KMP_ack_writer_set( KMP_ack_writer_t *writer,kmp_frame_position_t *cur_pos)
+{
+    if (writer->sent>0) {
+        return false;
+    }
+    KMP_build_ack(&writer->packet,cur_pos);
+    writer->pending=true;
+    return true;
+}
+
+int KMP_ack_writer_flush( KMP_session_t *context,KMP_ack_writer_t *writer)
+{
+    if (!writer->pending) {
+        return 0;
+    }
+    if(context->socket <= 0) {
+       return AVERROR(EBADFD);
+    }
+    ssize_t valwritten=send(context->socket,(uint8_t*)&writer->packet+writer->sent,sizeof(writer->packet)-writer->sent,MSG_DONTWAIT);
+    if (valwritten<0) {
+        if (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR) {
+            return AVERROR(EAGAIN);
+        }
+        LOGGER(CATEGORY_KMP,AV_LOG_ERROR,"[%s] ack send failed errno=%d",context->sessionName,errno);
+        return AVERROR(errno);
+    }
+    LOGGER(CATEGORY_KMP,AV_LOG_DEBUG,"[%s] sent ack %lld (%zd bytes)",context->sessionName,writer->packet.frame_id,valwritten);
+    writer->sent+=valwritten;
+    if (writer->sent<sizeof(writer->packet)) {
+        return AVERROR(EAGAIN);
+    }
+    writer->sent=0;
+    writer->pending=false;
+    return 0;
+}
+
 int KMP_send_handshake( KMP_session_t *context,const char* channel_id,const char* track_id,uint64_t initial_frame_id)
 {
     LOGGER(CATEGORY_KMP,AV_LOG_DEBUG,"[%s] send KMP_send_handshake %s,%s",context->sessionName,channel_id,track_id);
@@ -673,12 +818,54 @@ static void set_video_codec(int codecid,AVCodecParameters *apar)
          case KMP_CODEC_VIDEO_HEVC:
              apar->codec_id = AV_CODEC_ID_HEVC;
              break;
+        case KMP_CODEC_VIDEO_VP9:
+            apar->codec_id = AV_CODEC_ID_VP9;
+            break;
+        case KMP_CODEC_VIDEO_AV1:
+            apar->codec_id = AV_CODEC_ID_AV1;
+            break;
         default:
             apar->codec_tag = codecid;
             break;
     }
 }
 
+static void KMP_parse_mediaInfo( KMP_session_t *context,const kmp_media_info_t *mediaInfo,transcode_mediaInfo_t *transcodeMediaInfo)
+{
+    AVCodecParameters* params=transcodeMediaInfo->codecParams;
+    if (mediaInfo->media_type==KMP_MEDIA_AUDIO) {
+        params->codec_type=AVMEDIA_TYPE_AUDIO;
+        params->sample_rate=mediaInfo->u.audio.sample_rate;
+        params->bits_per_coded_sample=mediaInfo->u.audio.bits_per_sample;
+        params->channels=mediaInfo->u.audio.channels;
+        params->channel_layout=mediaInfo->u.audio.channel_layout;
+        set_audio_codec(mediaInfo->codec_id,params);
+
+
+        LOGGER(CATEGORY_KMP,AV_LOG_DEBUG,"[%s] KMP_read_mediaInfo audio kmp_media_info, codec id %d samplerate %d bps %d channels %d channel layout %d",
+            context->sessionName,
+            mediaInfo->codec_id,
+            mediaInfo->u.audio.sample_rate,
+            mediaInfo->u.audio.bits_per_sample,
+            mediaInfo->u.audio.channels,
+            mediaInfo->u.audio.channel_layout);
+    }
+    if (mediaInfo->media_type==KMP_MEDIA_VIDEO) {
+        params->codec_type=AVMEDIA_TYPE_VIDEO;
+        params->format=AV_PIX_FMT_YUV420P;
+        params->width=mediaInfo->u.video.width;
+        params->height=mediaInfo->u.video.height;
+        transcodeMediaInfo->frameRate.den=mediaInfo->u.video.frame_rate.denom;
+        transcodeMediaInfo->frameRate.num=mediaInfo->u.video.frame_rate.num;
+        transcodeMediaInfo->closed_captions = mediaInfo->u.video.cea_captions;
+        set_video_codec(mediaInfo->codec_id,params);
+    }
+    transcodeMediaInfo->timeScale.den=mediaInfo->timescale;
+    transcodeMediaInfo->timeScale.num=1;
+    params->bit_rate=mediaInfo->bitrate;
+    //params->codec_id=mediaInfo->codec_id;
+}
+
 int KMP_read_mediaInfo( KMP_session_t *context,kmp_packet_header_t *header,transcode_mediaInfo_t *transcodeMediaInfo)
 {
     kmp_media_info_t mediaInfo;
@@ -690,38 +877,8 @@ int KMP_read_mediaInfo( KMP_session_t *context,kmp_packet_header_t *header,trans
     if (valread<=0) {
         return checkReturn(valread);
     }
+    KMP_parse_mediaInfo(context,&mediaInfo,transcodeMediaInfo);
     AVCodecParameters* params=transcodeMediaInfo->codecParams;
-    if (mediaInfo.media_type==KMP_MEDIA_AUDIO) {
-        params->codec_type=AVMEDIA_TYPE_AUDIO;
-        params->sample_rate=mediaInfo.u.audio.sample_rate;
-        params->bits_per_coded_sample=mediaInfo.u.audio.bits_per_sample;
-        params->channels=mediaInfo.u.audio.channels;
-        params->channel_layout=mediaInfo.u.audio.channel_layout;
-        set_audio_codec(mediaInfo.codec_id,params);
-
-
-        LOGGER(CATEGORY_KMP,AV_LOG_DEBUG,"[%s] KMP_read_mediaInfo audio kmp_media_info, codec id %d samplerate %d bps %d channels %d channel layout %d",
-            context->sessionName,
-            mediaInfo.codec_id,
-            mediaInfo.u.audio.sample_rate,
-            mediaInfo.u.audio.bits_per_sample,
-            mediaInfo.u.audio.channels,
-            mediaInfo.u.audio.channel_layout);
-    }
-    if (mediaInfo.media_type==KMP_MEDIA_VIDEO) {
-        params->codec_type=AVMEDIA_TYPE_VIDEO;
-        params->format=AV_PIX_FMT_YUV420P;
-        params->width=mediaInfo.u.video.width;
-        params->height=mediaInfo.u.video.height;
-        transcodeMediaInfo->frameRate.den=mediaInfo.u.video.frame_rate.denom;
-        transcodeMediaInfo->frameRate.num=mediaInfo.u.video.frame_rate.num;
-        transcodeMediaInfo->closed_captions = mediaInfo.u.video.cea_captions;
-        set_video_codec(mediaInfo.codec_id,params);
-    }
-    transcodeMediaInfo->timeScale.den=mediaInfo.timescale;
-    transcodeMediaInfo->timeScale.num=1;
-    params->bit_rate=mediaInfo.bitrate;
-    //params->codec_id=mediaInfo.codec_id;
     params->extradata_size=header->data_size;
     params->extradata=NULL;
     if (params->extradata_size>0) {
@@ -755,6 +912,184 @@ int KMP_read_packet( KMP_session_t *context,kmp_packet_header_t *header,AVPacket
     return checkReturn(valread);
 }
 
+int KMP_reader_init( KMP_reader_t *reader)
+{
+    reader->chunk=NULL;
+    reader->readPos=reader->writePos=0;
+    reader->pool=av_buffer_pool_init(KMP_READER_CHUNK_SIZE,NULL);
+    if (reader->pool==NULL) {
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+void KMP_reader_close( KMP_reader_t *reader)
+{
+    av_buffer_unref(&reader->chunk);
+    // the chunks still referenced by packets are freed when the packets are
+    av_buffer_pool_uninit(&reader->pool);
+}
+
+// makes room for needed bytes after writePos, keeping AV_INPUT_BUFFER_PADDING_SIZE readable bytes after any packet.
+// the padding isn't zeroed, it's usually the start of the next packet
+static int KMP_reader_reserve( KMP_reader_t *reader,size_t needed)
+{
+    size_t pending=reader->writePos-reader->readPos;
+    if (reader->chunk!=NULL) {
+        if (pending==0 && av_buffer_get_ref_count(reader->chunk)==1) {
+            // no packet references the chunk anymore
+            reader->readPos=reader->writePos=0;
+        }
+        if (reader->chunk->size-reader->writePos>=needed+AV_INPUT_BUFFER_PADDING_SIZE) {
+            return 0;
+        }
+    }
+
+    size_t size=pending+needed+AV_INPUT_BUFFER_PADDING_SIZE;
+    AVBufferRef* chunk=size<=KMP_READER_CHUNK_SIZE ? av_buffer_pool_get(reader->pool) : av_buffer_alloc((int)size);
+    if (chunk==NULL) {
+        return AVERROR(ENOMEM);
+    }
+    // only the partially received packet at the end of the old chunk is copied
+    if (pending>0) {
+        memcpy(chunk->data,reader->chunk->data+reader->readPos,pending);
+    }
+    av_buffer_unref(&reader->chunk);
+    reader->chunk=chunk;
+    reader->readPos=0;
+    reader->writePos=pending;
+    return 0;
+}
+
+static int KMP_reader_peek_header( KMP_reader_t *reader,kmp_packet_header_t *header)
+{
+    if (reader->writePos-reader->readPos<sizeof(kmp_packet_header_t)) {
+        return 0;
+    }
+    memcpy(header,reader->chunk->data+reader->readPos,sizeof(kmp_packet_header_t));
+    if (header->header_size<sizeof(kmp_packet_header_t) ||
+        (uint64_t)header->header_size+header->data_size>KMP_READER_MAX_PACKET_SIZE) {
+        LOGGER(CATEGORY_KMP,AV_LOG_ERROR,"invalid packet header, type %d header_size %d data_size %d",
+               header->packet_type,header->header_size,header->data_size);
+        return AVERROR_INVALIDDATA;
+    }
+    return 1;
+}
+
+int KMP_reader_fill( KMP_session_t *context,KMP_reader_t *reader)
+{
+    kmp_packet_header_t header;
+    size_t needed=KMP_READER_MIN_READ;
+    int ret=KMP_reader_peek_header(reader,&header);
+    if (ret<0) {
+        return ret;
+    }
+    if (ret>0) {
+        size_t total=header.header_size+header.data_size;
+        size_t pending=reader->writePos-reader->readPos;
+        if (total>pending) {
+            needed=FFMAX(needed,total-pending);
+        }
+    }
+    _S(KMP_reader_reserve(reader,needed));
+
+    ssize_t valread=recv(context->socket,reader->chunk->data+reader->writePos,
+                         reader->chunk->size-reader->writePos-AV_INPUT_BUFFER_PADDING_SIZE,0);
+    if (valread==0) {
+        return AVERROR_EOF;
+    }
+    if (valread<0) {
+        return AVERROR(errno);
+    }
+    reader->writePos+=valread;
+    return (int)valread;
+}
+
+int KMP_reader_peek( KMP_reader_t *reader,kmp_packet_header_t *header)
+{
+    int ret=KMP_reader_peek_header(reader,header);
+    if (ret<=0) {
+        return ret;
+    }
+    return reader->writePos-reader->readPos>=(size_t)header->header_size+header->data_size ? 1 : 0;
+}
+
+void KMP_reader_skip( KMP_reader_t *reader,kmp_packet_header_t *header)
+{
+    reader->readPos+=header->header_size+header->data_size;
+}
+
+int KMP_reader_get_handshake( KMP_reader_t *reader,kmp_packet_header_t *header,char* channel_id,char* track_id,kmp_frame_position_t *start_pos)
+{
+    kmp_connect_packet_t connect;
+    if (header->packet_type!=KMP_PACKET_CONNECT || header->header_size<sizeof(connect)) {
+        LOGGER(CATEGORY_KMP,AV_LOG_FATAL,"KMP_reader_get_handshake. invalid packet, packet_type=%d header_size=%d",header->packet_type,header->header_size);
+        return AVERROR_INVALIDDATA;
+    }
+    memcpy(&connect,reader->chunk->data+reader->readPos,sizeof(connect));
+    KMP_reader_skip(reader,header);
+
+    av_strlcpy(channel_id,(char*)connect.channel_id,KMP_MAX_CHANNEL_ID);
+    av_strlcpy(track_id,(char*)connect.track_id,KMP_MAX_TRACK_ID);
+    start_pos->frame_id = connect.initial_frame_id;
+    start_pos->transcoded_frame_id = connect.initial_transcoded_frame_id;
+    start_pos->offset   = connect.offset;
+    return 0;
+}
+
+int KMP_reader_get_mediaInfo( KMP_session_t *context,KMP_reader_t *reader,kmp_packet_header_t *header,transcode_mediaInfo_t *transcodeMediaInfo)
+{
+    kmp_media_info_t mediaInfo;
+    if (header->packet_type!=KMP_PACKET_MEDIA_INFO || header->header_size<sizeof(kmp_packet_header_t)+sizeof(mediaInfo)) {
+        LOGGER(CATEGORY_KMP,AV_LOG_FATAL,"KMP_reader_get_mediaInfo. invalid packet, packet_type=%d header_size=%d",header->packet_type,header->header_size);
+        return AVERROR_INVALIDDATA;
+    }
+    const uint8_t* p=reader->chunk->data+reader->readPos;
+    memcpy(&mediaInfo,p+sizeof(kmp_packet_header_t),sizeof(mediaInfo));
+    KMP_parse_mediaInfo(context,&mediaInfo,transcodeMediaInfo);
+
+    // the extra data outlives the receive buffer, so it's copied
+    AVCodecParameters* params=transcodeMediaInfo->codecParams;
+    params->extradata_size=header->data_size;
+    params->extradata=NULL;
+    if (params->extradata_size>0) {
+        params->extradata=av_mallocz(params->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (params->extradata==NULL) {
+            return AVERROR(ENOMEM);
+        }
+        memcpy(params->extradata,p+header->header_size,header->data_size);
+    }
+    KMP_reader_skip(reader,header);
+    return 0;
+}
+
+int KMP_reader_get_packet( KMP_reader_t *reader,kmp_packet_header_t *header,AVPacket *packet)
+{
+    kmp_frame_t sample;
+    if (header->packet_type!=KMP_PACKET_FRAME || header->header_size<sizeof(kmp_packet_header_t)+sizeof(sample)) {
+        LOGGER(CATEGORY_KMP,AV_LOG_FATAL,"KMP_reader_get_packet. invalid packet, packet_type=%d header_size=%d",header->packet_type,header->header_size);
+        return AVERROR_INVALIDDATA;
+    }
+    uint8_t* p=reader->chunk->data+reader->readPos;
+    memcpy(&sample,p+sizeof(kmp_packet_header_t),sizeof(sample));
+
+    // the packet keeps the chunk alive, the frame data is not copied
+    packet->buf=av_buffer_ref(reader->chunk);
+    if (packet->buf==NULL) {
+        return AVERROR(ENOMEM);
+    }
+    packet->data=p+header->header_size;
+    packet->size=(int)header->data_size;
+    packet->dts=sample.dts;
+    packet->pts=sample.dts+sample.pts_delay;
+    packet->duration=0;
+    packet->pos=sample.created;
+    packet->flags=((sample.flags& KMP_FRAME_FLAG_KEY )==KMP_FRAME_FLAG_KEY)? AV_PKT_FLAG_KEY : 0;
+
+    KMP_reader_skip(reader,header);
+    return 0;
+}
+
 bool KMP_read_ack(KMP_session_t *context,uint64_t* frame_id)
 {
     *frame_id=0;
@@ -12,6 +12,21 @@
 #include <stdio.h>
 #include "kalturaMediaProtocol.h"
 #include <netinet/in.h>
+#include <sys/uio.h>
+
+#define KMP_WRITER_MAX_IOV 128
+#define KMP_WRITER_SCRATCH_SIZE 1024
+
+// gathers the parts of the outgoing packets, so that each packet is sent with a single writev.
+// small parts (headers, nal lengths) are copied to the scratch buffer, payloads are referenced in place
+typedef struct
+{
+    struct iovec iov[KMP_WRITER_MAX_IOV];
+    int iovcnt;
+    uint8_t scratch[KMP_WRITER_SCRATCH_SIZE];
+    size_t scratchUsed;
+} KMP_writer_t;
+
 //KMP
 typedef struct
 {
@@ -22,6 +37,7 @@ typedef struct
     char sessionName[MAX_URL_LENGTH];
     bool_t non_blocking;
     bool_t input_is_annex_b;
+    KMP_writer_t writer;
 } KMP_session_t;
 
 
@@ -33,6 +49,28 @@ typedef struct
     bool_t closed_captions;
 } transcode_mediaInfo_t;
 
+#define KMP_READER_CHUNK_SIZE (1024*1024)
+#define KMP_READER_MIN_READ (64*1024)
+#define KMP_READER_MAX_PACKET_SIZE (64*1024*1024)
+
+// receive buffer of a non-blocking KMP connection. packets are parsed in place,
+// and frames are returned as packets that reference a slice of the buffer chunk
+typedef struct
+{
+    AVBufferPool* pool;
+    AVBufferRef* chunk;
+    size_t readPos;
+    size_t writePos;
+} KMP_reader_t;
+
+// ack of a non-blocking KMP connection, sent without waiting for the socket
+typedef struct
+{
+    kmp_ack_frames_packet_t packet;
+    size_t sent;        // bytes of the packet already written
+    bool pending;
+} KMP_ack_writer_t;
+
 typedef struct {
     frame_id_t frame_id;
     frame_id_t transcoded_frame_id;
@@ -59,4 +97,21 @@ int KMP_read_mediaInfo( KMP_session_t *context,kmp_packet_header_t *header,trans
 int KMP_read_packet( KMP_session_t *context,kmp_packet_header_t *header,AVPacket *packet);
 bool KMP_read_ack(KMP_session_t *context,uint64_t* frame_id);
 
+int KMP_reader_init( KMP_reader_t *reader);
+void KMP_reader_close( KMP_reader_t *reader);
+// reads what is available on the socket, returns AVERROR(EAGAIN) when there is nothing to read and AVERROR_EOF on disconnect
+int KMP_reader_fill( KMP_session_t *context,KMP_reader_t *reader);
+// returns 1 when a complete packet is buffered, 0 when more data is needed
+int KMP_reader_peek( KMP_reader_t *reader,kmp_packet_header_t *header);
+int KMP_reader_get_handshake( KMP_reader_t *reader,kmp_packet_header_t *header,char* channel_id,char* track_id,kmp_frame_position_t *start_pos);
+int KMP_reader_get_mediaInfo( KMP_session_t *context,KMP_reader_t *reader,kmp_packet_header_t *header,transcode_mediaInfo_t *mediaInfo);
+int KMP_reader_get_packet( KMP_reader_t *reader,kmp_packet_header_t *header,AVPacket *packet);
+void KMP_reader_skip( KMP_reader_t *reader,kmp_packet_header_t *header);
+
+void KMP_ack_writer_init( KMP_ack_writer_t *writer);
+// replaces the unsent ack, returns false when an ack is partially written and has to complete first
+bool KMP_ack_writer_set( KMP_ack_writer_t *writer,kmp_frame_position_t *cur_pos);
+// a single send attempt, returns AVERROR(EAGAIN) when the ack is still pending
+int KMP_ack_writer_flush( KMP_session_t *context,KMP_ack_writer_t *writer);
+
 #endif /* sender_h */
@@ -12,6 +12,8 @@ typedef enum {
     KMP_CODEC_VIDEO_H264 = 7,
     KMP_CODEC_VIDEO_HEVC = 8,
     KMP_CODEC_VIDEO_H265 = KMP_CODEC_VIDEO_HEVC,
+    KMP_CODEC_VIDEO_VP9 = 9,
+    KMP_CODEC_VIDEO_AV1 = 10,
 
     KMP_CODEC_AUDIO_UNCOMPRESSED = 1016,
     KMP_CODEC_AUDIO_ADPCM = 1001,
@@ -4,6 +4,7 @@
        if(h){
             ack_handler_ctx_t *ahc = (ack_handler_ctx_t*)h->ctx;
             auto &am = *reinterpret_cast<BaseAckMap*>(ahc->ctx);
+            std::lock_guard<std::mutex> lock(am.m_lock);
             try {
                am.addIn(*desc);
              } catch(const std::exception &e) {
@@ -17,6 +18,7 @@
            if(h){
                 ack_handler_ctx_t *ahc = (ack_handler_ctx_t*)h->ctx;
                 auto &am = *reinterpret_cast<BaseAckMap*>(ahc->ctx);
+                std::lock_guard<std::mutex> lock(am.m_lock);
                 try {
                    am.addFiltered(*desc);
                  } catch(const std::exception &e) {
@@ -30,6 +32,7 @@
         if(h){
             ack_handler_ctx_t *ahc = (ack_handler_ctx_t*)h->ctx;
             auto &am = *reinterpret_cast<BaseAckMap*>(ahc->ctx);
+            std::lock_guard<std::mutex> lock(am.m_lock);
              try {
                 am.addOut(*desc);
             } catch(const std::exception &e) {
@@ -44,6 +47,7 @@
         if(h){
             ack_handler_ctx_t *ahc = (ack_handler_ctx_t*)h->ctx;
             auto &am = *reinterpret_cast<BaseAckMap*>(ahc->ctx);
+            std::lock_guard<std::mutex> lock(am.m_lock);
             try {
               am.map(ack,*ao);
               return;
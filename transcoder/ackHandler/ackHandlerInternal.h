@@ -7,6 +7,7 @@
 #include <cassert>
 #include <limits>
 #include <stdexcept>
+#include <mutex>
 typedef uint64_t frameId_t;
 
 extern "C" {
@@ -34,6 +35,8 @@ class BaseAckMap
   BaseAckMap(const BaseAckMap&) = delete;
 protected:
     const std::string m_name;
+    // frames are added by the decoding thread and acked by the encoder thread
+    std::mutex m_lock;
 public:
     BaseAckMap(const std::string &name) :m_name(name){}
     virtual ~BaseAckMap(){}
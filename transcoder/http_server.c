@@ -12,9 +12,15 @@
 
 static void process_client(AVIOContext *client,http_request_callback callback)
 {
-    uint8_t buf[10240];
+    // the metrics of many sessions don't fit on the stack
+    char *buf = av_malloc(HTTP_SERVER_MAX_RESPONSE_SIZE);
+    const char *content_type = "application/json";
     int ret, n, reply_code;
     uint8_t *resource = NULL;
+    if (!buf) {
+        avio_close(client);
+        return;
+    }
     while ((ret = avio_handshake(client)) > 0) {
         av_opt_get(client, "resource", AV_OPT_SEARCH_CHILDREN, &resource);
         // check for strlen(resource) is necessary, because av_opt_get()
@@ -30,7 +36,7 @@ static void process_client(AVIOContext *client,http_request_callback callback)
     //av_log(client, AV_LOG_TRACE, "resource=%p\n", resource);
 
     if (resource && resource[0] == '/') {
-        reply_code =  callback(resource,buf,sizeof(buf),&n);
+        reply_code =  callback(resource,buf,HTTP_SERVER_MAX_RESPONSE_SIZE,&n,&content_type);
     } else {
         reply_code = AVERROR_HTTP_NOT_FOUND;
     }
@@ -38,7 +44,7 @@ static void process_client(AVIOContext *client,http_request_callback callback)
         LOGGER(CATEGORY_HTTP_SERVER,AV_LOG_ERROR, "Failed to set reply_code: %d (%s)", av_err2str(ret));
         goto end;
     }
-    if ((ret = av_opt_set(client, "content_type", "application/json", AV_OPT_SEARCH_CHILDREN)) < 0) {
+    if ((ret = av_opt_set(client, "content_type", content_type, AV_OPT_SEARCH_CHILDREN)) < 0) {
         LOGGER(CATEGORY_HTTP_SERVER,AV_LOG_ERROR, "Failed to set content_type: %d (%s)", ret,av_err2str(ret));
         goto end;
     }
@@ -54,13 +60,14 @@ static void process_client(AVIOContext *client,http_request_callback callback)
     if (reply_code != 200)
         goto end;
 
-    avio_write(client, buf, n);
+    avio_write(client, (const uint8_t*)buf, n);
 end:
     LOGGER0(CATEGORY_HTTP_SERVER,AV_LOG_DEBUG, "Flushing client");
     avio_flush(client);
     LOGGER0(CATEGORY_HTTP_SERVER,AV_LOG_DEBUG, "Closing client");
     avio_close(client);
     av_freep(&resource);
+    av_free(buf);
 }
 
 void* httpServerThread(void *vargp)
@@ -11,7 +11,10 @@
 
 #include <stdio.h>
 
-typedef int (*http_request_callback)(const char* uri, char* buf,int bufSize,int* bytesWritten);
+#define HTTP_SERVER_MAX_RESPONSE_SIZE (256*1024)
+
+// contentType is preset to application/json
+typedef int (*http_request_callback)(const char* uri, char* buf,int bufSize,int* bytesWritten,const char** contentType);
 
 typedef struct {
     char listenAddress[MAX_URL_LENGTH];
@@ -30,14 +30,23 @@
 
 transcode_session_t ctx;
 receiver_server_t receiver;
+worker_pool_t worker_pool;
 receiver_server_t *pDummyPackager=NULL ;
 file_streamer_t* file_streamer=NULL;
 kmp_streamer_t* kmp_streamer=NULL;
 http_server_t http_server;
 
-int on_http_request(const char* uri, char* buf,int bufSize,int* bytesWritten)
+int on_http_request(const char* uri, char* buf,int bufSize,int* bytesWritten,const char** contentType)
 {
     int retVal=404;
+    if (strcmp(uri,"/metrics")==0) {
+        // prometheus text format
+        json_writer_ctx_s js_s = {.start = buf, .cur = buf,.end = buf + bufSize,.shouldAddComma = false};
+        receiver_server_get_metrics(&receiver,&js_s);
+        *bytesWritten=(int)(js_s.cur-js_s.start);
+        *contentType="text/plain; version=0.0.4";
+        return 200;
+    }
     JSON_SERIALIZE_INIT(buf,bufSize)
         JSON_SERIALIZE_STRING("uri", uri)
         JSON_SERIALIZE_OBJECT_BEGIN("result")
@@ -102,6 +111,20 @@ int start()
 
     receiver.transcode_session=&ctx;
     receiver.port=listenPort;
+    json_get_bool(GetConfig(),"kmp.multiSession",false,&receiver.multiSession);
+    json_get_bool(GetConfig(),"kmp.eventLoop",false,&receiver.eventLoop);
+    receiver.eventLoop&=receiver.multiSession;
+
+    int workerThreads;
+    json_get_int(GetConfig(),"engine.workerThreads",receiver.multiSession ? -1 : 0,&workerThreads);
+    receiver.workerPool=NULL;
+    if (workerThreads!=0) {
+        if ((ret=worker_pool_init(&worker_pool,workerThreads))<0) {
+            return ret;
+        }
+        receiver.workerPool=&worker_pool;
+    }
+
     json_get_string(GetConfig(),"kmp.listenAddress","127.0.0.1",receiver.listenAddress,sizeof(receiver.listenAddress));
     if (receiver_server_init(&receiver)<0) {
         return -1;
@@ -110,6 +133,9 @@ int start()
         pDummyPackager=malloc(sizeof(*pDummyPackager));
         pDummyPackager->port=10000;
         pDummyPackager->transcode_session=NULL;
+        pDummyPackager->multiSession=false;
+        pDummyPackager->workerPool=NULL;
+        pDummyPackager->eventLoop=false;
         receiver_server_init(pDummyPackager);
         receiver_server_async_listen(pDummyPackager);
     }
@@ -140,6 +166,10 @@ int stop()
         kmp_streamer_stop(kmp_streamer);
     }
     receiver_server_close(&receiver);
+    if (receiver.workerPool!=NULL) {
+        worker_pool_destroy(receiver.workerPool);
+        receiver.workerPool=NULL;
+    }
     loggerFlush();
     return 0;
 }
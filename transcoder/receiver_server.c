@@ -10,6 +10,10 @@
 #include "KMP/KMP.h"
 #include "transcode_session.h"
 #include "utils/throttler.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <fcntl.h>
+#endif
 
 
 int atomFileWrite (char* fileName,char* content,size_t size)
@@ -35,44 +39,107 @@ int processedFrameCB(receiver_server_session_t *session,bool completed)
         char* tmpBuf=av_malloc(MAX_DIAGNOSTICS_STRING_LENGTH);
         JSON_SERIALIZE_INIT(tmpBuf,MAX_DIAGNOSTICS_STRING_LENGTH)
         JSON_SERIALIZE_OBJECT_BEGIN("transcoder")
-         transcode_session_get_diagnostics(server->transcode_session,js);
+         transcode_session_get_diagnostics(session->transcode_session,js);
         JSON_SERIALIZE_OBJECT_END()
         JSON_SERIALIZE_OBJECT_BEGIN("receiver")
             pthread_mutex_lock(&server->diagnostics_locker);  // lock the critical section
-            sample_stats_get_diagnostics(&server->receiverStats,js);
+            sample_stats_get_diagnostics(&session->receiverStats,js);
             pthread_mutex_unlock(&server->diagnostics_locker);  // lock the critical section
         JSON_SERIALIZE_OBJECT_END()
         JSON_SERIALIZE_INT64("time",(uint64_t)time(NULL));
         JSON_SERIALIZE_END()
 
-        char* oldDiag=server->lastDiagnsotics;
+        char* oldDiag;
         pthread_mutex_lock(&server->diagnostics_locker);  // lock the critical section
-        server->lastDiagnsotics=tmpBuf;
-        atomFileWrite("lastState.json",tmpBuf,strlen(tmpBuf));
+        if (server->multiSession) {
+            oldDiag=session->lastDiagnostics;
+            session->lastDiagnostics=tmpBuf;
+        } else {
+            oldDiag=server->lastDiagnsotics;
+            server->lastDiagnsotics=tmpBuf;
+            atomFileWrite("lastState.json",tmpBuf,strlen(tmpBuf));
+        }
         pthread_mutex_unlock(&server->diagnostics_locker); // unlock once you are done
         av_free(oldDiag);
 
-        LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"calculated diagnostics %s",server->lastDiagnsotics);
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"[%s] calculated diagnostics %s",session->stream_name,tmpBuf);
         session->lastStatsUpdated=now;
     }
 
     return 0;
 }
 
+static
+int receiver_server_session_on_handshake(receiver_server_session_t *session,kmp_frame_position_t *start_pos)
+{
+    transcode_session_t *transcode_session=session->transcode_session;
+    LOGGER(CATEGORY_KMP,AV_LOG_INFO,"[%s] recieved handshake: frame_id: %lld , offset: %ld transcoded_frame_id: %lld",session->stream_name,start_pos->frame_id,start_pos->offset,start_pos->transcoded_frame_id);
+    transcode_session->onProcessedFrame=(transcode_session_processedFrameCB*)processedFrameCB;
+    transcode_session->onProcessedFrameContext=session;
+    sprintf(session->stream_name,"%s_%s",session->channel_id,session->track_id);
+    _S(transcode_session_init(transcode_session,session->channel_id,session->track_id,start_pos));
+    session->received_frame_id=start_pos->frame_id;
+    return 0;
+}
+
+static
+int receiver_server_session_send_ack(receiver_server_session_t *session)
+{
+    kmp_frame_position_t current_position;
+    if (session->autoAckMode) {
+        return 0;
+    }
+    transcode_session_get_ack_frame_id(session->transcode_session,&current_position);
+    if (current_position.frame_id!=0 && session->received_frame_ack_id!=current_position.frame_id) {
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_DEBUG,"[%s] sending ack for packet # : %lld",session->stream_name,current_position.frame_id);
+        if (!session->server->eventLoop) {
+            _S(KMP_send_ack(&session->kmpClient,&current_position));
+            session->received_frame_ack_id=current_position.frame_id;
+        } else if (KMP_ack_writer_set(&session->ackWriter,&current_position)) {
+            session->received_frame_ack_id=current_position.frame_id;
+        }
+    }
+    if (session->server->eventLoop) {
+        // the loop never waits for a client that doesn't read, a blocked ack is retried (or replaced
+        // by a newer one) on the next poll of the sessions
+        int ret=KMP_ack_writer_flush(&session->kmpClient,&session->ackWriter);
+        if (ret<0 && ret!=AVERROR(EAGAIN)) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// the caller keeps owning the packet
+static
+int receiver_server_session_on_frame(receiver_server_session_t *session,AVPacket *packet,throttler_t *throttler)
+{
+    receiver_server_t *server=session->server;
+    transcode_session_t *transcode_session=session->transcode_session;
+
+    pthread_mutex_lock(&server->diagnostics_locker);  // lock the critical section
+    samples_stats_add(&session->receiverStats,packet->dts,packet->pos,packet->size);
+    pthread_mutex_unlock(&server->diagnostics_locker);  // lock the critical section
+
+    throttler_process(throttler,transcode_session);
+
+    if(add_packet_frame_metadata(packet,session->received_frame_id,packet->pts,getTime64())){
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_ERROR,"[%s] failed to set frame id %lld on packet",session->stream_name,session->received_frame_id);
+    }
+    LOGGER(CATEGORY_RECEIVER,AV_LOG_DEBUG,"[%s] received packet %s (%p) #: %lld",session->stream_name,getPacketDesc(packet),transcode_session,session->received_frame_id);
+    _S(transcode_session_async_send_packet(transcode_session, packet));
+    session->received_frame_id++;
+    return receiver_server_session_send_ack(session);
+}
+
 static
 int clientLoop(receiver_server_t *server,receiver_server_session_t *session,transcode_session_t *transcode_session)
 {
     kmp_packet_header_t header;
     int retVal = 0;
-    uint64_t received_frame_ack_id=0;
-    bool autoAckMode;
-    uint64_t received_frame_id=0;
-    kmp_frame_position_t current_position;
     throttler_t throttler = {0};
 
-    json_get_bool(GetConfig(),"autoAckModeEnabled",false,&autoAckMode);
-
-    _S(throttler_init(&server->receiverStats,&throttler));
+    _S(throttler_init(&session->receiverStats,&throttler));
 
     while (retVal >= 0 && session->kmpClient.socket) {
 
@@ -91,12 +158,7 @@ int clientLoop(receiver_server_t *server,receiver_server_session_t *session,tran
                 LOGGER(CATEGORY_RECEIVER,AV_LOG_FATAL,"[%s] KMP_read_handshake",session->stream_name);
                 break;
             } else {
-                LOGGER(CATEGORY_KMP,AV_LOG_INFO,"[%s] recieved handshake: frame_id: %lld , offset: %ld transcoded_frame_id: %lld",session->stream_name,start_pos.frame_id,start_pos.offset,start_pos.transcoded_frame_id);
-                transcode_session->onProcessedFrame=(transcode_session_processedFrameCB*)processedFrameCB;
-                transcode_session->onProcessedFrameContext=session;
-                sprintf(session->stream_name,"%s_%s",session->channel_id,session->track_id);
-                _S(transcode_session_init(transcode_session,session->channel_id,session->track_id,&start_pos));
-                received_frame_id=start_pos.frame_id;
+                _S(receiver_server_session_on_handshake(session,&start_pos));
             }
         }
         if (header.packet_type==KMP_PACKET_MEDIA_INFO)
@@ -119,44 +181,32 @@ int clientLoop(receiver_server_t *server,receiver_server_session_t *session,tran
                  av_packet_free(&packet);
                  break;
             }
-            pthread_mutex_lock(&server->diagnostics_locker);  // lock the critical section
-            samples_stats_add(&server->receiverStats,packet->dts,packet->pos,packet->size);
-            pthread_mutex_unlock(&server->diagnostics_locker);  // lock the critical section
-
-            throttler_process(&throttler,transcode_session);
-
-            if(add_packet_frame_id_and_pts(packet,received_frame_id,packet->pts)){
-                LOGGER(CATEGORY_RECEIVER,AV_LOG_ERROR,"[%s] failed to set frame id %lld on packet",session->stream_name,received_frame_id);
-            }
-            LOGGER(CATEGORY_RECEIVER,AV_LOG_DEBUG,"[%s] received packet %s (%p) #: %lld",session->stream_name,getPacketDesc(packet),transcode_session,received_frame_id);
-            _S(transcode_session_async_send_packet(transcode_session, packet));
+            retVal=receiver_server_session_on_frame(session,packet,&throttler);
             av_packet_free(&packet);
-            received_frame_id++;
-            if(!autoAckMode) {
-                transcode_session_get_ack_frame_id(transcode_session,&current_position);
-                if (current_position.frame_id!=0 && received_frame_ack_id!=current_position.frame_id) {
-                    LOGGER(CATEGORY_RECEIVER,AV_LOG_DEBUG,"[%s] sending ack for packet # : %lld",session->stream_name,current_position.frame_id);
-                    _S(KMP_send_ack(&session->kmpClient,&current_position));
-                    received_frame_ack_id=current_position.frame_id;
-                }
-            }
         }
     }
     return retVal;
 }
 
-void* processClient(void *vargp)
+static
+void receiver_server_session_init_diagnostics(receiver_server_session_t *session)
 {
-    receiver_server_session_t* session=( receiver_server_session_t *)vargp;
-    receiver_server_t *server=session->server;
-    transcode_session_t *transcode_session = server->transcode_session;
-
     json_value_t* config=GetConfig();
 
     json_get_int64(config,"debug.diagnosticsIntervalInSeconds",60,&session->diagnosticsIntervalInSeconds);
     session->diagnosticsIntervalInSeconds*=1000LL*1000LL;
 
     session->lastStatsUpdated=0;
+}
+
+void* processClient(void *vargp)
+{
+    receiver_server_session_t* session=( receiver_server_session_t *)vargp;
+    receiver_server_t *server=session->server;
+    transcode_session_t *transcode_session = session->transcode_session;
+
+    receiver_server_session_init_diagnostics(session);
+
     int retval = clientLoop(server,session,transcode_session);
     LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"[%s] Destorying receive thread. exit code is %d",session->stream_name,retval);
 
@@ -168,29 +218,94 @@ void* processClient(void *vargp)
     KMP_close(&session->kmpClient);
 
     LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"[%s] Completed receive thread",session->stream_name);
+    atomic_store(&session->completed,true);
     return (void*)retval;
 }
 
+static void receiver_server_session_free(receiver_server_t *server,receiver_server_session_t* session)
+{
+    if (server->eventLoop) {
+        KMP_reader_close(&session->reader);
+    }
+    if (server->multiSession) {
+        av_free(session->transcode_session);
+        av_free(session->lastDiagnostics);
+    }
+    av_free(session);
+}
+
+// releases the sessions whose client disconnected, so a long running multi session process doesn't accumulate them
+static void receiver_server_reap_sessions(receiver_server_t *server)
+{
+    pthread_mutex_lock(&server->diagnostics_locker);
+    for (int i=vector_total(&server->sessions)-1;i>=0;i--) {
+        receiver_server_session_t* session=(receiver_server_session_t*)vector_get(&server->sessions,i);
+        if (!atomic_load(&session->completed)) {
+            continue;
+        }
+        if (session->thread_id>0) {
+            pthread_join(session->thread_id,NULL);
+        }
+        vector_delete(&server->sessions,i);
+        receiver_server_session_free(server,session);
+    }
+    pthread_mutex_unlock(&server->diagnostics_locker);
+}
+
+static receiver_server_session_t* receiver_server_session_create(receiver_server_t *server)
+{
+    receiver_server_session_t* session = (receiver_server_session_t*)av_mallocz(sizeof(receiver_server_session_t));
+    if (session==NULL) {
+        return NULL;
+    }
+
+    sample_stats_init(&session->receiverStats,standard_timebase);
+
+    session->thread_id=0;
+    session->server=server;
+    session->lastDiagnostics=NULL;
+    atomic_init(&session->completed,false);
+    json_get_bool(GetConfig(),"autoAckModeEnabled",false,&session->autoAckMode);
+    if (server->multiSession) {
+        session->transcode_session=(transcode_session_t*)av_mallocz(sizeof(transcode_session_t));
+        if (session->transcode_session==NULL) {
+            av_free(session);
+            return NULL;
+        }
+        // the event loop must not block on the transcoding, so its input is always queued
+        session->transcode_session->asyncInput=server->eventLoop;
+    } else {
+        session->transcode_session=server->transcode_session;
+    }
+    if (session->transcode_session!=NULL) {
+        session->transcode_session->workerPool=server->workerPool;
+    }
+    pthread_mutex_lock(&server->diagnostics_locker);
+    vector_add(&server->sessions,session);
+    pthread_mutex_unlock(&server->diagnostics_locker);
+    if (session->transcode_session==NULL) {
+        sprintf(session->stream_name,"Receiver-%d",vector_total(&server->sessions));
+    } else {
+        session->stream_name[0]=0;
+    }
+    return session;
+}
+
 void* listenerThread(void *vargp)
 {
     LOGGER0(CATEGORY_RECEIVER,AV_LOG_INFO,"listenerThread");
 
     receiver_server_t *server=(receiver_server_t *)vargp;
-    transcode_session_t *transcodeContext = server->transcode_session;
 
     while (true)
     {
-        receiver_server_session_t* session = (receiver_server_session_t*)av_malloc(sizeof(receiver_server_session_t));
-
-        sample_stats_init(&server->receiverStats,standard_timebase);
+        if (server->multiSession) {
+            receiver_server_reap_sessions(server);
+        }
 
-        vector_add(&server->sessions,session);
-        session->thread_id=0;
-        session->server=server;
-        if (transcodeContext==NULL) {
-            sprintf(session->stream_name,"Receiver-%d",vector_total(&server->sessions));
-        } else {
-            session->stream_name[0]=0;
+        receiver_server_session_t* session = receiver_server_session_create(server);
+        if (session==NULL) {
+            return (void*)AVERROR(ENOMEM);
         }
 
         LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"Waiting for accept on %s",socketAddress(&server->kmpServer.address));
@@ -210,6 +325,314 @@ void* listenerThread(void *vargp)
     return NULL;
 }
 
+#ifdef __linux__
+
+/* event loop, a single thread receives the packets of all the sessions */
+
+static void* receiver_server_session_close_thread(void *vargp)
+{
+    receiver_server_session_t* session=( receiver_server_session_t *)vargp;
+    LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"[%s] Closing session. exit code is %d",session->stream_name,session->exitCode);
+    if (session->handshakeReceived) {
+        transcode_session_close(session->transcode_session,session->exitCode);
+    }
+    KMP_close(&session->kmpClient);
+    LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"[%s] Completed session",session->stream_name);
+    atomic_store(&session->completed,true);
+    return NULL;
+}
+
+// flushing the transcoder can take a while, so it's done on a thread of its own
+static void receiver_server_session_close(receiver_server_session_t *session,int exitCode)
+{
+    receiver_server_t *server=session->server;
+    if (!session->paused) {
+        epoll_ctl(server->epollFd,EPOLL_CTL_DEL,session->kmpClient.socket,NULL);
+    }
+    session->closing=true;
+    session->exitCode=exitCode;
+    if (pthread_create(&session->thread_id,NULL,receiver_server_session_close_thread,session)) {
+        session->thread_id=0;
+        receiver_server_session_close_thread(session);
+    }
+}
+
+static bool receiver_server_session_input_full(receiver_server_session_t *session)
+{
+    return session->handshakeReceived && transcode_session_async_queue_full(session->transcode_session);
+}
+
+// handles the complete packets in the receive buffer,
+// returns 0 when more data is needed, 1 when the transcoder input queue is full or the input is throttled
+static int receiver_server_session_parse(receiver_server_session_t *session)
+{
+    kmp_packet_header_t header;
+    int ret;
+    while ((ret=KMP_reader_peek(&session->reader,&header))>0) {
+
+        if ((header.packet_type==KMP_PACKET_FRAME || header.packet_type==KMP_PACKET_MEDIA_INFO) &&
+            receiver_server_session_input_full(session)) {
+            return 1;
+        }
+
+        switch (header.packet_type) {
+            case KMP_PACKET_EOS:
+                LOGGER(CATEGORY_KMP,AV_LOG_INFO,"[%s] recieved termination packet",session->stream_name);
+                KMP_reader_skip(&session->reader,&header);
+                session->eos=true;
+                return AVERROR_EOF;
+
+            case KMP_PACKET_CONNECT:
+            {
+                kmp_frame_position_t start_pos = {0};
+                if ((ret=KMP_reader_get_handshake(&session->reader,&header,session->channel_id,session->track_id,&start_pos))<0) {
+                    LOGGER(CATEGORY_RECEIVER,AV_LOG_FATAL,"[%s] KMP_reader_get_handshake",session->stream_name);
+                    return ret;
+                }
+                session->handshakeReceived=true;
+                _S(receiver_server_session_on_handshake(session,&start_pos));
+                break;
+            }
+
+            case KMP_PACKET_MEDIA_INFO:
+            {
+                if (!session->handshakeReceived) {
+                    return AVERROR_INVALIDDATA;
+                }
+                transcode_mediaInfo_t* newParams=av_malloc(sizeof(transcode_mediaInfo_t));
+                if (newParams==NULL) {
+                    return AVERROR(ENOMEM);
+                }
+                newParams->codecParams=avcodec_parameters_alloc();
+                if ((ret=KMP_reader_get_mediaInfo(&session->kmpClient,&session->reader,&header,newParams))<0) {
+                    LOGGER(CATEGORY_RECEIVER,AV_LOG_FATAL,"[%s] Invalid mediainfo",session->stream_name);
+                    avcodec_parameters_free(&newParams->codecParams);
+                    av_free(newParams);
+                    return ret;
+                }
+                LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"[%s] received packet  KMP_PACKET_MEDIA_INFO",session->stream_name);
+                transcode_session_async_set_mediaInfo(session->transcode_session, newParams);
+                break;
+            }
+
+            case KMP_PACKET_FRAME:
+            {
+                if (!session->handshakeReceived) {
+                    return AVERROR_INVALIDDATA;
+                }
+                // the throttler delays the frame by pausing the session instead of sleeping
+                if (!session->throttleWaited) {
+                    int64_t wait=throttler_get_wait(&session->throttler,session->transcode_session);
+                    if (wait>0) {
+                        session->throttledUntil=av_gettime_relative()+wait;
+                        session->throttleWaited=true;
+                        return 1;
+                    }
+                }
+                session->throttleWaited=false;
+                AVPacket* packet=av_packet_alloc();
+                if (packet==NULL) {
+                    return AVERROR(ENOMEM);
+                }
+                if ((ret=KMP_reader_get_packet(&session->reader,&header,packet))>=0) {
+                    ret=receiver_server_session_on_frame(session,packet,NULL);
+                }
+                av_packet_free(&packet);
+                _S(ret);
+                break;
+            }
+
+            default:
+                KMP_reader_skip(&session->reader,&header);
+                break;
+        }
+    }
+    return ret;
+}
+
+#define RECEIVER_SERVER_MAX_READS_PER_EVENT 4
+
+static void receiver_server_session_process(receiver_server_session_t *session)
+{
+    receiver_server_t *server=session->server;
+    // packets left in the buffer by a pause are handled before reading more
+    int ret=receiver_server_session_parse(session);
+    // the reads per wakeup are bounded so that a busy session doesn't starve the others,
+    // epoll keeps reporting the socket while it has data
+    for (int i=0;ret==0 && i<RECEIVER_SERVER_MAX_READS_PER_EVENT;i++) {
+        ret=KMP_reader_fill(&session->kmpClient,&session->reader);
+        if (ret==AVERROR(EAGAIN) || ret==AVERROR(EWOULDBLOCK)) {
+            return;
+        }
+        if (ret<0) {
+            break;
+        }
+        session->lastReceiveTime=av_gettime_relative();
+        ret=receiver_server_session_parse(session);
+    }
+    if (ret==1) {
+        // resumed from the loop once the transcoder drains its queue and the throttling wait is over
+        if (!session->paused) {
+            epoll_ctl(server->epollFd,EPOLL_CTL_DEL,session->kmpClient.socket,NULL);
+            session->paused=true;
+        }
+        return;
+    }
+    if (ret>=0) {
+        return;
+    }
+    if (ret==AVERROR_EOF && !session->eos) {
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"[%s] client disconnected",session->stream_name);
+    } else if (ret!=AVERROR_EOF) {
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_ERROR,"[%s] receive failed %d (%s)",session->stream_name,ret,av_err2str(ret));
+    }
+    receiver_server_session_close(session,session->eos ? 0 : ret);
+}
+
+static void receiver_server_accept_clients(receiver_server_t *server)
+{
+    while (true) {
+        struct sockaddr_in address;
+        socklen_t addrLen=sizeof(address);
+        int fd=accept4(server->kmpServer.socket,(struct sockaddr *)&address,&addrLen,SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (fd<0) {
+            if (errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR) {
+                LOGGER(CATEGORY_RECEIVER,AV_LOG_ERROR,"accept failed errno=%d",errno);
+            }
+            return;
+        }
+        receiver_server_session_t* session = receiver_server_session_create(server);
+        if (session==NULL || KMP_reader_init(&session->reader)<0) {
+            LOGGER0(CATEGORY_RECEIVER,AV_LOG_ERROR,"failed to allocate session");
+            close(fd);
+            if (session!=NULL) {
+                atomic_store(&session->completed,true);
+            }
+            return;
+        }
+        KMP_init(&session->kmpClient);
+        KMP_ack_writer_init(&session->ackWriter);
+        throttler_init(&session->receiverStats,&session->throttler);
+        session->kmpClient.socket=fd;
+        session->kmpClient.address=address;
+        session->kmpClient.non_blocking=true;
+        sprintf(session->kmpClient.sessionName,"%s => %s",socketAddress(&address),socketAddress(&server->kmpServer.address));
+        receiver_server_session_init_diagnostics(session);
+        session->lastReceiveTime=av_gettime_relative();
+
+        struct epoll_event event={.events=EPOLLIN|EPOLLRDHUP,.data.ptr=session};
+        if (epoll_ctl(server->epollFd,EPOLL_CTL_ADD,fd,&event)<0) {
+            LOGGER(CATEGORY_RECEIVER,AV_LOG_ERROR,"epoll_ctl failed errno=%d",errno);
+            close(fd);
+            session->kmpClient.socket=0;
+            atomic_store(&session->completed,true);
+            continue;
+        }
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"Accepted client %s",session->kmpClient.sessionName);
+    }
+}
+
+// resumes the paused sessions, sends the acks of the frames transcoded since the last packet and times out idle clients
+static bool receiver_server_poll_sessions(receiver_server_t *server)
+{
+    bool hasPaused=false;
+    int64_t now=av_gettime_relative();
+    for (int i=0;i<vector_total(&server->sessions);i++) {
+        receiver_server_session_t* session=(receiver_server_session_t*)vector_get(&server->sessions,i);
+        if (session->closing || atomic_load(&session->completed)) {
+            continue;
+        }
+        if (session->paused && !receiver_server_session_input_full(session) && now>=session->throttledUntil) {
+            struct epoll_event event={.events=EPOLLIN|EPOLLRDHUP,.data.ptr=session};
+            epoll_ctl(server->epollFd,EPOLL_CTL_ADD,session->kmpClient.socket,&event);
+            session->paused=false;
+            receiver_server_session_process(session);
+            if (session->closing) {
+                continue;
+            }
+        }
+        hasPaused|=session->paused;
+        if (session->handshakeReceived && receiver_server_session_send_ack(session)<0) {
+            receiver_server_session_close(session,AVERROR(EIO));
+            continue;
+        }
+        if (!session->paused && now-session->lastReceiveTime>server->receiveTimeout) {
+            LOGGER(CATEGORY_RECEIVER,AV_LOG_ERROR,"[%s] receive timeout",session->stream_name);
+            receiver_server_session_close(session,AVERROR(ETIMEDOUT));
+        }
+    }
+    return hasPaused;
+}
+
+#define RECEIVER_SERVER_MAX_EVENTS 64
+
+static int receiver_server_event_loop(receiver_server_t *server)
+{
+    struct epoll_event events[RECEIVER_SERVER_MAX_EVENTS];
+    int tv_sec;
+    json_get_int(GetConfig(),"kmp.sndRcvTimeout",60*3,&tv_sec);
+    server->receiveTimeout=tv_sec*1000000LL;
+
+    server->epollFd=epoll_create1(EPOLL_CLOEXEC);
+    if (server->epollFd<0) {
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_FATAL,"epoll_create1 failed errno=%d",errno);
+        return AVERROR(errno);
+    }
+    int flags=fcntl(server->kmpServer.socket,F_GETFL,0);
+    fcntl(server->kmpServer.socket,F_SETFL,(flags<0 ? 0 : flags)|O_NONBLOCK);
+    struct epoll_event listenEvent={.events=EPOLLIN,.data.ptr=NULL};
+    if (epoll_ctl(server->epollFd,EPOLL_CTL_ADD,server->kmpServer.socket,&listenEvent)<0) {
+        LOGGER(CATEGORY_RECEIVER,AV_LOG_FATAL,"epoll_ctl failed errno=%d",errno);
+        close(server->epollFd);
+        return AVERROR(errno);
+    }
+    LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"Event loop listening on %s",socketAddress(&server->kmpServer.address));
+
+    bool hasPaused=false;
+    // the server socket is reset by receiver_server_close
+    while (server->kmpServer.socket>0) {
+        // acks and paused sessions are polled, more often while sessions are paused
+        int n=epoll_wait(server->epollFd,events,RECEIVER_SERVER_MAX_EVENTS,hasPaused ? 10 : 100);
+        if (n<0 && errno!=EINTR) {
+            LOGGER(CATEGORY_RECEIVER,AV_LOG_FATAL,"epoll_wait failed errno=%d",errno);
+            break;
+        }
+        for (int i=0;i<n;i++) {
+            receiver_server_session_t* session=(receiver_server_session_t*)events[i].data.ptr;
+            if (session==NULL) {
+                receiver_server_accept_clients(server);
+                continue;
+            }
+            if (!session->closing && !session->paused) {
+                receiver_server_session_process(session);
+            }
+        }
+        hasPaused=receiver_server_poll_sessions(server);
+        receiver_server_reap_sessions(server);
+    }
+
+    for (int i=0;i<vector_total(&server->sessions);i++) {
+        receiver_server_session_t* session=(receiver_server_session_t*)vector_get(&server->sessions,i);
+        if (!session->closing && !atomic_load(&session->completed)) {
+            receiver_server_session_close(session,0);
+        }
+    }
+    // waits for the transcoders to flush
+    for (int i=0;i<vector_total(&server->sessions);i++) {
+        receiver_server_session_t* session=(receiver_server_session_t*)vector_get(&server->sessions,i);
+        if (session->thread_id>0) {
+            pthread_join(session->thread_id,NULL);
+            session->thread_id=0;
+        }
+    }
+    receiver_server_reap_sessions(server);
+    close(server->epollFd);
+    server->epollFd=-1;
+    return 0;
+}
+
+#endif
+
 
 int receiver_server_init(receiver_server_t *server)
 {
@@ -222,6 +645,8 @@ int receiver_server_init(receiver_server_t *server)
     server->kmpServer.listenPort=server->port;
     if(clientSocket > 0){
         LOGGER(CATEGORY_RECEIVER,AV_LOG_INFO,"kmp.fd  %d",clientSocket);
+        // there is no listening socket to poll
+        server->eventLoop=false;
         return 0;
     } else {
         int ret;
@@ -244,7 +669,13 @@ int receiver_server_async_listen(receiver_server_t *server)
 }
 int receiver_server_sync_listen(receiver_server_t *server)
 {
-    server->multiThreaded=false;
+    // a multi session server keeps accepting clients, each on its own receive thread
+    server->multiThreaded=server->multiSession;
+#ifdef __linux__
+    if (server->eventLoop) {
+        return receiver_server_event_loop(server);
+    }
+#endif
     return (int)listenerThread(server);
 }
 
@@ -268,7 +699,7 @@ void receiver_server_close(receiver_server_t *server)
             if (session->thread_id>0) {
                 pthread_join(session->thread_id,NULL);
             }
-            av_free(session);
+            receiver_server_session_free(server,session);
         }
         server->thread_id=0;
     }
@@ -276,10 +707,57 @@ void receiver_server_close(receiver_server_t *server)
     pthread_mutex_destroy(&server->diagnostics_locker);
 }
 
+void receiver_server_get_metrics(receiver_server_t *server,json_writer_ctx_t js)
+{
+    pthread_mutex_lock(&server->diagnostics_locker);
+    latency_histogram_write_prometheus_header(TRANSCODER_INPUT_LATENCY_METRIC,
+        "Input latency by stage, queue is the wait in the incoming queue, decode is from the KMP receive to the decoder output.",js);
+    for (int i=0;i<vector_total(&server->sessions);i++) {
+        receiver_server_session_t* session=(receiver_server_session_t*)vector_get(&server->sessions,i);
+        if (session->transcode_session!=NULL) {
+            transcode_session_get_input_metrics(session->transcode_session,TRANSCODER_INPUT_LATENCY_METRIC,js);
+        }
+        // in single session mode, all the connections share the transcode session
+        if (!server->multiSession) {
+            break;
+        }
+    }
+    latency_histogram_write_prometheus_header(TRANSCODER_OUTPUT_LATENCY_METRIC,
+        "Output latency by stage, total is from the KMP receive to the KMP send.",js);
+    for (int i=0;i<vector_total(&server->sessions);i++) {
+        receiver_server_session_t* session=(receiver_server_session_t*)vector_get(&server->sessions,i);
+        if (session->transcode_session!=NULL) {
+            transcode_session_get_output_metrics(session->transcode_session,TRANSCODER_OUTPUT_LATENCY_METRIC,js);
+        }
+        if (!server->multiSession) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->diagnostics_locker);
+}
+
 void receiver_server_get_diagnostics(receiver_server_t *server,json_writer_ctx_t js)
 {
     pthread_mutex_lock(&server->diagnostics_locker);  // lock the critical section
-    if (server->lastDiagnsotics) {
+    if (server->multiSession) {
+        JSON_SERIALIZE_ARRAY_START("sessions")
+        for (int i=0;i<vector_total(&server->sessions);i++) {
+            receiver_server_session_t* session=(receiver_server_session_t*)vector_get(&server->sessions,i);
+            // sessions that don't fit in the response are left out
+            if (session->lastDiagnostics==NULL || strlen(session->lastDiagnostics)+2>=js->end-js->cur) {
+                continue;
+            }
+            ADD_COMMA()
+            JSON_WRITE("%s",session->lastDiagnostics);
+            JSON_SERIALIZE_ARRAY_ITEM()
+        }
+        JSON_SERIALIZE_ARRAY_END()
+        if (server->workerPool!=NULL) {
+            JSON_SERIALIZE_OBJECT_BEGIN("workerPool")
+            worker_pool_get_diagnostics(server->workerPool,js);
+            JSON_SERIALIZE_OBJECT_END()
+        }
+    } else if (server->lastDiagnsotics) {
        JSON_WRITE("%s",server->lastDiagnsotics);
     }
     pthread_mutex_unlock(&server->diagnostics_locker);  // lock the critical section
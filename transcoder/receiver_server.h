@@ -15,6 +15,7 @@
 #include "KMP/KMP.h"
 #include "vector.h"
 #include "./utils/packetQueue.h"
+#include "./utils/throttler.h"
 
 
 typedef struct
@@ -26,9 +27,13 @@ typedef struct
     char listenAddress[MAX_URL_LENGTH];
     uint16_t port;
     vector_t sessions;
-    samples_stats_t receiverStats;
     pthread_mutex_t diagnostics_locker;
     char* lastDiagnsotics;
+    bool multiSession;          // every accepted client gets its own transcode session
+    worker_pool_t* workerPool;  // shared by the transcode sessions' queues, may be NULL
+    bool eventLoop;             // multi session mode only, a single epoll thread receives all the sessions
+    int epollFd;
+    int64_t receiveTimeout;
 } receiver_server_t;
 
 typedef struct
@@ -41,13 +46,37 @@ typedef struct
     pthread_t thread_id;
     uint64_t lastStatsUpdated;
     int64_t diagnosticsIntervalInSeconds;
+    transcode_session_t *transcode_session;
+    samples_stats_t receiverStats;
+    char* lastDiagnostics;      // multi session mode only
+    atomic_bool completed;
+    uint64_t received_frame_id;
+    uint64_t received_frame_ack_id;
+    bool autoAckMode;
+    // event loop only
+    KMP_reader_t reader;
+    KMP_ack_writer_t ackWriter;
+    throttler_t throttler;
+    int64_t throttledUntil;     // the session is paused until then
+    bool throttleWaited;        // the frame at the head of the buffer already waited
+    bool handshakeReceived;
+    bool paused;                // the transcoder input queue is full or throttled, the socket isn't polled
+    bool eos;
+    bool closing;
+    int exitCode;
+    int64_t lastReceiveTime;
 } receiver_server_session_t;
 
+#define TRANSCODER_INPUT_LATENCY_METRIC "transcoder_input_latency_seconds"
+#define TRANSCODER_OUTPUT_LATENCY_METRIC "transcoder_output_latency_seconds"
+
 int receiver_server_init( receiver_server_t *server);
 int receiver_server_async_listen( receiver_server_t *server);
 int receiver_server_sync_listen( receiver_server_t *server);
 
 void receiver_server_close( receiver_server_t *server);
 void receiver_server_get_diagnostics( receiver_server_t *server,json_writer_ctx_t js);
+// prometheus text format
+void receiver_server_get_metrics( receiver_server_t *server,json_writer_ctx_t js);
 
 #endif /* listener_h */
@@ -13,6 +13,8 @@ int transcode_codec_init( transcode_codec_t * pContext)
 {
     pContext->name[0]=0;
     pContext->inDts=pContext->outDts=0;
+    pContext->busyTime=0;
+    pContext->framePool=NULL;
     sample_stats_init(&pContext->inStats,standard_timebase);
     sample_stats_init(&pContext->outStats,standard_timebase);
     return 0;
@@ -88,16 +90,19 @@ static enum AVPixelFormat get_hw_format(AVCodecContext *ctx,const enum AVPixelFo
 
 static int get_decoder_buffer(AVCodecContext *s, AVFrame *frame, int flags)
 {
-    //transcode_codec_t *context = s->opaque;
-
+    transcode_codec_t *context = s->opaque;
+    if (context->framePool!=NULL && frame_pool_supports(context->framePool,s)) {
+        return frame_pool_get_video_buffer(context->framePool,s,frame);
+    }
     return avcodec_default_get_buffer2(s, frame, flags);
 }
 
 
 
-int transcode_codec_init_decoder( transcode_codec_t * pContext,transcode_mediaInfo_t* extraParams)
+int transcode_codec_init_decoder( transcode_codec_t * pContext,transcode_mediaInfo_t* extraParams,frame_pool_t* framePool)
 {
     transcode_codec_init(pContext);
+    pContext->framePool=framePool;
 
     AVCodecParameters *pCodecParams=extraParams->codecParams;
 
@@ -161,9 +166,9 @@ int transcode_codec_init_decoder( transcode_codec_t * pContext,transcode_mediaIn
             return ret;
         }
         codec_ctx->get_format  = get_hw_format;
-        codec_ctx->get_buffer2 = get_decoder_buffer;
         codec_ctx->hw_device_ctx = av_buffer_ref(pContext->hw_device_ctx);
     }
+    codec_ctx->get_buffer2 = get_decoder_buffer;
     av_opt_set_int(codec_ctx, "refcounted_frames", 1, 0);
 
     ret = avcodec_open2(codec_ctx, dec, NULL);
@@ -201,6 +206,32 @@ int get_preset(const char* codec,const char* preset,char* result,size_t resultSi
     return -1;
 }
 
+// no frame is held by the encoder: no B frames and no lookahead, and the threads split each frame
+// into slices instead of working on several frames
+static
+void set_low_latency_options(AVCodecContext *enc_ctx,const transcode_session_output_t* pOutput,char* x264Params,size_t x264ParamsSize)
+{
+    enc_ctx->max_b_frames=0;
+    enc_ctx->thread_type=FF_THREAD_SLICE;
+    if (strcmp(enc_ctx->codec->name,"libx264")==0) {
+        av_opt_set(enc_ctx->priv_data, "tune", "zerolatency", 0);
+        av_opt_set_int(enc_ctx->priv_data, "rc-lookahead", 0, 0);
+        if (pOutput->videoParams.intraRefresh) {
+            av_opt_set_int(enc_ctx->priv_data, "intra-refresh", 1, 0);
+        }
+        av_strlcat(x264Params,":sliced-threads=1:sync-lookahead=0",x264ParamsSize);
+    } else {
+        // nvenc, the options that the encoder doesn't have are ignored
+        av_opt_set_int(enc_ctx->priv_data, "zerolatency", 1, 0);
+        av_opt_set_int(enc_ctx->priv_data, "delay", 0, 0);
+        av_opt_set_int(enc_ctx->priv_data, "rc-lookahead", 0, 0);
+        if (pOutput->videoParams.intraRefresh) {
+            av_opt_set_int(enc_ctx->priv_data, "intra-refresh", 1, 0);
+        }
+    }
+    LOGGER(CATEGORY_CODEC,AV_LOG_INFO,"set video encoder low latency options (intra refresh %d)",pOutput->videoParams.intraRefresh);
+}
+
 static
 int
 init_video_encoder(transcode_codec_t * pContext,
@@ -212,7 +243,10 @@ init_video_encoder(transcode_codec_t * pContext,
      AVRational timebase,
      AVRational inputFrameRate,
      struct AVBufferRef* hw_frames_ctx,
-     const char *codecName){
+     const char *codecName,
+     const char *presetOverride,
+     int threads,
+     int maxBFrames){
 
     int ret = 0;
 
@@ -257,15 +291,28 @@ init_video_encoder(transcode_codec_t * pContext,
        av_opt_set_int(enc_ctx->priv_data, "forced-idr", 1, 0);
     }
 
-    if (strlen(pOutput->videoParams.preset)>0) {
+    if (presetOverride!=NULL) {
+        av_opt_set(enc_ctx->priv_data, "preset", presetOverride, 0);
+        LOGGER(CATEGORY_CODEC,AV_LOG_INFO,"set video encoder preset %s",presetOverride);
+    } else if (strlen(pOutput->videoParams.preset)>0) {
         char preset[100]={0};
         if (0>=get_preset(codec->name,pOutput->videoParams.preset,preset,sizeof(preset))) {
             av_opt_set(enc_ctx->priv_data, "preset",   preset, 0);
             LOGGER(CATEGORY_CODEC,AV_LOG_INFO,"set video encoder preset %s",preset);
         }
     }
+    char x264Params[256]="nal-hrd=cbr:ratetol=10:scenecut=-1";
+    if (threads>0) {
+        enc_ctx->thread_count=threads;
+    }
+    if (maxBFrames>=0) {
+        enc_ctx->max_b_frames=maxBFrames;
+    }
+    if (pOutput->videoParams.lowLatency) {
+        set_low_latency_options(enc_ctx,pOutput,x264Params,sizeof(x264Params));
+    }
     if (strcmp(enc_ctx->codec->name,"libx264")==0) {
-        av_opt_set(enc_ctx->priv_data, "x264-params", "nal-hrd=cbr:ratetol=10:scenecut=-1", AV_OPT_SEARCH_CHILDREN);
+        av_opt_set(enc_ctx->priv_data, "x264-params", x264Params, AV_OPT_SEARCH_CHILDREN);
     }
     enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
@@ -276,6 +323,9 @@ init_video_encoder(transcode_codec_t * pContext,
     } else {
         pContext->codec=codec;
         pContext->ctx=enc_ctx;
+        if (pOutput->videoParams.lowLatency && enc_ctx->has_b_frames>0) {
+            LOGGER(CATEGORY_CODEC,AV_LOG_WARNING,"low latency video encoder \"%s\" delays the output by %d frames",codec->name,enc_ctx->has_b_frames);
+        }
         LOGGER(CATEGORY_CODEC,AV_LOG_INFO,"video encoder  \"%s\"  %dx%d %d Kbit/s %s initilaized",codec->long_name,enc_ctx->width,enc_ctx->height,enc_ctx->bit_rate/1000, av_get_pix_fmt_name (enc_ctx->pix_fmt));
     }
     return ret;
@@ -335,12 +385,46 @@ int transcode_codec_init_video_encoder( transcode_codec_t * pContext,
             timebase,
             inputFrameRate,
             hw_frames_ctx,
-            tmp);
+            tmp,
+            NULL,
+            pOutput->presetController.threads,
+            -1);
     }
 
     return ret;
 }
 
+int transcode_codec_clone_video_encoder(transcode_codec_t * pContext,
+                       const transcode_session_output_t* pOutput,
+                       const char* preset,
+                       int threads,
+                       int maxBFrames,
+                       AVCodecContext** pNewCtx)
+{
+    const AVCodecContext* ctx=pContext->ctx;
+    transcode_codec_t clone;
+    transcode_codec_init(&clone);
+
+    int ret=init_video_encoder(&clone,
+        pOutput,
+        ctx->width,
+        ctx->height,
+        ctx->sample_aspect_ratio,
+        ctx->pix_fmt,
+        ctx->time_base,
+        ctx->framerate,
+        ctx->hw_frames_ctx,
+        pContext->codec->name,
+        preset,
+        threads,
+        maxBFrames);
+    if (ret<0) {
+        return ret;
+    }
+    *pNewCtx=clone.ctx;
+    return 0;
+}
+
 int transcode_codec_init_audio_encoder( transcode_codec_t * pContext,transcode_filter_t* pFilter, const  transcode_session_output_t* pOutput)
 {
     transcode_codec_init(pContext);
@@ -398,7 +482,9 @@ int transcode_encoder_send_frame( transcode_codec_t *encoder, const AVFrame* pFr
         samples_stats_add(&encoder->inStats,pFrame->pts,pFrame->pkt_pos, 0);
     }
 
+    int64_t start=getTime64();
     int ret = avcodec_send_frame(encoder->ctx, pFrame);
+    encoder->busyTime+=getTime64()-start;
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
     {
         return 0;
@@ -413,7 +499,9 @@ int transcode_encoder_send_frame( transcode_codec_t *encoder, const AVFrame* pFr
 int transcode_encoder_receive_packet( transcode_codec_t *encoder,AVPacket* pkt)
 {
     int ret;
+    int64_t start=getTime64();
     ret = avcodec_receive_packet(encoder->ctx, pkt);
+    encoder->busyTime+=getTime64()-start;
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
     {
         return ret;
@@ -13,6 +13,7 @@
 #include "transcode_filter.h"
 #include "transcode_session_output.h"
 #include "samples_stats.h"
+#include "framePool.h"
 
 typedef struct
 {
@@ -23,12 +24,15 @@ typedef struct
     int64_t inDts,outDts;
     bool nvidiaAccelerated;
     samples_stats_t inStats,outStats;
+    int64_t busyTime;   // spent in the encoder calls, microseconds
+    frame_pool_t* framePool;    // decoders, owned by the session
 
 } transcode_codec_t;
 
 int transcode_codec_init(transcode_codec_t * pContext);
 
-int transcode_codec_init_decoder(transcode_codec_t * pContext,transcode_mediaInfo_t* extraParams);
+// framePool, when not NULL, provides the buffers of the decoded video frames
+int transcode_codec_init_decoder(transcode_codec_t * pContext,transcode_mediaInfo_t* extraParams,frame_pool_t* framePool);
 
 int transcode_codec_close(transcode_codec_t * pContext);
 
@@ -41,6 +45,15 @@ int transcode_codec_init_video_encoder(transcode_codec_t * pContext,
                        const transcode_session_output_t* pOutput,
                        int width,int height);
 
+// opens a new video encoder with the settings of pContext and another preset / thread count (0 for the default)
+// and max B frames (-1 for the preset default), pContext is left as is
+int transcode_codec_clone_video_encoder(transcode_codec_t * pContext,
+                       const transcode_session_output_t* pOutput,
+                       const char* preset,
+                       int threads,
+                       int maxBFrames,
+                       AVCodecContext** pNewCtx);
+
 int transcode_codec_init_audio_encoder(transcode_codec_t * pContext, transcode_filter_t* pFilter,const  transcode_session_output_t* pOutput);
 
 
@@ -12,36 +12,22 @@
      (val)++;
 
 
-int transcode_filter_init( transcode_filter_t *pFilter, AVCodecContext *dec_ctx,const char *filters_descr)
+static
+int transcode_filter_init_graph( transcode_filter_t *pFilter, enum AVMediaType codec_type,const char *args,
+    AVBufferRef *hw_frames_ctx,const char *filters_descr)
 {
-    char args[512];
     int ret = 0;
     const AVFilter *buffersrc=NULL;
     const AVFilter *buffersink=NULL;
 
 
-    if (dec_ctx->codec_type==AVMEDIA_TYPE_VIDEO) {
+    if (codec_type==AVMEDIA_TYPE_VIDEO) {
         buffersrc  = avfilter_get_by_name("buffer");
         buffersink = avfilter_get_by_name("buffersink");
-        snprintf(args, sizeof(args),
-                 "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d:frame_rate=%d/%d",
-                 dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt,
-                 standard_timebase.num, standard_timebase.den,
-                 dec_ctx->sample_aspect_ratio.num, dec_ctx->sample_aspect_ratio.den,
-                 dec_ctx->framerate.num, dec_ctx->framerate.den);
     }
-    if (dec_ctx->codec_type==AVMEDIA_TYPE_AUDIO) {
+    if (codec_type==AVMEDIA_TYPE_AUDIO) {
         buffersrc  = avfilter_get_by_name("abuffer");
         buffersink = avfilter_get_by_name("abuffersink");
-        uint64_t channelLayout=dec_ctx->channel_layout;
-        if (channelLayout<=0) {
-            channelLayout=av_get_default_channel_layout(dec_ctx->channels);
-        }
-        snprintf(args, sizeof args,
-                 "sample_rate=%d:sample_fmt=%d:channel_layout=0x%"PRIx64":channels=%d:"
-                 "time_base=%d/%d",
-                 dec_ctx->sample_rate, dec_ctx->sample_fmt, channelLayout,
-                 dec_ctx->channels, standard_timebase.num, standard_timebase.den);
     }
 
     AVFilterInOut *outputs = avfilter_inout_alloc();
@@ -50,6 +36,7 @@ int transcode_filter_init( transcode_filter_t *pFilter, AVCodecContext *dec_ctx,
     LOGGER(CATEGORY_FILTER,AV_LOG_INFO, "Create filter: config: \"%s\"  args: \"%s\"",filters_descr,args);
 
     pFilter->config=strdup(filters_descr);
+    pFilter->sourceFilterId=-1;
 
     pFilter->filter_graph = avfilter_graph_alloc();
     if (!outputs || !inputs || !pFilter->filter_graph) {
@@ -67,12 +54,12 @@ int transcode_filter_init( transcode_filter_t *pFilter, AVCodecContext *dec_ctx,
 
 
 
-    if (dec_ctx->hw_frames_ctx!=NULL) {
+    if (hw_frames_ctx!=NULL) {
         LOGGER0(CATEGORY_FILTER, AV_LOG_INFO, "Setting hardware device context")
         AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
         memset(par, 0, sizeof(*par));
         par->format = AV_PIX_FMT_NONE;
-        par->hw_frames_ctx=dec_ctx->hw_frames_ctx;
+        par->hw_frames_ctx=hw_frames_ctx;
         ret = av_buffersrc_parameters_set(pFilter->src_ctx, par);
         if (ret<0) {
             LOGGER(CATEGORY_FILTER, AV_LOG_ERROR, "Failed setting hardware device context %d (%s)",ret,av_err2str(ret))
@@ -90,7 +77,7 @@ int transcode_filter_init( transcode_filter_t *pFilter, AVCodecContext *dec_ctx,
         goto end;
     }
 
-    if (dec_ctx->codec_type==AVMEDIA_TYPE_VIDEO)
+    if (codec_type==AVMEDIA_TYPE_VIDEO)
     {
         enum AVPixelFormat pix_fmts[] = { AV_PIX_FMT_CUDA, AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE };
         ret = av_opt_set_int_list(pFilter->sink_ctx, "pix_fmts", pix_fmts,
@@ -117,9 +104,9 @@ int transcode_filter_init( transcode_filter_t *pFilter, AVCodecContext *dec_ctx,
         goto end;
     }
 
-    if (dec_ctx->hw_frames_ctx!=NULL) {
+    if (hw_frames_ctx!=NULL) {
         for (int i = 0; i < pFilter->filter_graph->nb_filters; i++) {
-            pFilter->filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(dec_ctx->hw_frames_ctx);
+            pFilter->filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(hw_frames_ctx);
         }
     }
 
@@ -138,6 +125,51 @@ end:
     pFilter->outputTimeScale=av_buffersink_get_time_base(pFilter->sink_ctx);
     return ret;
 }
+
+int transcode_filter_init( transcode_filter_t *pFilter, AVCodecContext *dec_ctx,const char *filters_descr)
+{
+    char args[512];
+
+    if (dec_ctx->codec_type==AVMEDIA_TYPE_VIDEO) {
+        snprintf(args, sizeof(args),
+                 "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d:frame_rate=%d/%d",
+                 dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt,
+                 standard_timebase.num, standard_timebase.den,
+                 dec_ctx->sample_aspect_ratio.num, dec_ctx->sample_aspect_ratio.den,
+                 dec_ctx->framerate.num, dec_ctx->framerate.den);
+    }
+    if (dec_ctx->codec_type==AVMEDIA_TYPE_AUDIO) {
+        uint64_t channelLayout=dec_ctx->channel_layout;
+        if (channelLayout<=0) {
+            channelLayout=av_get_default_channel_layout(dec_ctx->channels);
+        }
+        snprintf(args, sizeof args,
+                 "sample_rate=%d:sample_fmt=%d:channel_layout=0x%"PRIx64":channels=%d:"
+                 "time_base=%d/%d",
+                 dec_ctx->sample_rate, dec_ctx->sample_fmt, channelLayout,
+                 dec_ctx->channels, standard_timebase.num, standard_timebase.den);
+    }
+
+    return transcode_filter_init_graph(pFilter,dec_ctx->codec_type,args,dec_ctx->hw_frames_ctx,filters_descr);
+}
+
+int transcode_filter_init_from_filter( transcode_filter_t *pFilter, transcode_filter_t *pSource,const char *filters_descr)
+{
+    char args[512];
+    AVRational sample_aspect_ratio=av_buffersink_get_sample_aspect_ratio(pSource->sink_ctx);
+    AVRational frame_rate=av_buffersink_get_frame_rate(pSource->sink_ctx);
+
+    // frames leaving a filter are rescaled to the standard timebase (see transcode_filter_receive_frame)
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d:frame_rate=%d/%d",
+             av_buffersink_get_w(pSource->sink_ctx), av_buffersink_get_h(pSource->sink_ctx),
+             av_buffersink_get_format(pSource->sink_ctx),
+             standard_timebase.num, standard_timebase.den,
+             sample_aspect_ratio.num, sample_aspect_ratio.den,
+             frame_rate.num, frame_rate.den);
+
+    return transcode_filter_init_graph(pFilter,AVMEDIA_TYPE_VIDEO,args,av_buffersink_get_hw_frames_ctx(pSource->sink_ctx),filters_descr);
+}
 int transcode_filter_close( transcode_filter_t *pFilter)
 {
     avfilter_graph_free(&pFilter->filter_graph);
@@ -19,9 +19,11 @@ typedef  struct
     AVFilterContext *sink_ctx;
     AVFilterContext *src_ctx;
     uint64_t totalInErrors, totalOutErrors;
+    int sourceFilterId; // -1 when fed by the decoder
 } transcode_filter_t;
 
 int transcode_filter_init( transcode_filter_t *pFilter, AVCodecContext *dec_ctx,const char *filters_descr);
+int transcode_filter_init_from_filter( transcode_filter_t *pFilter, transcode_filter_t *pSource,const char *filters_descr);
 int transcode_filter_send_frame( transcode_filter_t *pFilter,const AVFrame* pInFrame);
 int transcode_filter_receive_frame( transcode_filter_t *pFilter,struct AVFrame* pOutFrame);
 int transcode_filter_close( transcode_filter_t *pFilter);
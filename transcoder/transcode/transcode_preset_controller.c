@@ -0,0 +1,162 @@
+#include "transcode_preset_controller.h"
+
+#define CATEGORY_PRESET_CONTROLLER "PRESET_CONTROLLER"
+
+// fastest first, placebo is left out
+static const char* x264_presets[]={"ultrafast","superfast","veryfast","faster","fast","medium","slow","slower","veryslow"};
+#define X264_PRESETS (int)(sizeof(x264_presets)/sizeof(x264_presets[0]))
+
+static int find_preset(const char* name,int defaultValue)
+{
+    for (int i=0;i<X264_PRESETS;i++) {
+        if (strcmp(x264_presets[i],name)==0) {
+            return i;
+        }
+    }
+    return defaultValue;
+}
+
+void transcode_preset_controller_init(transcode_preset_controller_t *ctl)
+{
+    char preset[32];
+    int intervalInSeconds;
+    json_value_t* config=GetConfig();
+
+    json_get_bool(config,"engine.adaptivePreset.enabled",false,&ctl->enabled);
+    json_get_string(config,"engine.adaptivePreset.fastest","superfast",preset,sizeof(preset));
+    ctl->fastest=find_preset(preset,1);
+    json_get_string(config,"engine.adaptivePreset.slowest","medium",preset,sizeof(preset));
+    ctl->slowest=FFMAX(find_preset(preset,5),ctl->fastest);
+    json_get_int(config,"engine.adaptivePreset.minThreads",0,&ctl->minThreads);
+    json_get_int(config,"engine.adaptivePreset.maxThreads",0,&ctl->maxThreads);
+    ctl->maxThreads=FFMAX(ctl->maxThreads,ctl->minThreads);
+    json_get_double(config,"engine.adaptivePreset.highLoad",0.85,&ctl->highLoad);
+    json_get_double(config,"engine.adaptivePreset.lowLoad",0.5,&ctl->lowLoad);
+    json_get_int(config,"engine.adaptivePreset.intervalInSeconds",10,&intervalInSeconds);
+    ctl->interval=intervalInSeconds*1000000LL;
+
+    ctl->preset=-1;
+    ctl->threads=ctl->minThreads;
+    ctl->lastBusyTime=0;
+    ctl->lastPts=AV_NOPTS_VALUE;
+    ctl->busyTime=ctl->duration=0;
+    ctl->pending=false;
+    ctl->load=0;
+    ctl->changes=0;
+}
+
+void transcode_preset_controller_start(transcode_preset_controller_t *ctl,const char* codecName,const char* preset)
+{
+    if (!ctl->enabled) {
+        return;
+    }
+    if (strcmp(codecName,"libx264")!=0) {
+        LOGGER(CATEGORY_PRESET_CONTROLLER,AV_LOG_INFO,"adaptive preset is not supported for %s",codecName);
+        ctl->enabled=false;
+        return;
+    }
+    // a preset out of the bounds is moved into them on the first change
+    ctl->preset=av_clip(find_preset(preset,ctl->fastest),ctl->fastest,ctl->slowest);
+    ctl->pending=strcmp(x264_presets[ctl->preset],preset)!=0;
+    ctl->nextPreset=ctl->preset;
+    ctl->nextThreads=ctl->threads;
+    LOGGER(CATEGORY_PRESET_CONTROLLER,AV_LOG_INFO,"adaptive preset started, preset %s (%s - %s) threads %d",
+           preset,x264_presets[ctl->fastest],x264_presets[ctl->slowest],ctl->threads);
+}
+
+static void transcode_preset_controller_decide(transcode_preset_controller_t *ctl)
+{
+    int nextPreset=ctl->preset;
+    int nextThreads=ctl->threads;
+    bool threadsManaged=ctl->maxThreads>0;
+
+    ctl->load=(double)ctl->busyTime/ctl->duration;
+    if (ctl->load>ctl->highLoad) {
+        // more threads first, they cost less quality than a faster preset
+        if (threadsManaged && ctl->threads<ctl->maxThreads) {
+            nextThreads++;
+        } else if (ctl->preset>ctl->fastest) {
+            nextPreset--;
+        }
+    } else if (ctl->load<ctl->lowLoad) {
+        if (ctl->preset<ctl->slowest) {
+            nextPreset++;
+        } else if (threadsManaged && ctl->threads>ctl->minThreads) {
+            nextThreads--;
+        }
+    }
+    if (nextPreset!=ctl->preset || nextThreads!=ctl->threads) {
+        LOGGER(CATEGORY_PRESET_CONTROLLER,AV_LOG_INFO,"load %.2f, changing preset %s -> %s threads %d -> %d on the next key frame",
+               ctl->load,x264_presets[ctl->preset],x264_presets[nextPreset],ctl->threads,nextThreads);
+        ctl->nextPreset=nextPreset;
+        ctl->nextThreads=nextThreads;
+        ctl->pending=true;
+    }
+}
+
+void transcode_preset_controller_on_frame(transcode_preset_controller_t *ctl,int64_t pts,AVRational timeBase,int64_t busyTime)
+{
+    if (!ctl->enabled) {
+        return;
+    }
+    if (ctl->lastPts!=AV_NOPTS_VALUE && pts>ctl->lastPts) {
+        // gaps longer than a second aren't real time
+        int64_t frameDuration=av_rescale_q(pts-ctl->lastPts,timeBase,AV_TIME_BASE_Q);
+        if (frameDuration<AV_TIME_BASE) {
+            ctl->duration+=frameDuration;
+            ctl->busyTime+=busyTime-ctl->lastBusyTime;
+        }
+    }
+    ctl->lastPts=pts;
+    ctl->lastBusyTime=busyTime;
+
+    if (ctl->pending || ctl->duration<ctl->interval) {
+        return;
+    }
+    transcode_preset_controller_decide(ctl);
+    ctl->busyTime=ctl->duration=0;
+}
+
+bool transcode_preset_controller_has_pending(transcode_preset_controller_t *ctl)
+{
+    return ctl->enabled && ctl->pending;
+}
+
+const char* transcode_preset_controller_get_next_preset(transcode_preset_controller_t *ctl)
+{
+    return x264_presets[ctl->nextPreset];
+}
+
+int transcode_preset_controller_get_next_max_b_frames(transcode_preset_controller_t *ctl,int hasBFrames)
+{
+    // x264 delays the dts by 0, 1 (B frames) or 2 (B pyramid) frames. the new encoder must keep
+    // the delay, otherwise its first dts would go back. only ultrafast has no B frames by default
+    if (hasBFrames==0) {
+        return 0;
+    }
+    return ctl->nextPreset==0 ? hasBFrames : -1;
+}
+
+void transcode_preset_controller_set_applied(transcode_preset_controller_t *ctl,bool applied,int64_t busyTime)
+{
+    ctl->pending=false;
+    ctl->lastBusyTime=busyTime;
+    // the window covered the previous settings
+    ctl->busyTime=ctl->duration=0;
+    if (!applied) {
+        LOGGER0(CATEGORY_PRESET_CONTROLLER,AV_LOG_ERROR,"failed to apply the preset change, adaptive preset disabled");
+        ctl->enabled=false;
+        return;
+    }
+    ctl->preset=ctl->nextPreset;
+    ctl->threads=ctl->nextThreads;
+    ctl->changes++;
+}
+
+void transcode_preset_controller_get_diagnostics(transcode_preset_controller_t *ctl,json_writer_ctx_t js)
+{
+    JSON_SERIALIZE_STRING("preset",ctl->preset>=0 ? x264_presets[ctl->preset] : "")
+    JSON_SERIALIZE_INT("threads",ctl->threads)
+    JSON_SERIALIZE_DOUBLE("load",ctl->load)
+    JSON_SERIALIZE_INT("changes",ctl->changes)
+}
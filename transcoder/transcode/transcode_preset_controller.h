@@ -0,0 +1,53 @@
+#ifndef transcode_preset_controller_h
+#define transcode_preset_controller_h
+
+#include <stdio.h>
+#include "../core.h"
+
+/* steps the preset (and thread count) of a libx264 encoder according to the time it spends
+   encoding compared to the duration of the frames. the changes are applied on key frames,
+   by replacing the encoder */
+
+typedef struct {
+    bool enabled;
+    int fastest,slowest;            // indexes in the x264 preset list, lower is faster
+    int minThreads,maxThreads;      // both 0 to keep the encoder default
+    double highLoad,lowLoad;        // encoding time / frames duration
+    int64_t interval;               // frames duration between decisions, in microseconds
+
+    int preset;
+    int threads;
+
+    // the current window
+    int64_t lastBusyTime;
+    int64_t lastPts;
+    int64_t busyTime;
+    int64_t duration;
+
+    // decided, waiting for the next key frame
+    bool pending;
+    int nextPreset;
+    int nextThreads;
+
+    double load;
+    int changes;
+} transcode_preset_controller_t;
+
+// reads the configuration, called before the encoder is opened with ctl->threads
+void transcode_preset_controller_init(transcode_preset_controller_t *ctl);
+// preset is the one the encoder was opened with, the controller is enabled only for libx264
+void transcode_preset_controller_start(transcode_preset_controller_t *ctl,const char* codecName,const char* preset);
+
+// called before every frame is sent to the encoder, busyTime is the total time spent in the encoder calls so far
+void transcode_preset_controller_on_frame(transcode_preset_controller_t *ctl,int64_t pts,AVRational timeBase,int64_t busyTime);
+
+bool transcode_preset_controller_has_pending(transcode_preset_controller_t *ctl);
+const char* transcode_preset_controller_get_next_preset(transcode_preset_controller_t *ctl);
+// returns the number of B frames that keeps the dts delay of the current encoder (-1 for the preset default)
+int transcode_preset_controller_get_next_max_b_frames(transcode_preset_controller_t *ctl,int hasBFrames);
+// the pending change was applied (or failed, which disables the controller), busyTime as in on_frame
+void transcode_preset_controller_set_applied(transcode_preset_controller_t *ctl,bool applied,int64_t busyTime);
+
+void transcode_preset_controller_get_diagnostics(transcode_preset_controller_t *ctl,json_writer_ctx_t js);
+
+#endif /* transcode_preset_controller_h */
@@ -26,6 +26,7 @@ int transcode_session_init(transcode_session_t *ctx,char* channelId,char* trackI
     strcpy(ctx->trackId,trackId);
     sprintf(ctx->name,"%s_%s",channelId,trackId);
     ctx->cc_a53 = NULL;
+    latency_histogram_init(&ctx->decodeLatency);
 
     transcode_dropper_init(&ctx->dropper);
 
@@ -38,13 +39,24 @@ int transcode_session_init(transcode_session_t *ctx,char* channelId,char* trackI
     json_get_int64(GetConfig(),"frameDropper.queueDuration",10,&ctx->queueDuration);
     AVRational seconds={1,1};
     ctx->queueDuration=av_rescale_q(ctx->queueDuration,seconds,standard_timebase);
-
-    packet_queue_init(&ctx->packetQueue);
+    ctx->packetQueue.slots=NULL;
+    ctx->packetQueue.workerPool=ctx->workerPool;
+
+    json_get_int(GetConfig(),"encoder.queueSize",8,&ctx->encoderQueueSize);
+    // a decoded frame is referenced by the encoder queues of the unfiltered outputs, and by the filters input
+    frame_pool_init(&ctx->framePool,ctx->encoderQueueSize+1);
+    json_get_bool(GetConfig(),"engine.scalingCascade",false,&ctx->scalingCascade);
+    for (int i=0;i<MAX_OUTPUTS;i++) {
+        ctx->encoderThread[i].frameQueue.queue=NULL;
+    }
 
     json_get_bool(GetConfig(),"frameDropper.enabled",false,&ctx->dropper.enabled);
-    if (!ctx->dropper.enabled) {
+    if (!ctx->dropper.enabled && !ctx->asyncInput) {
         ctx->packetQueue.queueSize=0;
     }
+    if (ctx->packetQueue.queueSize>0) {
+        _S(packet_queue_init(&ctx->packetQueue));
+    }
     json_get_int64(GetConfig(),"frameDropper.nonKeyFrameDropperThreshold",10,&ctx->dropper.nonKeyFrameDropperThreshold);
     json_get_int64(GetConfig(),"frameDropper.decodedFrameDropperThreshold",10,&ctx->dropper.decodedFrameDropperThreshold);
     ctx->dropper.nonKeyFrameDropperThreshold=av_rescale_q(ctx->dropper.nonKeyFrameDropperThreshold,seconds,standard_timebase);
@@ -85,6 +97,10 @@ int transcode_session_async_set_mediaInfo(transcode_session_t *ctx,transcode_med
         return transcode_session_set_media_info(ctx,mediaInfo);
     }
     LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_DEBUG,"[%s] enqueue media info",ctx->name);
+    if (ctx->workerPool!=NULL) {
+        worker_pool_lane_set_priority(&ctx->packetQueue.lane,mediaInfo->codecParams->codec_type==AVMEDIA_TYPE_AUDIO ?
+            WORKER_POOL_PRIORITY_HIGH : WORKER_POOL_PRIORITY_NORMAL);
+    }
     packet_queue_write_mediaInfo(&ctx->packetQueue, mediaInfo);
     return 0;
 }
@@ -101,6 +117,11 @@ int transcode_session_async_send_packet(transcode_session_t *ctx, struct AVPacke
     return packet_queue_write_packet(&ctx->packetQueue, packet);
 }
 
+bool transcode_session_async_queue_full(transcode_session_t *ctx)
+{
+    return packet_queue_is_full(&ctx->packetQueue);
+}
+
 void transcode_session_get_ack_frame_id(transcode_session_t *ctx,kmp_frame_position_t *pos)
 {
     if(ctx->ack_handler){
@@ -136,7 +157,7 @@ int transcode_session_set_media_info(transcode_session_t *ctx,transcode_mediaInf
     ctx->currentMediaInfo=newMediaInfo;
 
     transcode_codec_t *pDecoderContext=&ctx->decoder[0];
-    transcode_codec_init_decoder(pDecoderContext,newMediaInfo);
+    transcode_codec_init_decoder(pDecoderContext,newMediaInfo,&ctx->framePool);
     sprintf(pDecoderContext->name,"Decoder for input %s",ctx->name);
     ctx->decoders++;
     if (init_outputs_from_config(ctx)<0) {
@@ -165,8 +186,70 @@ int transcode_session_set_media_info(transcode_session_t *ctx,transcode_mediaInf
     return 0;
 }
 
-void get_filter_config(transcode_session_t *pSession,char *filterConfig,  transcode_codec_t *pDecoderContext, transcode_session_output_t *pOutput)
+/* with a scaling cascade, a video output is scaled from the smallest larger
+   output that has the same frame step, instead of from the decoded frame */
+static
+int findCascadeSourceFilter(transcode_session_t *pSession, transcode_codec_t *pDecoderContext, transcode_session_output_t *pOutput)
+{
+    int width=pOutput->videoParams.width;
+    int height=pOutput->videoParams.height;
+
+    // the source is picked by height, and hw scaling is cheap enough as is
+    if (!pSession->scalingCascade ||
+        pOutput->codec_type!=AVMEDIA_TYPE_VIDEO ||
+        pDecoderContext->nvidiaAccelerated ||
+        height<=0) {
+        return -1;
+    }
+
+    int64_t decoderWidth=pDecoderContext->ctx->width;
+    int64_t decoderHeight=pDecoderContext->ctx->height;
+    int sourceFilterId=-1;
+    int sourceHeight=INT_MAX;
+
+    for (int outputId=0;outputId<pSession->outputs;outputId++) {
+        transcode_session_output_t *pSource=&pSession->output[outputId];
+        if (pSource==pOutput ||
+            pSource->codec_type!=AVMEDIA_TYPE_VIDEO ||
+            pSource->filterId<0 ||
+            pSource->filterId>=pSession->filters ||
+            pSource->videoParams.skipFrame!=pOutput->videoParams.skipFrame) {
+            continue;
+        }
+
+        transcode_filter_t *pFilter=&pSession->filter[pSource->filterId];
+        if (!pFilter->config) {
+            continue;
+        }
+
+        int64_t w=av_buffersink_get_w(pFilter->sink_ctx);
+        int64_t h=av_buffersink_get_h(pFilter->sink_ctx);
+
+        // the source must be larger, and keep the decoded aspect ratio (up to even rounding)
+        if (h<=height || (width>0 && w<width) ||
+            llabs(w*decoderHeight-h*decoderWidth)>2*decoderHeight) {
+            continue;
+        }
+
+        if (h<sourceHeight) {
+            sourceFilterId=pSource->filterId;
+            sourceHeight=h;
+        }
+    }
+    return sourceFilterId;
+}
+
+void get_filter_config(transcode_session_t *pSession,char *filterConfig,  transcode_codec_t *pDecoderContext, transcode_session_output_t *pOutput, int sourceFilterId)
 {
+    if (pOutput->codec_type==AVMEDIA_TYPE_VIDEO && sourceFilterId!=-1)
+    {
+        // the source filter already applied the frame step
+        sprintf(filterConfig,"scale=w=%d:h=%d:sws_flags=%s",
+                pOutput->videoParams.width,
+                pOutput->videoParams.height,
+                "lanczos");
+        return;
+    }
     if (pOutput->codec_type==AVMEDIA_TYPE_VIDEO)
     {
         int n=sprintf(filterConfig,"framestep=step=%d,",pOutput->videoParams.skipFrame);
@@ -191,27 +274,34 @@ void get_filter_config(transcode_session_t *pSession,char *filterConfig,  transc
     }
     if (pOutput->codec_type==AVMEDIA_TYPE_AUDIO)
     {
-        //once initialized stick to encoder output format
-        transcode_codec_t *codec = pOutput->actualAudioParams.samplingRate > 0 ?
-            &pSession->encoder[pOutput->encoderId] : pDecoderContext;
+        //once initialized stick to encoder output format, as copied to the output
+        //(the encoder context may be replaced by the encoder thread)
+        int sampleRate=pDecoderContext->ctx->sample_rate;
+        int channels=pDecoderContext->ctx->channels;
+        uint64_t channelLayout=pDecoderContext->ctx->channel_layout;
+        if (pOutput->actualAudioParams.samplingRate > 0) {
+            sampleRate=pOutput->actualAudioParams.samplingRate;
+            channels=pOutput->actualAudioParams.channels;
+            channelLayout=pOutput->actualAudioParams.channelLayout;
+        }
         char buf[64];
-        av_get_channel_layout_string(buf,sizeof(buf),
-            codec->ctx->channels,codec->ctx->channel_layout);
+        av_get_channel_layout_string(buf,sizeof(buf),channels,channelLayout);
         sprintf(filterConfig,"aresample=async=0:out_sample_rate=%d:out_channel_layout=%s",
-            codec->ctx->sample_rate,buf);
+            sampleRate,buf);
     }
 }
 
 transcode_filter_t* GetFilter(transcode_session_t* pContext,transcode_session_output_t* pOutput, transcode_codec_t *pDecoderContext)
 {
     char filterConfig[MAX_URL_LENGTH]={0};
-    get_filter_config(pContext,filterConfig, pDecoderContext, pOutput);
+    int sourceFilterId=findCascadeSourceFilter(pContext, pDecoderContext, pOutput);
+    get_filter_config(pContext,filterConfig, pDecoderContext, pOutput, sourceFilterId);
 
     transcode_filter_t* pFilter=NULL;
     pOutput->filterId=-1;
     for (int selectedFilter=0; selectedFilter<pContext->filters;selectedFilter++) {
         pFilter=&pContext->filter[selectedFilter];
-        if (pFilter->config && strcmp(pFilter->config,filterConfig)==0) {
+        if (pFilter->config && strcmp(pFilter->config,filterConfig)==0 && pFilter->sourceFilterId==sourceFilterId) {
             pOutput->filterId=selectedFilter;
             LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"Output %s - Resuing existing filter %s",pOutput->track_id,filterConfig);
             break;
@@ -219,14 +309,17 @@ transcode_filter_t* GetFilter(transcode_session_t* pContext,transcode_session_ou
     }
     if ( pOutput->filterId==-1) {
         pFilter=&pContext->filter[pContext->filters];
-        int ret=transcode_filter_init(pFilter,pDecoderContext->ctx,filterConfig);
+        int ret=sourceFilterId==-1 ?
+            transcode_filter_init(pFilter,pDecoderContext->ctx,filterConfig) :
+            transcode_filter_init_from_filter(pFilter,&pContext->filter[sourceFilterId],filterConfig);
         if (ret<0) {
             LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_ERROR,"Output %s - Cannot create filter %s",pOutput->track_id,filterConfig);
             return NULL;
         }
+        pFilter->sourceFilterId=sourceFilterId;
 
         pOutput->filterId=pContext->filters++;
-        LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"Output %s - Created new  filter %s",pOutput->track_id,filterConfig);
+        LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"Output %s - Created new  filter %s (source filter %d)",pOutput->track_id,filterConfig,sourceFilterId);
     }
     return pFilter;
 }
@@ -277,12 +370,34 @@ int config_encoder(transcode_session_output_t *pOutput,  transcode_codec_t *pDec
         ret=transcode_codec_init_audio_encoder(pEncoderContext, pFilter,pOutput);
         pOutput->actualAudioParams.samplingRate=pEncoderContext->ctx->sample_rate;
         pOutput->actualAudioParams.channels=pEncoderContext->ctx->channels;
+        pOutput->actualAudioParams.channelLayout=pEncoderContext->ctx->channel_layout;
     }
+    pOutput->encoderFrameSize=pEncoderContext->ctx->frame_size;
 
     sprintf(pEncoderContext->name,"Encoder for output %s",pOutput->track_id);
     return ret;
 }
 
+static
+int transcode_session_start_encoder_thread(transcode_session_t* pContext,int outputId);
+
+static
+int transcode_session_output_send_encoder_media_info(transcode_session_output_t* pOutput,transcode_codec_t *pEncoderContext,int bits_per_coded_sample)
+{
+    transcode_mediaInfo_t extra;
+    extra.frameRate=pEncoderContext->ctx->framerate;
+    extra.timeScale=pEncoderContext->ctx->time_base;
+    extra.codecParams=avcodec_parameters_alloc();
+    extra.closed_captions = pOutput->closed_captions;
+    avcodec_parameters_from_context(extra.codecParams,pEncoderContext->ctx);
+    if(!extra.codecParams->bits_per_coded_sample) {
+        extra.codecParams->bits_per_coded_sample = bits_per_coded_sample;
+    }
+    int ret=transcode_session_output_set_media_info(pOutput,&extra);
+    avcodec_parameters_free(&extra.codecParams);
+    return ret;
+}
+
 static
 int transcode_session_init_output(transcode_session_t* pContext,
     transcode_codec_t *pDecoderContext,
@@ -295,21 +410,21 @@ int transcode_session_init_output(transcode_session_t* pContext,
 
     pOutput->encoderId=pContext->encoders++;
     LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"Output %s - Added encoder %d bitrate=%d",pOutput->track_id,pOutput->encoderId,pOutput->bitrate);
-    transcode_mediaInfo_t extra;
-    extra.frameRate=pEncoderContext->ctx->framerate;
-    extra.timeScale=pEncoderContext->ctx->time_base;
-    extra.codecParams=avcodec_parameters_alloc();
     //TODO: how do we know encoder supports captions?
-    extra.closed_captions = pContext->currentMediaInfo->closed_captions;
-    avcodec_parameters_from_context(extra.codecParams,pEncoderContext->ctx);
-    if(!extra.codecParams->bits_per_coded_sample) {
-        extra.codecParams->bits_per_coded_sample = pDecoderContext->ctx->bits_per_coded_sample;
-    }
-    _S(transcode_session_output_set_media_info(pOutput,&extra));
+    pOutput->closed_captions = pContext->currentMediaInfo->closed_captions;
+    _S(transcode_session_output_send_encoder_media_info(pOutput,pEncoderContext,pDecoderContext->ctx->bits_per_coded_sample));
     if(pEncoderContext->codec->type == AVMEDIA_TYPE_VIDEO) {
          _S(atsc_a53_add_stream(pContext->cc_a53,pEncoderContext->ctx,pOutput->encoderId));
+         uint8_t *preset=NULL;
+         if (av_opt_get(pEncoderContext->ctx->priv_data,"preset",0,&preset)>=0 && preset!=NULL) {
+             transcode_preset_controller_start(&pOutput->presetController,pEncoderContext->codec->name,(const char*)preset);
+             av_free(preset);
+         }
     }
 
+    if (pContext->encoderQueueSize>0) {
+        _S(transcode_session_start_encoder_thread(pContext,pOutput-pContext->output));
+    }
 
     return 0;
 }
@@ -334,6 +449,48 @@ int transcode_session_add_output(transcode_session_t* pContext, const json_value
 
 
 /* processing */
+int encodeFrame(transcode_session_t *pContext,int encoderId,int outputId,AVFrame *pFrame);
+
+// applies the pending change of the preset controller: the new encoder is opened first, so that
+// a failure leaves the current one running, then the current one is drained and replaced
+static
+int transcode_session_reopen_encoder(transcode_session_t *pContext,int encoderId,int outputId)
+{
+    transcode_codec_t* pEncoder=&pContext->encoder[encoderId];
+    transcode_session_output_t* pOutput=&pContext->output[outputId];
+    transcode_preset_controller_t* ctl=&pOutput->presetController;
+    AVCodecContext* newCtx=NULL;
+    int hasBFrames=pEncoder->ctx->has_b_frames;
+
+    if (transcode_codec_clone_video_encoder(pEncoder,
+                                            pOutput,
+                                            transcode_preset_controller_get_next_preset(ctl),
+                                            ctl->nextThreads,
+                                            transcode_preset_controller_get_next_max_b_frames(ctl,hasBFrames),
+                                            &newCtx)<0) {
+        transcode_preset_controller_set_applied(ctl,false,pEncoder->busyTime);
+        return 0;
+    }
+    if (newCtx->has_b_frames!=hasBFrames) {
+        LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_WARNING,"[%s] the new encoder delays the dts by %d frames instead of %d",
+               pOutput->track_id,newCtx->has_b_frames,hasBFrames);
+    }
+
+    int ret=encodeFrame(pContext,encoderId,outputId,NULL);
+    avcodec_free_context(&pEncoder->ctx);
+    pEncoder->ctx=newCtx;
+    // the drain isn't counted in the load
+    transcode_preset_controller_set_applied(ctl,true,pEncoder->busyTime);
+    _S(ret);
+
+    _S(atsc_a53_update_stream(pContext->cc_a53,pEncoder->ctx,pOutput->encoderId));
+    // the extradata (SPS/PPS) of the new encoder
+    _S(transcode_session_output_send_encoder_media_info(pOutput,pEncoder,pContext->decoder[0].ctx->bits_per_coded_sample));
+    LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"[%s] encoder reopened with preset %s",
+           pOutput->track_id,transcode_preset_controller_get_next_preset(ctl));
+    return 0;
+}
+
 int encodeFrame(transcode_session_t *pContext,int encoderId,int outputId,AVFrame *pFrame) {
 
     transcode_codec_t* pEncoder=&pContext->encoder[encoderId];
@@ -349,14 +506,21 @@ int encodeFrame(transcode_session_t *pContext,int encoderId,int outputId,AVFrame
     int ret=0;
 
     if (pFrame) {
+        latency_tracer_frame_encoding(&pOutput->latency,pFrame,getTime64());
         //key frame aligment
         if (pFrame->key_frame==1 || (pFrame->flags & AV_PKT_FLAG_KEY)==AV_PKT_FLAG_KEY)
             pFrame->pict_type=AV_PICTURE_TYPE_I;
         else
             pFrame->pict_type=AV_PICTURE_TYPE_NONE;
 
+        transcode_preset_controller_on_frame(&pOutput->presetController,pFrame->pts,pEncoder->ctx->time_base,pEncoder->busyTime);
+        if (pFrame->pict_type==AV_PICTURE_TYPE_I && transcode_preset_controller_has_pending(&pOutput->presetController)) {
+            _S(transcode_session_reopen_encoder(pContext,encoderId,outputId));
+        }
     }
 
+    bool checkLatency=pFrame!=NULL && pOutput->videoParams.lowLatency;
+    int64_t sendTime=getTime64(),firstPacketTime=0;
     ret=transcode_encoder_send_frame(pEncoder,pFrame);
 encoder_error:
     if (ret < 0)
@@ -375,6 +539,10 @@ encoder_error:
             if (ret == AVERROR_EOF) {
                 LOGGER0(CATEGORY_TRANSCODING_SESSION, AV_LOG_INFO,"encoding completed!")
             }
+            if (checkLatency) {
+                transcode_session_output_check_encode_latency(pOutput,pEncoder->ctx->framerate,firstPacketTime>0,
+                                                              firstPacketTime>0 ? firstPacketTime-sendTime : 0);
+            }
             av_packet_free(&pOutPacket);
             return 0;
         }
@@ -387,6 +555,13 @@ encoder_error:
                pOutput->track_id,
                getPacketDesc(pOutPacket),
                encoderId);
+        int64_t encodedTime=getTime64();
+        if (firstPacketTime==0) {
+            firstPacketTime=encodedTime;
+        }
+        latency_trace_t trace;
+        bool traced=latency_tracer_packet_encoded(&pOutput->latency,pOutPacket->pts,encodedTime,&trace);
+
         output_frame_id = pContext->transcoded_frame_first_id+pOutput->stats.totalFrames;
         add_packet_frame_id_and_pts(pOutPacket,output_frame_id,pOutPacket->pts);
 
@@ -399,12 +574,53 @@ encoder_error:
              atsc_a53_encoded(pContext->cc_a53,pOutput->encoderId,&pOutPacket);
         }
         ret = transcode_session_output_send_output_packet(pOutput,pOutPacket);
+        if (traced) {
+            latency_tracer_packet_sent(&pOutput->latency,&trace,encodedTime,getTime64());
+        }
 
        av_packet_free(&pOutPacket);
     }
     return ret;
 }
 
+static
+int encoderThreadOnFrame(transcode_session_encoder_thread_t *pThread,AVFrame *pFrame)
+{
+    transcode_session_t *pContext=(transcode_session_t *)pThread->session;
+    transcode_session_output_t *pOutput=&pContext->output[pThread->outputId];
+    return encodeFrame(pContext,pOutput->encoderId,pThread->outputId,pFrame);
+}
+
+static
+int transcode_session_start_encoder_thread(transcode_session_t* pContext,int outputId)
+{
+    transcode_session_encoder_thread_t *pThread=&pContext->encoderThread[outputId];
+    pThread->session=pContext;
+    pThread->outputId=outputId;
+    pThread->frameQueue.queueSize=pContext->encoderQueueSize;
+    pThread->frameQueue.callbackContext=pThread;
+    pThread->frameQueue.onFrame=(frame_queue_frameCB*)encoderThreadOnFrame;
+    pThread->frameQueue.workerPool=pContext->workerPool;
+    pThread->frameQueue.priority=pContext->output[outputId].codec_type==AVMEDIA_TYPE_AUDIO ?
+        WORKER_POOL_PRIORITY_HIGH : WORKER_POOL_PRIORITY_NORMAL;
+    _S(frame_queue_init(&pThread->frameQueue));
+    LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"Output %s - Started encoder thread, queue size %d",
+        pContext->output[outputId].track_id,pThread->frameQueue.queueSize);
+    return 0;
+}
+
+/* the frame is encoded on the output encoder thread, when there is one,
+   otherwise it's encoded synchronously */
+static
+int queueFrameToEncoder(transcode_session_t *pContext,int outputId,AVFrame *pFrame)
+{
+    FrameQueueContext_t *pQueue=&pContext->encoderThread[outputId].frameQueue;
+    if (pQueue->queue==NULL) {
+        return encodeFrame(pContext,pContext->output[outputId].encoderId,outputId,pFrame);
+    }
+    return frame_queue_write_frame(pQueue,pFrame);
+}
+
 static
 bool mediaTypesMatch(transcode_filter_t *pFilter,AVCodecContext *ctx)
 {
@@ -479,7 +695,7 @@ int getFilterForStream(transcode_session_t *pContext,int filterId,
             *ppFilter = GetFilter(pContext,pOutput,pDecoderContext);
             if(*ppFilter)
             {
-                av_buffersink_set_frame_size((*ppFilter)->sink_ctx, pContext->encoder[pOutput->encoderId].ctx->frame_size);
+                av_buffersink_set_frame_size((*ppFilter)->sink_ctx, pOutput->encoderFrameSize);
             }
             pContext->filters =  temp;
             LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"reinited filter %d",filterId);
@@ -536,6 +752,10 @@ int sendFrameToFilter(transcode_session_t *pContext,int filterId, AVCodecContext
         }
 
 
+        if (latency_trace_get_frame_time(pOutFrame,LATENCY_TRACE_RECEIVE_TIME)>0) {
+            latency_trace_set_frame_time(pOutFrame,LATENCY_TRACE_FILTER_TIME,getTime64());
+        }
+
         LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_DEBUG,"[%s] recieved from filterId %d (%s): %s",
                pContext->name,
                filterId,
@@ -545,6 +765,16 @@ int sendFrameToFilter(transcode_session_t *pContext,int filterId, AVCodecContext
              ackFilter(&pContext->ack_handler->acker,pOutFrame);
         }
 
+        // feed the cascaded filters before the frame gets the cc side data of this filter outputs
+        for (int childId=filterId+1;childId<pContext->filters;childId++) {
+            if (pContext->filter[childId].sourceFilterId==filterId) {
+                ret=sendFrameToFilter(pContext,childId,pDecoderContext,pOutFrame);
+                if (ret<0) {
+                    av_frame_free(&pOutFrame);
+                    return ret;
+                }
+            }
+        }
 
 
         for (int outputId=0;outputId<pContext->outputs;outputId++) {
@@ -554,7 +784,7 @@ int sendFrameToFilter(transcode_session_t *pContext,int filterId, AVCodecContext
                if(pDecoderContext->codec_type == AVMEDIA_TYPE_VIDEO) {
                   atsc_a53_filtered(pContext->cc_a53,pOutput->encoderId,pOutFrame);
                }
-                _S(encodeFrame(pContext,pOutput->encoderId,outputId,pOutFrame));
+                _S(queueFrameToEncoder(pContext,outputId,pOutFrame));
             }
         }
         av_frame_free(&pOutFrame);
@@ -569,15 +799,32 @@ static void shift_audio_samples(AVFrame *frame,int shift_by) {
   frame->nb_samples -= shift_by;
 }
 
+static
+int transcode_session_init_outputs(transcode_session_t *ctx)
+{
+    while (true) {
+        // with a scaling cascade, larger outputs are initialized first so that they can feed the smaller ones
+        transcode_session_output_t *pNext=NULL;
+        for (int outputId=0;outputId<ctx->outputs;outputId++) {
+            transcode_session_output_t *pOutput=&ctx->output[outputId];
+            if (pOutput->passthrough || pOutput->encoderId!=-1) {
+                continue;
+            }
+            if (pNext==NULL || (ctx->scalingCascade && pOutput->videoParams.height>pNext->videoParams.height)) {
+                pNext=pOutput;
+            }
+        }
+        if (pNext==NULL) {
+            return 0;
+        }
+        _S(transcode_session_init_output(ctx,&ctx->decoder[0],pNext));
+    }
+}
+
 int OnDecodedFrame(transcode_session_t *ctx,AVCodecContext* decoderCtx, AVFrame *frame)
 {
    uint64_t pts;
-   for (int outputId=0;outputId<ctx->outputs;outputId++) {
-         transcode_session_output_t *pOutput=&ctx->output[outputId];
-         if (!pOutput->passthrough && pOutput->encoderId==-1) {
-              _S(transcode_session_init_output(ctx,&ctx->decoder[0],pOutput));
-         }
-    }
+   _S(transcode_session_init_outputs(ctx));
 
     if (frame==NULL) {
 
@@ -585,7 +832,7 @@ int OnDecodedFrame(transcode_session_t *ctx,AVCodecContext* decoderCtx, AVFrame
             transcode_session_output_t *pOutput=&ctx->output[outputId];
             if (pOutput->encoderId!=-1){
                 LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_DEBUG,"[%s] flushing encoderId %d for output %s",ctx->name,pOutput->encoderId,pOutput->track_id);
-                _S(encodeFrame(ctx,pOutput->encoderId,outputId,NULL));
+                _S(queueFrameToEncoder(ctx,outputId,NULL));
             }
         }
         return 0;
@@ -620,6 +867,14 @@ int OnDecodedFrame(transcode_session_t *ctx,AVCodecContext* decoderCtx, AVFrame
 
     LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_DEBUG,"[%s] decoded: %s",ctx->name,getFrameDesc(frame));
 
+    // the decoder copies the packet metadata, incl. the receive time, to the frame
+    int64_t receiveTime=latency_trace_get_frame_time(frame,LATENCY_TRACE_RECEIVE_TIME);
+    if (receiveTime>0) {
+        int64_t now=getTime64();
+        latency_histogram_add(&ctx->decodeLatency,now-receiveTime);
+        latency_trace_set_frame_time(frame,LATENCY_TRACE_DECODE_TIME,now);
+    }
+
     if(decoderCtx->codec_type == AVMEDIA_TYPE_VIDEO) {
         atsc_a53_decoded(ctx->cc_a53,frame);
     }
@@ -637,7 +892,9 @@ int OnDecodedFrame(transcode_session_t *ctx,AVCodecContext* decoderCtx, AVFrame
 
     for (int filterId=0;filterId<ctx->filters;filterId++) {
 
-        _S(sendFrameToFilter(ctx,filterId,decoderCtx,frame));
+        if (ctx->filter[filterId].sourceFilterId==-1) {
+            _S(sendFrameToFilter(ctx,filterId,decoderCtx,frame));
+        }
 
     }
 
@@ -645,7 +902,7 @@ int OnDecodedFrame(transcode_session_t *ctx,AVCodecContext* decoderCtx, AVFrame
         transcode_session_output_t *pOutput=&ctx->output[outputId];
         if (pOutput->filterId==-1 && pOutput->encoderId!=-1){
             LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_DEBUG,"[%s] sending frame directly from decoder to encoderId %d for output %s",ctx->name,pOutput->encoderId,pOutput->track_id);
-            _S(encodeFrame(ctx,pOutput->encoderId,outputId,frame));
+            _S(queueFrameToEncoder(ctx,outputId,frame));
         }
     }
 
@@ -709,11 +966,21 @@ int transcode_session_send_packet(transcode_session_t *ctx ,struct AVPacket* pac
         samples_stats_add(&ctx->processedStats,packet->dts,packet->pos,packet->size);
     }
     bool shouldDecode=false;
+    int64_t receiveTime=-1;
     for (int i=0;i<ctx->outputs;i++) {
         transcode_session_output_t *pOutput=&ctx->output[i];
         if (pOutput->passthrough)
         {
+            int64_t sendTime=getTime64();
             _S(transcode_session_output_send_output_packet(pOutput,packet));
+            if (packet!=NULL && receiveTime<0) {
+                get_packet_receive_time(packet,&receiveTime);
+            }
+            if (receiveTime>0) {
+                int64_t now=getTime64();
+                latency_histogram_add(&pOutput->latency.stages[LATENCY_STAGE_SEND],now-sendTime);
+                latency_histogram_add(&pOutput->latency.stages[LATENCY_STAGE_TOTAL],now-receiveTime);
+            }
         }
         else
         {
@@ -748,6 +1015,11 @@ int transcode_session_close(transcode_session_t *session,int exitErrorCode) {
         LOGGER0(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO, "Flushing completed");
     }
 
+    // the encoder threads drain their queues (incl. the flush) before exiting
+    for (int i=0;i<session->outputs;i++) {
+        frame_queue_destroy(&session->encoderThread[i].frameQueue);
+    }
+
     for (int i=0;i<session->decoders;i++) {
         LOGGER(CATEGORY_TRANSCODING_SESSION,AV_LOG_INFO,"Closing decoder %d",i);
         transcode_codec_close(&session->decoder[i]);
@@ -779,6 +1051,10 @@ int transcode_session_close(transcode_session_t *session,int exitErrorCode) {
 
     atsc_a53_handler_free(&session->cc_a53);
 
+    frame_pool_close(&session->framePool);
+
+    clock_estimator_destroy(&session->clock_estimator);
+
     return 0;
 }
 
@@ -814,6 +1090,48 @@ void transcode_session_get_pipeline_diagnostics(transcode_session_t *ctx,json_wr
       }
 }
 
+void transcode_session_get_input_metrics(transcode_session_t *ctx,const char* name,json_writer_ctx_t js)
+{
+    char channelId[2*KMP_MAX_CHANNEL_ID],trackId[2*KMP_MAX_TRACK_ID];
+    char labels[MAX_URL_LENGTH];
+    if (ctx->channelId[0]==0) {
+        return;
+    }
+    latency_write_label_value(channelId,sizeof(channelId),ctx->channelId);
+    latency_write_label_value(trackId,sizeof(trackId),ctx->trackId);
+    if (ctx->packetQueue.slots!=NULL) {
+        snprintf(labels,sizeof(labels),"channel_id=\"%s\",track_id=\"%s\",stage=\"queue\"",channelId,trackId);
+        latency_histogram_write_prometheus(&ctx->packetQueue.stats.waitTime,name,labels,js);
+    }
+    snprintf(labels,sizeof(labels),"channel_id=\"%s\",track_id=\"%s\",stage=\"decode\"",channelId,trackId);
+    latency_histogram_write_prometheus(&ctx->decodeLatency,name,labels,js);
+}
+
+void transcode_session_get_output_metrics(transcode_session_t *ctx,const char* name,json_writer_ctx_t js)
+{
+    char channelId[2*KMP_MAX_CHANNEL_ID],trackId[2*KMP_MAX_TRACK_ID],outputTrackId[2*KMP_MAX_TRACK_ID];
+    char labels[MAX_URL_LENGTH];
+    if (ctx->channelId[0]==0) {
+        return;
+    }
+    latency_write_label_value(channelId,sizeof(channelId),ctx->channelId);
+    latency_write_label_value(trackId,sizeof(trackId),ctx->trackId);
+    for (int i=0;i<ctx->outputs;i++)
+    {
+        transcode_session_output_t* output=&ctx->output[i];
+        latency_write_label_value(outputTrackId,sizeof(outputTrackId),output->track_id);
+        for (int stage=0;stage<LATENCY_STAGES;stage++) {
+            // a passthrough output only has the send and total stages, an unfiltered output has no filter stage
+            if (atomic_load_explicit(&output->latency.stages[stage].count,memory_order_relaxed)==0) {
+                continue;
+            }
+            snprintf(labels,sizeof(labels),"channel_id=\"%s\",track_id=\"%s\",output=\"%s\",stage=\"%s\"",
+                     channelId,trackId,outputTrackId,latency_tracer_stage_name(stage));
+            latency_histogram_write_prometheus(&output->latency.stages[stage],name,labels,js);
+        }
+    }
+}
+
 void transcode_session_get_diagnostics(transcode_session_t *ctx,json_writer_ctx_t js)
 {
     int64_t now=av_rescale_q( getClock64(), clockScale, standard_timebase);
@@ -862,7 +1180,18 @@ void transcode_session_get_diagnostics(transcode_session_t *ctx,json_writer_ctx_
     JSON_SERIALIZE_INT64("minDts",lastDts);
     JSON_SERIALIZE_INT64("processTime",(ctx->lastInputDts-lastDts)/90);
     JSON_SERIALIZE_INT64("latency",(now-lastTimeStamp)/90);
-    JSON_SERIALIZE_INT("currentIncomingQueueLength",ctx->packetQueue.queue ? av_thread_message_queue_nb_elems(ctx->packetQueue.queue) : -1);
+    JSON_SERIALIZE_INT("currentIncomingQueueLength",packet_queue_get_length(&ctx->packetQueue));
+    if (ctx->packetQueue.slots!=NULL) {
+        JSON_SERIALIZE_OBJECT_BEGIN("incomingQueue")
+        packet_queue_get_diagnostics(&ctx->packetQueue,js);
+        JSON_SERIALIZE_OBJECT_END()
+    }
+
+    if (ctx->framePool.format!=AV_PIX_FMT_NONE) {
+        JSON_SERIALIZE_OBJECT_BEGIN("framePool")
+        frame_pool_get_diagnostics(&ctx->framePool,js);
+        JSON_SERIALIZE_OBJECT_END()
+    }
 
     transcode_session_get_pipeline_diagnostics(ctx,js);
 }
@@ -15,6 +15,7 @@
 #include "transcode_filter.h"
 #include "../utils/time_estimator.h"
 #include "../utils/packetQueue.h"
+#include "../utils/frameQueue.h"
 #include "./transcode_dropper.h"
 #include "../utils/policy_provider.h"
 #include "../utils/cc_atsc_a53.h"
@@ -25,6 +26,12 @@
 
 typedef int transcode_session_processedFrameCB(void *pContext,bool completed);
 
+typedef struct  {
+    void* session;
+    int outputId;
+    FrameQueueContext_t frameQueue;
+} transcode_session_encoder_thread_t;
+
 typedef struct  {
 
     char name[KMP_MAX_CHANNEL_ID+KMP_MAX_TRACK_ID+2];
@@ -42,9 +49,13 @@ typedef struct  {
     int encoders;
     transcode_codec_t encoder[MAX_OUTPUTS];
 
+    int encoderQueueSize;
+    transcode_session_encoder_thread_t encoderThread[MAX_OUTPUTS];
+
 
     int filters;
     transcode_filter_t filter[10];
+    bool scalingCascade;
 
     clock_estimator_t clock_estimator;
 
@@ -52,6 +63,10 @@ typedef struct  {
 
     PacketQueueContext_t packetQueue;
     samples_stats_t processedStats;
+    latency_histogram_t decodeLatency;  // KMP receive -> decoded
+    frame_pool_t framePool;             // decoded video frames
+    worker_pool_t* workerPool;
+    bool asyncInput;    // queue the input even when the frame dropper is disabled
 
     int64_t queueDuration;
     void* onProcessedFrameContext;
@@ -77,10 +92,15 @@ int transcode_session_send_packet(transcode_session_t *pContext, struct AVPacket
 
 int transcode_session_async_set_mediaInfo(transcode_session_t *pContext,transcode_mediaInfo_t* mediaInfo);
 int transcode_session_async_send_packet(transcode_session_t *pContext, struct AVPacket* packet);
+// true when the next async call would block
+bool transcode_session_async_queue_full(transcode_session_t *pContext);
 
 int transcode_session_close(transcode_session_t *ctx,int exitErrorCode);
 int transcode_session_add_output(transcode_session_t* pContext,const json_value_t* json);
 void transcode_session_get_diagnostics(transcode_session_t *ctx,json_writer_ctx_t js);
+// prometheus histograms, labeled by the channel and track ids (and the output track id)
+void transcode_session_get_input_metrics(transcode_session_t *ctx,const char* name,json_writer_ctx_t js);
+void transcode_session_get_output_metrics(transcode_session_t *ctx,const char* name,json_writer_ctx_t js);
 void transcode_session_get_ack_frame_id(transcode_session_t *ctx,kmp_frame_position_t *pos);
 
 #endif /* TranscodePipeline_hpp */
@@ -17,9 +17,12 @@ int transcode_session_output_init(transcode_session_output_t* pOutput)  {
     pOutput->passthrough=true;
     pOutput->filterId=-1;
     pOutput->encoderId=-1;
+    pOutput->encoderFrameSize=0;
     pOutput->oc=NULL;
     pOutput->videoParams.width=pOutput->videoParams.height=-1;
     pOutput->videoParams.skipFrame=1;
+    pOutput->videoParams.lowLatency=false;
+    pOutput->videoParams.intraRefresh=false;
     pOutput->videoParams.frameRate=-1;
     memset(&pOutput->actualVideoParams, 0, sizeof(pOutput->actualVideoParams));
     memset(&pOutput->actualAudioParams, 0, sizeof(pOutput->actualAudioParams));
@@ -33,6 +36,10 @@ int transcode_session_output_init(transcode_session_output_t* pOutput)  {
     ack_hanler_init(&pOutput->acker);
 
     sample_stats_init(&pOutput->stats,standard_timebase);
+    latency_tracer_init(&pOutput->latency);
+    transcode_preset_controller_init(&pOutput->presetController);
+    pOutput->closed_captions=false;
+    memset(&pOutput->lowLatencyStats, 0, sizeof(pOutput->lowLatencyStats));
     return 0;
 }
 
@@ -43,14 +50,15 @@ int print_output(transcode_session_output_t* pOutput) {
         return 0;
     }
     if (pOutput->codec_type==AVMEDIA_TYPE_VIDEO) {
-        LOGGER(CATEGORY_OUTPUT,AV_LOG_INFO,"(%s) output configuration: mode: codec: %s transcode bitrate: %d Kbit/s  resolution: %dx%d  profile: %s preset: %s",
+        LOGGER(CATEGORY_OUTPUT,AV_LOG_INFO,"(%s) output configuration: mode: codec: %s transcode bitrate: %d Kbit/s  resolution: %dx%d  profile: %s preset: %s low latency: %d",
                pOutput->track_id,
                pOutput->codec,
                pOutput->bitrate / 1000,
                pOutput->videoParams.width,
                pOutput->videoParams.height,
                pOutput->videoParams.profile,
-               pOutput->videoParams.preset
+               pOutput->videoParams.preset,
+               pOutput->videoParams.lowLatency
                )
     }
     if (pOutput->codec_type==AVMEDIA_TYPE_AUDIO) {
@@ -82,6 +90,8 @@ int transcode_session_output_from_json(transcode_session_output_t* pOutput,const
         json_get_string(pVideoParams,"profile","",pOutput->videoParams.profile,sizeof(pOutput->videoParams.profile));
         json_get_string(pVideoParams,"preset","",pOutput->videoParams.preset,sizeof(pOutput->videoParams.preset));
         json_get_int(pVideoParams,"skipFrame",1,&pOutput->videoParams.skipFrame);
+        json_get_bool(pVideoParams,"lowLatency",false,&pOutput->videoParams.lowLatency);
+        json_get_bool(pVideoParams,"intraRefresh",false,&pOutput->videoParams.intraRefresh);
 
     }
     if (JSON_OK==json_get(json,"audioParams",&pAudioParams)) {
@@ -180,6 +190,7 @@ int transcode_session_output_set_media_info(transcode_session_output_t *pOutput,
     if (extra->codecParams->sample_rate>0) {
         pOutput->actualAudioParams.samplingRate=extra->codecParams->sample_rate;
         pOutput->actualAudioParams.channels=extra->codecParams->channels;
+        pOutput->actualAudioParams.channelLayout=extra->codecParams->channel_layout;
         pOutput->codec_type=AVMEDIA_TYPE_AUDIO;
     }
 
@@ -256,6 +267,33 @@ int transcode_session_output_close(transcode_session_output_t* pOutput)
     return 0;
 }
 
+void transcode_session_output_check_encode_latency(transcode_session_output_t *pOutput,AVRational frameRate,bool encoded,int64_t encodeTime)
+{
+    struct LowLatencyStats* stats=&pOutput->lowLatencyStats;
+    int64_t budget=TRANSCODE_LOW_LATENCY_MAX_ENCODE_TIME;
+    if (frameRate.num>0 && frameRate.den>0) {
+        budget=FFMIN(budget,av_rescale(1000000,frameRate.den,frameRate.num));
+    }
+    stats->maxEncodeTime=FFMAX(stats->maxEncodeTime,encodeTime);
+    if (encoded && encodeTime<=budget) {
+        return;
+    }
+    if (!encoded) {
+        stats->heldFrames++;
+    } else {
+        stats->slowFrames++;
+    }
+    int64_t lateFrames=stats->heldFrames+stats->slowFrames;
+    if (lateFrames%100==1) {
+        LOGGER(CATEGORY_OUTPUT,AV_LOG_WARNING,"[%s] low latency output is late (%s), %lld frames held by the encoder, %lld frames encoded in more than %lld us",
+               pOutput->track_id,
+               encoded ? "slow frame" : "held frame",
+               stats->heldFrames,
+               stats->slowFrames,
+               budget);
+    }
+}
+
 void transcode_session_output_get_diagnostics(transcode_session_output_t *pOutput,uint64_t recieveDts,uint64_t startProcessDts,json_writer_ctx_t js)
 {
     char codecData[100]={0};
@@ -273,5 +311,17 @@ void transcode_session_output_get_diagnostics(transcode_session_output_t *pOutpu
     JSON_SERIALIZE_INT64("lastDts",pOutput->stats.lastDts)
     JSON_SERIALIZE_INT("bitrate",pOutput->bitrate > 0 ? pOutput->bitrate : -1)
     JSON_SERIALIZE_INT("currentBitrate",pOutput->stats.currentBitRate)
+    if (pOutput->videoParams.lowLatency) {
+        JSON_SERIALIZE_OBJECT_BEGIN("lowLatency")
+        JSON_SERIALIZE_INT64("heldFrames",pOutput->lowLatencyStats.heldFrames)
+        JSON_SERIALIZE_INT64("slowFrames",pOutput->lowLatencyStats.slowFrames)
+        JSON_SERIALIZE_INT64("maxEncodeTime",pOutput->lowLatencyStats.maxEncodeTime)
+        JSON_SERIALIZE_OBJECT_END()
+    }
+    if (pOutput->presetController.preset>=0) {
+        JSON_SERIALIZE_OBJECT_BEGIN("adaptivePreset")
+        transcode_preset_controller_get_diagnostics(&pOutput->presetController,js);
+        JSON_SERIALIZE_OBJECT_END()
+    }
     JSON_SERIALIZE_END()
 }
@@ -11,6 +11,8 @@
 
 #include "core.h"
 #include "samples_stats.h"
+#include "latencyTracer.h"
+#include "transcode_preset_controller.h"
 #include "json_parser.h"
 #include "KMP.h"
 #include "../ackHandler/ackHandler.h"
@@ -37,6 +39,8 @@ typedef struct
         char level[128];
         char preset[128];
         int skipFrame;
+        bool lowLatency;
+        bool intraRefresh;
     } videoParams;
     struct ActualVideoParams
     {
@@ -50,10 +54,14 @@ typedef struct
     struct ActualAudioParams
     {
         int samplingRate,channels;
+        uint64_t channelLayout;
     } actualAudioParams;
 
     int filterId;
     int encoderId;
+    // copied when the encoder is opened, the filters are (re)built on the input thread
+    // while the encoder context belongs to the encoder thread
+    int encoderFrameSize;
 
     samples_stats_t stats;
 
@@ -67,6 +75,17 @@ typedef struct
     KMP_session_t* sender;
     // ack mapping
     ack_handler_t acker;
+    latency_tracer_t latency;
+    transcode_preset_controller_t presetController;
+    bool closed_captions;
+
+    // low latency outputs, checked after every frame
+    struct LowLatencyStats
+    {
+        int64_t heldFrames;         // no packet came out of the encoder
+        int64_t slowFrames;         // encoded in more than a frame duration
+        int64_t maxEncodeTime;      // microseconds
+    } lowLatencyStats;
 } transcode_session_output_t;
 
 
@@ -78,6 +97,12 @@ int transcode_session_output_connect(transcode_session_output_t *pOutput,uint64_
 int transcode_session_output_set_media_info(transcode_session_output_t *,transcode_mediaInfo_t* extra) ;
 int transcode_session_output_send_output_packet(transcode_session_output_t *,struct AVPacket* ) ;
 
+// the encode time budget of a low latency output is a frame, and never more than this
+#define TRANSCODE_LOW_LATENCY_MAX_ENCODE_TIME 100000
+
+// encodeTime is the time from sending the frame to the encoder to its packet, 0 when no packet came out
+void transcode_session_output_check_encode_latency(transcode_session_output_t *pOutput,AVRational frameRate,bool encoded,int64_t encodeTime);
+
 void transcode_session_output_get_diagnostics (transcode_session_output_t *,uint64_t recieveDts,uint64_t startProcessDts,json_writer_ctx_t js);
 
 #endif /* output_h */
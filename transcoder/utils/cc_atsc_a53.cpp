@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <stdexcept>
 #include <memory>
+#include <mutex>
 
 extern "C"
 {
@@ -142,6 +143,15 @@ struct A53Stream {
             throw std::invalid_argument("A53Stream already initialized");
         m_codec = codec;
     }
+    // the encoder was reopened, the bitstream context is rebuilt from its extradata on the next packet
+    void reset(const AVCodecContext *codec){
+        if(m_cbs)
+           ff_cbs_close(&m_cbs);
+        ff_cbs_fragment_reset(&m_frag);
+        m_desc = nullptr;
+        m_bInited = false;
+        m_codec = codec;
+    }
     ~A53Stream()
     {
         if(m_cbs)
@@ -250,6 +260,8 @@ private:
 struct A53Mapper
 {
    std::unordered_map<stream_id_t,std::unique_ptr<A53Stream>> m_cc;
+   // streams are fed by the decoding thread and drained by the encoder threads
+   std::mutex m_lock;
 };
 
 int atsc_a53_handler_create(atsc_a53_handler_t *h)
@@ -274,6 +286,7 @@ int atsc_a53_add_stream(atsc_a53_handler_t h,AVCodecContext *codec,stream_id_t s
              LOGGER(CATEGORY_ATSC_A53,AV_LOG_INFO,"atsc_a53_add_stream(%p). stream %d",
                      h,streamId);
               auto &m = *reinterpret_cast<A53Mapper*>(h);
+              std::lock_guard<std::mutex> lock(m.m_lock);
               std::unique_ptr<A53Stream> ptr(new A53Stream());
               if(!ptr.get())
                 throw std::bad_alloc();
@@ -287,6 +300,20 @@ int atsc_a53_add_stream(atsc_a53_handler_t h,AVCodecContext *codec,stream_id_t s
     }
     return 0;
 }
+int atsc_a53_update_stream(atsc_a53_handler_t h,AVCodecContext *codec,stream_id_t streamId) {
+    if(h)
+    {
+        LOGGER(CATEGORY_ATSC_A53,AV_LOG_INFO,"atsc_a53_update_stream(%p). stream %d",
+                 h,streamId);
+        auto &m = *reinterpret_cast<A53Mapper*>(h);
+        std::lock_guard<std::mutex> lock(m.m_lock);
+        auto it = m.m_cc.find(streamId);
+        if(it == m.m_cc.end())
+            return AVERROR(EINVAL);
+        it->second->reset(codec);
+    }
+    return 0;
+}
 int atsc_a53_decoded(atsc_a53_handler_t h,AVFrame *f)
 {
     LOGGER(CATEGORY_ATSC_A53,AV_LOG_DEBUG,"atsc_a53_decoded(%p). %p",
@@ -298,6 +325,7 @@ int atsc_a53_decoded(atsc_a53_handler_t h,AVFrame *f)
        //best effort
        get_frame_id(f,&fid);
         auto &m = *reinterpret_cast<A53Mapper*>(h);
+        std::lock_guard<std::mutex> lock(m.m_lock);
         try {
             for(auto &it: m.m_cc) {
               it.second->decoded(f,fid,sd);
@@ -323,6 +351,7 @@ int atsc_a53_filtered(atsc_a53_handler_t h,stream_id_t streamId,AVFrame *f)
            //best effort
            get_frame_id(f,&fid);
            auto &m = *reinterpret_cast<A53Mapper*>(h);
+           std::lock_guard<std::mutex> lock(m.m_lock);
            try {
               auto it = m.m_cc.find(streamId);
               if(it == m.m_cc.end())
@@ -343,6 +372,7 @@ int atsc_a53_encoded(atsc_a53_handler_t h,stream_id_t streamId,AVPacket **ppPack
       if(h && ppPacket && *ppPacket)
      {
           auto &m = *reinterpret_cast<A53Mapper*>(h);
+          std::lock_guard<std::mutex> lock(m.m_lock);
           try {
                auto it = m.m_cc.find(streamId);
                if(it == m.m_cc.end())
@@ -9,6 +9,9 @@ void atsc_a53_handler_free(atsc_a53_handler_t *h);
 
 int atsc_a53_add_stream(atsc_a53_handler_t h,AVCodecContext *codec,stream_id_t id);
 
+// the encoder of the stream was replaced
+int atsc_a53_update_stream(atsc_a53_handler_t h,AVCodecContext *codec,stream_id_t id);
+
 int atsc_a53_decoded(atsc_a53_handler_t h,AVFrame *f);
 
 int atsc_a53_filtered(atsc_a53_handler_t h,stream_id_t id,AVFrame *f);
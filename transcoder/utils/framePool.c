@@ -0,0 +1,182 @@
+#include "framePool.h"
+#include <libavutil/imgutils.h>
+
+// the padding libavcodec adds to every plane, for the SIMD reads past the end of the lines
+#define FRAME_POOL_PLANE_PADDING (16+64-1)
+
+void frame_pool_init(frame_pool_t *pool,int depth)
+{
+    json_get_bool(GetConfig(),"engine.framePool",true,&pool->enabled);
+    pool->depth=depth;
+    pool->warmFrames=0;
+    pool->format=AV_PIX_FMT_NONE;
+    pool->width=pool->height=0;
+    pool->frameSize=0;
+    pool->allocations=0;
+    for (int i=0;i<4;i++) {
+        pool->linesize[i]=0;
+        pool->pools[i]=NULL;
+    }
+    atomic_init(&pool->hits,0);
+    atomic_init(&pool->misses,0);
+    atomic_init(&pool->allocatedBytes,0);
+}
+
+void frame_pool_close(frame_pool_t *pool)
+{
+    // the buffers still referenced are freed when released
+    for (int i=0;i<4;i++) {
+        av_buffer_pool_uninit(&pool->pools[i]);
+    }
+    pool->format=AV_PIX_FMT_NONE;
+}
+
+static AVBufferRef* frame_pool_alloc(void* opaque,int size)
+{
+    frame_pool_t *pool=(frame_pool_t*)opaque;
+    AVBufferRef* buf=av_buffer_alloc(size);
+    if (buf!=NULL) {
+        pool->allocations++;
+        atomic_fetch_add_explicit(&pool->allocatedBytes,size,memory_order_relaxed);
+    }
+    return buf;
+}
+
+// allocates the frames the pipeline holds at once, so that the steady state never allocates
+static int frame_pool_warm(frame_pool_t *pool)
+{
+    int planes=0;
+    while (planes<4 && pool->pools[planes]!=NULL) {
+        planes++;
+    }
+    AVBufferRef** bufs=av_calloc(pool->warmFrames*planes,sizeof(AVBufferRef*));
+    if (bufs==NULL) {
+        return AVERROR(ENOMEM);
+    }
+    int ret=0;
+    for (int i=0;i<pool->warmFrames*planes && ret==0;i++) {
+        bufs[i]=av_buffer_pool_get(pool->pools[i % planes]);
+        if (bufs[i]==NULL) {
+            ret=AVERROR(ENOMEM);
+        }
+    }
+    for (int i=0;i<pool->warmFrames*planes;i++) {
+        av_buffer_unref(&bufs[i]);
+    }
+    av_free(bufs);
+    return ret;
+}
+
+// the same layout as avcodec_default_get_buffer2
+static int frame_pool_configure(frame_pool_t *pool,AVCodecContext *s,const AVFrame *frame)
+{
+    int w=frame->width,h=frame->height;
+    int strideAlign[AV_NUM_DATA_POINTERS];
+    int linesize[4];
+    uint8_t *data[4];
+    bool unaligned;
+    int ret;
+
+    avcodec_align_dimensions2(s,&w,&h,strideAlign);
+    do {
+        ret=av_image_fill_linesizes(linesize,frame->format,w);
+        if (ret<0) {
+            return ret;
+        }
+        // the lines aren't aligned one by one, the decoders expect e.g. linesize[0]==2*linesize[1] for 4:2:2
+        w+=w & ~(w-1);
+        unaligned=false;
+        for (int i=0;i<4;i++) {
+            unaligned|=(linesize[i] % strideAlign[i])!=0;
+        }
+    } while (unaligned);
+
+    int size=av_image_fill_pointers(data,frame->format,h,NULL,linesize);
+    if (size<0) {
+        return size;
+    }
+    int64_t planeSize[4]={0};
+    int planes;
+    for (planes=0;planes<3 && data[planes+1]!=NULL;planes++) {
+        planeSize[planes]=data[planes+1]-data[planes];
+    }
+    planeSize[planes]=size-(data[planes]-data[0]);
+    planes++;
+
+    frame_pool_close(pool);
+    pool->frameSize=0;
+    for (int i=0;i<planes;i++) {
+        pool->linesize[i]=linesize[i];
+        pool->pools[i]=av_buffer_pool_init2(planeSize[i]+FRAME_POOL_PLANE_PADDING,pool,frame_pool_alloc,NULL);
+        if (pool->pools[i]==NULL) {
+            frame_pool_close(pool);
+            return AVERROR(ENOMEM);
+        }
+        pool->frameSize+=planeSize[i]+FRAME_POOL_PLANE_PADDING;
+    }
+    pool->format=frame->format;
+    pool->width=frame->width;
+    pool->height=frame->height;
+    // the reference frames and the reordering delay of the decoder, and the frame being decoded
+    pool->warmFrames=pool->depth+FFMAX(s->refs,1)+s->has_b_frames+1;
+
+    LOGGER(CATEGORY_FRAME_POOL,AV_LOG_INFO,"frame pool %dx%d %s, %d planes, %lld bytes per frame, %d frames",
+           pool->width,pool->height,av_get_pix_fmt_name(pool->format),planes,pool->frameSize,pool->warmFrames);
+    return frame_pool_warm(pool);
+}
+
+bool frame_pool_supports(frame_pool_t *pool,const AVCodecContext *s)
+{
+    if (!pool->enabled || s->codec_type!=AVMEDIA_TYPE_VIDEO || s->hw_frames_ctx!=NULL ||
+        (s->codec->capabilities & AV_CODEC_CAP_DR1)==0) {
+        return false;
+    }
+    // the palette formats get their palette from the default allocator
+    const AVPixFmtDescriptor *desc=av_pix_fmt_desc_get(s->pix_fmt);
+    uint64_t unsupported=AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL;
+#ifdef AV_PIX_FMT_FLAG_PSEUDOPAL
+    unsupported|=AV_PIX_FMT_FLAG_PSEUDOPAL;
+#endif
+    return desc!=NULL && (desc->flags & unsupported)==0;
+}
+
+int frame_pool_get_video_buffer(frame_pool_t *pool,AVCodecContext *s,AVFrame *frame)
+{
+    if (frame->format!=pool->format || frame->width!=pool->width || frame->height!=pool->height) {
+        int ret=frame_pool_configure(pool,s,frame);
+        if (ret<0) {
+            LOGGER(CATEGORY_FRAME_POOL,AV_LOG_ERROR,"failed to configure the frame pool for %dx%d %s %d (%s)",
+                   frame->width,frame->height,av_get_pix_fmt_name(frame->format),ret,av_err2str(ret));
+            return ret;
+        }
+    }
+
+    int64_t allocations=pool->allocations;
+    memset(frame->data,0,sizeof(frame->data));
+    for (int i=0;i<4 && pool->pools[i]!=NULL;i++) {
+        frame->buf[i]=av_buffer_pool_get(pool->pools[i]);
+        if (frame->buf[i]==NULL) {
+            for (int j=0;j<i;j++) {
+                av_buffer_unref(&frame->buf[j]);
+            }
+            return AVERROR(ENOMEM);
+        }
+        frame->data[i]=frame->buf[i]->data;
+        frame->linesize[i]=pool->linesize[i];
+    }
+    frame->extended_data=frame->data;
+
+    // a miss is a frame that needed a new buffer, the pipeline holds more frames than the pool was warmed with
+    atomic_fetch_add_explicit(pool->allocations==allocations ? &pool->hits : &pool->misses,1,memory_order_relaxed);
+    return 0;
+}
+
+void frame_pool_get_diagnostics(frame_pool_t *pool,json_writer_ctx_t js)
+{
+    JSON_SERIALIZE_BOOL("enabled",pool->enabled)
+    JSON_SERIALIZE_INT("frames",pool->warmFrames)
+    JSON_SERIALIZE_INT64("frameSize",pool->frameSize)
+    JSON_SERIALIZE_INT64("hits",(int64_t)atomic_load_explicit(&pool->hits,memory_order_relaxed))
+    JSON_SERIALIZE_INT64("misses",(int64_t)atomic_load_explicit(&pool->misses,memory_order_relaxed))
+    JSON_SERIALIZE_INT64("allocatedBytes",(int64_t)atomic_load_explicit(&pool->allocatedBytes,memory_order_relaxed))
+}
@@ -0,0 +1,41 @@
+#ifndef framePool_h
+#define framePool_h
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include "../core.h"
+
+#define CATEGORY_FRAME_POOL "FRAME_POOL"
+
+/* the buffers of the decoded video frames. the frames are fanned out to the filters and encoders
+   by reference, and their buffers return to the pool once the last reference is released */
+typedef struct {
+    bool enabled;
+    int depth;                          // frames held after the decoder (encoder queues)
+    int warmFrames;                     // allocated up front, depth + the frames the decoder holds
+
+    // the current layout, the pools are rebuilt when the decoded frames change
+    enum AVPixelFormat format;
+    int width,height;
+    int linesize[4];
+    AVBufferPool* pools[4];             // one per plane
+    int64_t frameSize;                  // bytes
+
+    int64_t allocations;                // buffers allocated by the pools, decoding thread only
+    // read by the diagnostics
+    atomic_int_fast64_t hits;
+    atomic_int_fast64_t misses;
+    atomic_int_fast64_t allocatedBytes;
+} frame_pool_t;
+
+void frame_pool_init(frame_pool_t *pool,int depth);
+void frame_pool_close(frame_pool_t *pool);
+
+// whether the frames of the decoder can come from the pool
+bool frame_pool_supports(frame_pool_t *pool,const AVCodecContext *s);
+// get_buffer2 for the video decoder
+int frame_pool_get_video_buffer(frame_pool_t *pool,AVCodecContext *s,AVFrame *frame);
+
+void frame_pool_get_diagnostics(frame_pool_t *pool,json_writer_ctx_t js);
+
+#endif /* framePool_h */
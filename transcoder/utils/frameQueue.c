@@ -0,0 +1,147 @@
+#include "frameQueue.h"
+#include <pthread.h>
+
+
+static void frame_queue_free_message(void *msg)
+{
+    FrameQueueMessage *frameMsg=(FrameQueueMessage *)msg;
+    av_frame_free(&frameMsg->frame);
+}
+
+static int frame_queue_send(FrameQueueContext_t *ctx, FrameQueueMessage *msg)
+{
+    if (ctx->workerPool==NULL) {
+        return av_thread_message_queue_send(ctx->queue, msg, 0);
+    }
+    int ret;
+    while ((ret=av_thread_message_queue_send(ctx->queue, msg, AV_THREAD_MESSAGE_NONBLOCK))==AVERROR(EAGAIN)) {
+        worker_pool_lane_help(&ctx->lane);
+    }
+    if (ret>=0) {
+        worker_pool_lane_schedule(&ctx->lane);
+    }
+    return ret;
+}
+
+int frame_queue_write_frame(FrameQueueContext_t *ctx, const AVFrame *frame)
+{
+    FrameQueueMessage msg = {.type = FRAME_QUEUE_WRITE_FRAME, .frame=NULL};
+    if (frame!=NULL) {
+        // the queue takes a reference, a frame without buffers would be copied
+        if (frame->buf[0]==NULL) {
+            LOGGER0(CATEGORY_FRAME_QUEUE,AV_LOG_ERROR,"frame is not reference counted");
+            return AVERROR(EINVAL);
+        }
+        msg.frame=av_frame_clone(frame);
+        if (msg.frame==NULL) {
+            return AVERROR(ENOMEM);
+        }
+    }
+    int ret=frame_queue_send(ctx, &msg);
+    if (ret<0) {
+        av_frame_free(&msg.frame);
+    }
+    return ret;
+}
+
+static int frame_queue_write_stop(FrameQueueContext_t *ctx)
+{
+    FrameQueueMessage msg = {.type = FRAME_QUEUE_WRITE_STOP, .frame=NULL};
+    return frame_queue_send(ctx, &msg);
+}
+
+// returns false once the consumer should stop
+static bool frame_queue_process_message(FrameQueueContext_t *ctx, FrameQueueMessage *msg)
+{
+    if (msg->type==FRAME_QUEUE_WRITE_STOP) {
+        ctx->stopped=true;
+        return false;
+    }
+    int ret=ctx->onFrame(ctx->callbackContext,msg->frame);
+    av_frame_free(&msg->frame);
+    if (ret < 0) {
+        // the error is returned to the producer on its next write
+        LOGGER(CATEGORY_FRAME_QUEUE, AV_LOG_ERROR, "Frame queue callback failed %d (%s)",ret,av_err2str(ret));
+        av_thread_message_queue_set_err_send(ctx->queue, ret);
+        ctx->stopped=true;
+        return false;
+    }
+    return true;
+}
+
+static void* frame_queue_consumer_thread(void* params) {
+    FrameQueueContext_t *ctx=(FrameQueueContext_t *)params;
+    FrameQueueMessage msg = {FRAME_QUEUE_WRITE_STOP, NULL};
+    while(1) {
+
+        if (av_thread_message_queue_recv(ctx->queue, &msg, 0) < 0) {
+            break;
+        }
+        if (!frame_queue_process_message(ctx, &msg)) {
+            break;
+        }
+    }
+    LOGGER0(CATEGORY_FRAME_QUEUE, AV_LOG_INFO, "Stopped frame queue thread");
+    return NULL;
+}
+
+static int frame_queue_run_lane(void* params) {
+    FrameQueueContext_t *ctx=(FrameQueueContext_t *)params;
+    FrameQueueMessage msg = {FRAME_QUEUE_WRITE_STOP, NULL};
+    // a stopped queue has no more work, even when the lane was signaled again
+    if (ctx->stopped) {
+        return 0;
+    }
+    for (int i=0;i<WORKER_POOL_QUANTUM;i++) {
+        if (av_thread_message_queue_recv(ctx->queue, &msg, AV_THREAD_MESSAGE_NONBLOCK) < 0) {
+            return 0;
+        }
+        if (!frame_queue_process_message(ctx, &msg)) {
+            return 0;
+        }
+    }
+    return ctx->stopped ? 0 : 1;
+}
+
+int frame_queue_init(FrameQueueContext_t *ctx)
+{
+    int ret;
+    ret = av_thread_message_queue_alloc(&ctx->queue,ctx->queueSize,sizeof(FrameQueueMessage));
+    if (ret < 0) {
+        LOGGER(CATEGORY_FRAME_QUEUE, AV_LOG_ERROR, "Failed to allocate queue: %s", av_err2str(ret));
+        return ret;
+    }
+    av_thread_message_queue_set_free_func(ctx->queue, frame_queue_free_message);
+    ctx->stopped=false;
+
+    if (ctx->workerPool!=NULL) {
+        worker_pool_lane_init(&ctx->lane,ctx->workerPool,frame_queue_run_lane,ctx,ctx->priority);
+        return 0;
+    }
+
+    ret = pthread_create(&ctx->thread, NULL, frame_queue_consumer_thread, ctx);
+    if (ret) {
+        LOGGER(CATEGORY_FRAME_QUEUE, AV_LOG_ERROR, "Failed to start thread: %s", av_err2str(AVERROR(ret)));
+        av_thread_message_queue_free(&ctx->queue);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+void frame_queue_destroy(FrameQueueContext_t *ctx)
+{
+    if (ctx->queue==NULL) {
+        return;
+    }
+    LOGGER0(CATEGORY_FRAME_QUEUE, AV_LOG_INFO, "Destroying frame queue");
+    frame_queue_write_stop(ctx);
+
+    if (ctx->workerPool!=NULL) {
+        worker_pool_lane_wait_idle(&ctx->lane);
+    } else {
+        pthread_join(ctx->thread,NULL);
+    }
+    // releases the frames left in the queue if the consumer stopped on error
+    av_thread_message_queue_free(&ctx->queue);
+}
@@ -0,0 +1,45 @@
+#ifndef frameQueue_h
+#define frameQueue_h
+
+#include <stdio.h>
+#include "../core.h"
+
+#include "libavutil/threadmessage.h"
+#include "workerPool.h"
+
+typedef int frame_queue_frameCB(void* cbContext,AVFrame* frame);
+
+typedef struct  {
+    pthread_t thread;
+    int queueSize;
+    AVThreadMessageQueue *queue;
+    void* callbackContext;
+    frame_queue_frameCB*  onFrame;
+    // when set, the frames are consumed by a lane of the shared pool instead of a dedicated thread
+    worker_pool_t* workerPool;
+    int priority;
+    worker_pool_lane_t lane;
+    bool stopped;
+} FrameQueueContext_t;
+
+
+typedef enum FrameQueueMessageType {
+    FRAME_QUEUE_WRITE_FRAME,
+    FRAME_QUEUE_WRITE_STOP
+} FrameQueueMessageType;
+
+
+typedef struct FrameQueueMessage {
+    FrameQueueMessageType type;
+    AVFrame* frame;
+} FrameQueueMessage;
+
+#define CATEGORY_FRAME_QUEUE "CATEGORY_FRAME_QUEUE"
+
+// queues a new reference to frame, NULL is passed as is (flush)
+int frame_queue_write_frame(FrameQueueContext_t *ctx, const AVFrame *frame);
+
+int frame_queue_init(FrameQueueContext_t *ctx);
+void frame_queue_destroy(FrameQueueContext_t *ctx);
+
+#endif /* frameQueue_h */
@@ -0,0 +1,191 @@
+#include "latencyTracer.h"
+#include <stdarg.h>
+
+static const int64_t latency_histogram_bounds[LATENCY_HISTOGRAM_BUCKETS-1]={LATENCY_HISTOGRAM_BOUNDS};
+
+static void latency_write(json_writer_ctx_t js,const char* fmt,...)
+{
+    if (js->cur>=js->end) {
+        return;
+    }
+    va_list args;
+    va_start(args,fmt);
+    int n=vsnprintf(js->cur,js->end-js->cur,fmt,args);
+    va_end(args);
+    if (n>0) {
+        js->cur+=FFMIN(n,js->end-js->cur-1);
+    }
+}
+
+void latency_histogram_init(latency_histogram_t *h)
+{
+    for (int i=0;i<LATENCY_HISTOGRAM_BUCKETS;i++) {
+        atomic_init(&h->buckets[i],0);
+    }
+    atomic_init(&h->count,0);
+    atomic_init(&h->sum,0);
+}
+
+void latency_histogram_add(latency_histogram_t *h,int64_t durationUs)
+{
+    if (durationUs<0) {
+        durationUs=0;
+    }
+    int bucket=0;
+    while (bucket<LATENCY_HISTOGRAM_BUCKETS-1 && durationUs>latency_histogram_bounds[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucket],1,memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum,durationUs,memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count,1,memory_order_relaxed);
+}
+
+void latency_histogram_write_prometheus_header(const char* name,const char* help,json_writer_ctx_t js)
+{
+    latency_write(js,"# HELP %s %s\n# TYPE %s histogram\n",name,help,name);
+}
+
+void latency_histogram_write_prometheus(const latency_histogram_t *h,const char* name,const char* labels,json_writer_ctx_t js)
+{
+    // room for the whole histogram, so that the response is never cut in the middle of one
+    size_t lineSize=strlen(name)+strlen(labels)+64;
+    if (js->cur>=js->end || (size_t)(js->end-js->cur)<(LATENCY_HISTOGRAM_BUCKETS+2)*lineSize) {
+        return;
+    }
+    // the buckets are updated without a lock, so the count is taken from them to keep the output consistent
+    int64_t cumulative=0;
+    for (int i=0;i<LATENCY_HISTOGRAM_BUCKETS;i++) {
+        cumulative+=atomic_load_explicit(&h->buckets[i],memory_order_relaxed);
+        if (i<LATENCY_HISTOGRAM_BUCKETS-1) {
+            latency_write(js,"%s_bucket{%s,le=\"%g\"} %"PRId64"\n",name,labels,latency_histogram_bounds[i]/1000000.0,cumulative);
+        } else {
+            latency_write(js,"%s_bucket{%s,le=\"+Inf\"} %"PRId64"\n",name,labels,cumulative);
+        }
+    }
+    latency_write(js,"%s_sum{%s} %.6f\n",name,labels,atomic_load_explicit(&h->sum,memory_order_relaxed)/1000000.0);
+    latency_write(js,"%s_count{%s} %"PRId64"\n",name,labels,cumulative);
+}
+
+void latency_write_label_value(char* buf,int size,const char* value)
+{
+    int n=0;
+    for (;*value && n<size-2;value++) {
+        if (*value=='"' || *value=='\\') {
+            buf[n++]='\\';
+            buf[n++]=*value;
+        } else if (*value=='\n') {
+            buf[n++]='\\';
+            buf[n++]='n';
+        } else {
+            buf[n++]=*value;
+        }
+    }
+    buf[n]=0;
+}
+
+int latency_trace_set_frame_time(AVFrame *frame,const char* key,int64_t time)
+{
+    char buf[sizeof("9223372036854775807")];
+    sprintf(buf,"%"PRId64,time);
+    return av_dict_set(&frame->metadata,key,buf,0);
+}
+
+int64_t latency_trace_get_frame_time(const AVFrame *frame,const char* key)
+{
+    AVDictionaryEntry *entry=av_dict_get(frame->metadata,key,NULL,0);
+    return entry!=NULL ? strtoll(entry->value,NULL,10) : 0;
+}
+
+void latency_tracer_init(latency_tracer_t *tracer)
+{
+    tracer->head=tracer->count=0;
+    for (int i=0;i<LATENCY_STAGES;i++) {
+        latency_histogram_init(&tracer->stages[i]);
+    }
+}
+
+const char* latency_tracer_stage_name(latency_stage_t stage)
+{
+    switch (stage) {
+        case LATENCY_STAGE_FILTER: return "filter";
+        case LATENCY_STAGE_ENCODER_QUEUE: return "encoderQueue";
+        case LATENCY_STAGE_ENCODE: return "encode";
+        case LATENCY_STAGE_SEND: return "send";
+        case LATENCY_STAGE_TOTAL: return "total";
+        default: return "unknown";
+    }
+}
+
+static latency_trace_t* latency_tracer_at(latency_tracer_t *tracer,int i)
+{
+    return &tracer->pending[(tracer->head+i) % LATENCY_TRACER_MAX_PENDING];
+}
+
+void latency_tracer_frame_encoding(latency_tracer_t *tracer,const AVFrame *frame,int64_t now)
+{
+    int64_t receiveTime=latency_trace_get_frame_time(frame,LATENCY_TRACE_RECEIVE_TIME);
+    if (receiveTime==0) {
+        return;
+    }
+    if (tracer->count==LATENCY_TRACER_MAX_PENDING) {
+        // the encoder holds more frames than expected, the oldest one is given up on
+        tracer->head=(tracer->head+1) % LATENCY_TRACER_MAX_PENDING;
+        tracer->count--;
+    }
+    latency_trace_t *trace=latency_tracer_at(tracer,tracer->count++);
+    trace->pts=frame->pts;
+    trace->receiveTime=receiveTime;
+    trace->decodeTime=latency_trace_get_frame_time(frame,LATENCY_TRACE_DECODE_TIME);
+    trace->filterTime=latency_trace_get_frame_time(frame,LATENCY_TRACE_FILTER_TIME);
+    trace->encodeTime=now;
+    trace->done=false;
+}
+
+bool latency_tracer_packet_encoded(latency_tracer_t *tracer,pts_t pts,int64_t now,latency_trace_t *trace)
+{
+    // video packets carry the pts of their frame (in any order), an audio encoder may regroup the
+    // samples, so its packet is matched with the latest frame that started before it
+    int match=-1;
+    for (int i=0;i<tracer->count;i++) {
+        latency_trace_t *pending=latency_tracer_at(tracer,i);
+        if (pending->done || pending->pts>pts) {
+            continue;
+        }
+        match=i;
+        if (pending->pts==pts) {
+            break;
+        }
+    }
+    if (match<0) {
+        return false;
+    }
+    latency_trace_t *pending=latency_tracer_at(tracer,match);
+    pending->done=true;
+    if (pending->pts!=pts) {
+        for (int i=0;i<match;i++) {
+            latency_tracer_at(tracer,i)->done=true;
+        }
+    }
+    *trace=*pending;
+    while (tracer->count>0 && latency_tracer_at(tracer,0)->done) {
+        tracer->head=(tracer->head+1) % LATENCY_TRACER_MAX_PENDING;
+        tracer->count--;
+    }
+
+    int64_t readyTime=trace->decodeTime;
+    if (trace->filterTime>0) {
+        latency_histogram_add(&tracer->stages[LATENCY_STAGE_FILTER],trace->filterTime-trace->decodeTime);
+        readyTime=trace->filterTime;
+    }
+    if (readyTime>0) {
+        latency_histogram_add(&tracer->stages[LATENCY_STAGE_ENCODER_QUEUE],trace->encodeTime-readyTime);
+    }
+    latency_histogram_add(&tracer->stages[LATENCY_STAGE_ENCODE],now-trace->encodeTime);
+    return true;
+}
+
+void latency_tracer_packet_sent(latency_tracer_t *tracer,const latency_trace_t *trace,int64_t encodedTime,int64_t now)
+{
+    latency_histogram_add(&tracer->stages[LATENCY_STAGE_SEND],now-encodedTime);
+    latency_histogram_add(&tracer->stages[LATENCY_STAGE_TOTAL],now-trace->receiveTime);
+}
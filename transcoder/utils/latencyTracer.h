@@ -0,0 +1,74 @@
+#ifndef latencyTracer_h
+#define latencyTracer_h
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include "../core.h"
+
+// upper bounds of the buckets in microseconds, the last bucket (+Inf) is implicit
+#define LATENCY_HISTOGRAM_BOUNDS 1000,2500,5000,10000,25000,50000,100000,250000,500000,1000000,2500000,5000000,10000000
+#define LATENCY_HISTOGRAM_BUCKETS 14
+
+// written by the pipeline threads, read by the http thread
+typedef struct {
+    atomic_int_fast64_t buckets[LATENCY_HISTOGRAM_BUCKETS];    // not cumulative
+    atomic_int_fast64_t count;
+    atomic_int_fast64_t sum;                                    // microseconds
+} latency_histogram_t;
+
+// the stages of an output, each measured from the end of the previous one
+typedef enum {
+    LATENCY_STAGE_FILTER,           // decoded -> filtered, filtered outputs only
+    LATENCY_STAGE_ENCODER_QUEUE,    // filtered (or decoded) -> taken by the encoder
+    LATENCY_STAGE_ENCODE,           // taken by the encoder -> encoded
+    LATENCY_STAGE_SEND,             // encoded -> sent
+    LATENCY_STAGE_TOTAL,            // received -> sent
+    LATENCY_STAGES
+} latency_stage_t;
+
+// the timestamps (getTime64) of a frame, carried in the frame metadata up to the encoder
+typedef struct {
+    pts_t pts;
+    int64_t receiveTime;
+    int64_t decodeTime;
+    int64_t filterTime;     // 0 when the output isn't filtered
+    int64_t encodeTime;     // sent to the encoder
+    bool done;
+} latency_trace_t;
+
+// frames inside the encoder, enough for the lookahead of x264
+#define LATENCY_TRACER_MAX_PENDING 128
+
+// per output, used by the encoding thread only (except the histograms)
+typedef struct {
+    latency_trace_t pending[LATENCY_TRACER_MAX_PENDING];
+    int head;
+    int count;
+    latency_histogram_t stages[LATENCY_STAGES];
+} latency_tracer_t;
+
+#define LATENCY_TRACE_RECEIVE_TIME "recv_time"     // set by add_packet_frame_metadata
+#define LATENCY_TRACE_DECODE_TIME "decode_time"
+#define LATENCY_TRACE_FILTER_TIME "filter_time"
+
+void latency_histogram_init(latency_histogram_t *h);
+void latency_histogram_add(latency_histogram_t *h,int64_t durationUs);
+
+// prometheus text format, the histograms that don't fit in the buffer are left out
+void latency_histogram_write_prometheus_header(const char* name,const char* help,json_writer_ctx_t js);
+void latency_histogram_write_prometheus(const latency_histogram_t *h,const char* name,const char* labels,json_writer_ctx_t js);
+// writes a prometheus label value, escaping quotes, backslashes and new lines
+void latency_write_label_value(char* buf,int size,const char* value);
+
+int latency_trace_set_frame_time(AVFrame *frame,const char* key,int64_t time);
+int64_t latency_trace_get_frame_time(const AVFrame *frame,const char* key);
+
+void latency_tracer_init(latency_tracer_t *tracer);
+const char* latency_tracer_stage_name(latency_stage_t stage);
+// the frame is about to be sent to the encoder
+void latency_tracer_frame_encoding(latency_tracer_t *tracer,const AVFrame *frame,int64_t now);
+// matches an encoded packet with its frame, returns false if the frame wasn't traced
+bool latency_tracer_packet_encoded(latency_tracer_t *tracer,pts_t pts,int64_t now,latency_trace_t *trace);
+void latency_tracer_packet_sent(latency_tracer_t *tracer,const latency_trace_t *trace,int64_t encodedTime,int64_t now);
+
+#endif /* latencyTracer_h */
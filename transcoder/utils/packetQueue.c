@@ -8,47 +8,176 @@
 
 #include "packetQueue.h"
 #include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 
 #define CATEGORY_PACKET_QUEUE "CATEGORY_PACKET_QUEUE"
 
+static int packet_queue_event_init(PacketQueueEvent_t *event)
+{
+    atomic_init(&event->waiting,0);
+#ifdef __linux__
+    event->readFd=event->writeFd=eventfd(0,EFD_CLOEXEC);
+    if (event->readFd<0) {
+        return AVERROR(errno);
+    }
+#else
+    int fds[2];
+    if (pipe(fds)<0) {
+        return AVERROR(errno);
+    }
+    event->readFd=fds[0];
+    event->writeFd=fds[1];
+#endif
+    return 0;
+}
+
+static void packet_queue_event_close(PacketQueueEvent_t *event)
+{
+    if (event->readFd>=0) {
+        close(event->readFd);
+    }
+    if (event->writeFd>=0 && event->writeFd!=event->readFd) {
+        close(event->writeFd);
+    }
+    event->readFd=event->writeFd=-1;
+}
+
+static void packet_queue_event_signal(PacketQueueEvent_t *event)
+{
+    // only the side that announced it is about to sleep needs a syscall
+    if (!atomic_exchange(&event->waiting,0)) {
+        return;
+    }
+    uint64_t value=1;
+    while (write(event->writeFd,&value,sizeof(value))<0 && errno==EINTR);
+}
+
+static void packet_queue_event_wait(PacketQueueEvent_t *event)
+{
+    uint64_t value;
+    while (read(event->readFd,&value,sizeof(value))<0 && errno==EINTR);
+    atomic_store(&event->waiting,0);
+}
+
+static int packet_queue_write_message(PacketQueueContext_t *ctx, FifoMessageType type, AVPacket *pkt, transcode_mediaInfo_t *mediaInfo)
+{
+    uint64_t writeIndex=atomic_load_explicit(&ctx->writeIndex,memory_order_relaxed);
+    uint64_t blockedSince=0;
+
+    // the ring is full, block until the consumer frees a slot.
+    // waiting is set before re-checking readIndex, so the consumer either sees the flag or we see its progress
+    while (writeIndex-atomic_load_explicit(&ctx->readIndex,memory_order_acquire)>=ctx->queueSize) {
+        if (blockedSince==0) {
+            blockedSince=getTime64();
+        }
+        atomic_store(&ctx->notFull.waiting,1);
+        if (writeIndex-atomic_load(&ctx->readIndex)<ctx->queueSize) {
+            atomic_store(&ctx->notFull.waiting,0);
+            break;
+        }
+        packet_queue_event_wait(&ctx->notFull);
+    }
+
+    FifoMessage* slot=&ctx->slots[writeIndex % ctx->queueSize];
+    slot->type=type;
+    slot->mediaInfo=mediaInfo;
+    if (pkt!=NULL) {
+        av_packet_move_ref(slot->pkt,pkt);
+    }
+    slot->enqueueTime=getTime64();
+    if (blockedSince!=0) {
+        atomic_fetch_add_explicit(&ctx->stats.producerBlockedTime,slot->enqueueTime-blockedSince,memory_order_relaxed);
+    }
+
+    atomic_store(&ctx->writeIndex,writeIndex+1);
+    if (ctx->workerPool!=NULL) {
+        worker_pool_lane_schedule(&ctx->lane);
+    } else {
+        packet_queue_event_signal(&ctx->notEmpty);
+    }
+
+    int length=(int)(writeIndex+1-atomic_load_explicit(&ctx->readIndex,memory_order_relaxed));
+    if (length>atomic_load_explicit(&ctx->stats.maxLength,memory_order_relaxed)) {
+        atomic_store_explicit(&ctx->stats.maxLength,length,memory_order_relaxed);
+    }
+    return 0;
+}
+
 int packet_queue_write_packet(PacketQueueContext_t *ctx, AVPacket *pkt)
 {
-    FifoMessage msg = {.type =  FIFO_WRITE_PACKET, .pkt=pkt};
-    return av_thread_message_queue_send(ctx->queue, &msg, 0);
+    return packet_queue_write_message(ctx,FIFO_WRITE_PACKET,pkt,NULL);
 }
 
 int packet_queue_write_mediaInfo(PacketQueueContext_t *ctx, transcode_mediaInfo_t *mediaInfo)
 {
-    FifoMessage msg = {.type = FIFO_WRITE_CODEC_PARAMS, .mediaInfo=mediaInfo};
-    return av_thread_message_queue_send(ctx->queue, &msg, 0);
+    return packet_queue_write_message(ctx,FIFO_WRITE_CODEC_PARAMS,NULL,mediaInfo);
 }
 
 int packet_queue_write_stop(PacketQueueContext_t *ctx)
 {
-    FifoMessage msg = {.type = FIFO_WRITE_STOP, .mediaInfo=NULL, .pkt=NULL};
-    return av_thread_message_queue_send(ctx->queue, &msg, 0);
+    return packet_queue_write_message(ctx,FIFO_WRITE_STOP,NULL,NULL);
+}
+
+static void packet_queue_update_wait_time(PacketQueueContext_t *ctx,FifoMessage* slot)
+{
+    int64_t waitTime=getTime64()-slot->enqueueTime;
+    atomic_fetch_add_explicit(&ctx->stats.dequeued,1,memory_order_relaxed);
+    atomic_fetch_add_explicit(&ctx->stats.totalWaitTime,waitTime,memory_order_relaxed);
+    latency_histogram_add(&ctx->stats.waitTime,waitTime);
+    if (waitTime>atomic_load_explicit(&ctx->stats.maxWaitTime,memory_order_relaxed)) {
+        atomic_store_explicit(&ctx->stats.maxWaitTime,waitTime,memory_order_relaxed);
+    }
+}
+
+// processes the message at the read index, returns false once the consumer should stop
+static bool packet_queue_process_message(PacketQueueContext_t *ctx)
+{
+    uint64_t readIndex=atomic_load_explicit(&ctx->readIndex,memory_order_relaxed);
+    FifoMessage* slot=&ctx->slots[readIndex % ctx->queueSize];
+    FifoMessageType type=slot->type;
+    if (type==FIFO_WRITE_CODEC_PARAMS) {
+        packet_queue_update_wait_time(ctx,slot);
+        ctx->onMediaInfo(ctx->callbackContext,slot->mediaInfo);
+    }
+    if (type==FIFO_WRITE_PACKET) {
+        packet_queue_update_wait_time(ctx,slot);
+        ctx->onPacket(ctx->callbackContext,slot->pkt);
+        av_packet_unref(slot->pkt);
+    }
+    slot->mediaInfo=NULL;
+
+    // the slot is handed back to the producer only once the callback is done with it
+    atomic_store(&ctx->readIndex,readIndex+1);
+    packet_queue_event_signal(&ctx->notFull);
+
+    return type!=FIFO_WRITE_STOP;
+}
+
+static bool packet_queue_is_empty(PacketQueueContext_t *ctx)
+{
+    // seq_cst, pairs with the waiting flag set by the consumer before re-checking
+    return atomic_load(&ctx->writeIndex)==atomic_load_explicit(&ctx->readIndex,memory_order_relaxed);
 }
 
 void* fifo_consumer_thread(void* params) {
     PacketQueueContext_t *ctx=(PacketQueueContext_t *)params;
-    FifoMessage msg = {FIFO_WRITE_NOPS, NULL,NULL};
-    int ret=0;
     while(1) {
 
-        ret = av_thread_message_queue_recv(ctx->queue, &msg, 0);
-        if (ret < 0) {
-            av_thread_message_queue_set_err_send(ctx->queue, ret);
-            break;
-        }
-        if (msg.type==FIFO_WRITE_CODEC_PARAMS) {
-            ctx->onMediaInfo(ctx->callbackContext,msg.mediaInfo);
+        while (packet_queue_is_empty(ctx)) {
+            atomic_store(&ctx->notEmpty.waiting,1);
+            if (!packet_queue_is_empty(ctx)) {
+                atomic_store(&ctx->notEmpty.waiting,0);
+                break;
+            }
+            packet_queue_event_wait(&ctx->notEmpty);
         }
-        if (msg.type==FIFO_WRITE_PACKET) {
-            ctx->onPacket(ctx->callbackContext,msg.pkt);
-            av_packet_free(&msg.pkt);
-        }
-        if (msg.type==FIFO_WRITE_STOP) {
+
+        if (!packet_queue_process_message(ctx)) {
             break;
         }
     }
@@ -56,27 +185,117 @@ void* fifo_consumer_thread(void* params) {
     return NULL;
 }
 
+static int packet_queue_run_lane(void* params) {
+    PacketQueueContext_t *ctx=(PacketQueueContext_t *)params;
+    for (int i=0;i<WORKER_POOL_QUANTUM;i++) {
+        if (packet_queue_is_empty(ctx)) {
+            return 0;
+        }
+        if (!packet_queue_process_message(ctx)) {
+            return 0;
+        }
+    }
+    return packet_queue_is_empty(ctx) ? 0 : 1;
+}
+
+int packet_queue_get_length(PacketQueueContext_t *ctx)
+{
+    if (ctx->slots==NULL) {
+        return -1;
+    }
+    return (int)(atomic_load_explicit(&ctx->writeIndex,memory_order_relaxed)-atomic_load_explicit(&ctx->readIndex,memory_order_relaxed));
+}
+
+bool packet_queue_is_full(PacketQueueContext_t *ctx)
+{
+    return ctx->slots!=NULL && packet_queue_get_length(ctx)>=ctx->queueSize;
+}
+
+void packet_queue_get_diagnostics(PacketQueueContext_t *ctx,json_writer_ctx_t js)
+{
+    int64_t dequeued=atomic_load_explicit(&ctx->stats.dequeued,memory_order_relaxed);
+    int64_t totalWaitTime=atomic_load_explicit(&ctx->stats.totalWaitTime,memory_order_relaxed);
+    JSON_SERIALIZE_INT("length",packet_queue_get_length(ctx));
+    JSON_SERIALIZE_INT("maxLength",atomic_load_explicit(&ctx->stats.maxLength,memory_order_relaxed));
+    JSON_SERIALIZE_INT64("avgWaitTimeUs",dequeued>0 ? totalWaitTime/dequeued : 0);
+    JSON_SERIALIZE_INT64("maxWaitTimeUs",(int64_t)atomic_load_explicit(&ctx->stats.maxWaitTime,memory_order_relaxed));
+    JSON_SERIALIZE_INT64("producerBlockedTimeUs",(int64_t)atomic_load_explicit(&ctx->stats.producerBlockedTime,memory_order_relaxed));
+}
+
 int packet_queue_init(PacketQueueContext_t *ctx)
 {
-     int ret;
-     av_thread_message_queue_alloc(&ctx->queue,ctx->queueSize,sizeof(FifoMessage));
+    int ret;
+    atomic_init(&ctx->writeIndex,0);
+    atomic_init(&ctx->readIndex,0);
+    atomic_init(&ctx->stats.maxLength,0);
+    atomic_init(&ctx->stats.dequeued,0);
+    atomic_init(&ctx->stats.totalWaitTime,0);
+    atomic_init(&ctx->stats.maxWaitTime,0);
+    atomic_init(&ctx->stats.producerBlockedTime,0);
+    latency_histogram_init(&ctx->stats.waitTime);
+    ctx->notEmpty.readFd=ctx->notEmpty.writeFd=-1;
+    ctx->notFull.readFd=ctx->notFull.writeFd=-1;
+
+    ctx->slots=av_mallocz_array(ctx->queueSize,sizeof(FifoMessage));
+    if (ctx->slots==NULL) {
+        return AVERROR(ENOMEM);
+    }
+    for (int i=0;i<ctx->queueSize;i++) {
+        ctx->slots[i].pkt=av_packet_alloc();
+        if (ctx->slots[i].pkt==NULL) {
+            ret=AVERROR(ENOMEM);
+            goto error;
+        }
+    }
+
+    if ((ret=packet_queue_event_init(&ctx->notEmpty))<0 ||
+        (ret=packet_queue_event_init(&ctx->notFull))<0) {
+        LOGGER(CATEGORY_PACKET_QUEUE, AV_LOG_ERROR, "Failed to create wakeup event: %s", av_err2str(ret));
+        goto error;
+    }
+
+    if (ctx->workerPool!=NULL) {
+        worker_pool_lane_init(&ctx->lane,ctx->workerPool,packet_queue_run_lane,ctx,WORKER_POOL_PRIORITY_NORMAL);
+        return 0;
+    }
+
+    ret = pthread_create(&ctx->thread, NULL, fifo_consumer_thread, ctx);
+    if (ret) {
+        LOGGER(CATEGORY_PACKET_QUEUE, AV_LOG_ERROR, "Failed to start thread: %s", av_err2str(AVERROR(ret)));
+        ret=AVERROR(ret);
+        goto error;
+    }
 
-     ret = pthread_create(&ctx->thread, NULL, fifo_consumer_thread, ctx);
-     if (ret) {
-          LOGGER(CATEGORY_PACKET_QUEUE, AV_LOG_ERROR, "Failed to start thread: %s", av_err2str(AVERROR(ret)));
-          return AVERROR(ret);
-      }
+    return 0;
 
-     return ret;
+error:
+    packet_queue_event_close(&ctx->notEmpty);
+    packet_queue_event_close(&ctx->notFull);
+    for (int i=0;i<ctx->queueSize;i++) {
+        av_packet_free(&ctx->slots[i].pkt);
+    }
+    av_freep(&ctx->slots);
+    return ret;
 }
 
 void packet_queue_destroy(PacketQueueContext_t *ctx)
 {
+    if (ctx->slots==NULL) {
+        return;
+    }
     LOGGER0(CATEGORY_PACKET_QUEUE, AV_LOG_INFO, "Destroying packet queue");
     packet_queue_write_stop(ctx);
 
-    pthread_join(ctx->thread,NULL);
-    av_thread_message_queue_free(&ctx->queue);
-}
-
+    if (ctx->workerPool!=NULL) {
+        worker_pool_lane_wait_idle(&ctx->lane);
+    } else {
+        pthread_join(ctx->thread,NULL);
+    }
 
+    packet_queue_event_close(&ctx->notEmpty);
+    packet_queue_event_close(&ctx->notFull);
+    for (int i=0;i<ctx->queueSize;i++) {
+        av_packet_free(&ctx->slots[i].pkt);
+    }
+    av_freep(&ctx->slots);
+}
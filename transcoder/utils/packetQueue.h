@@ -10,23 +10,16 @@
 #define packetQueue_h
 
 #include <stdio.h>
+#include <stdatomic.h>
 #include "../core.h"
 
-#include "libavutil/threadmessage.h"
 #include "../KMP/KMP.h"
+#include "workerPool.h"
+#include "latencyTracer.h"
 
 typedef int packet_queue_packetCB(void* cbContext,AVPacket* packet);
 typedef int packet_queue_mediaInfoCB(void* cbContext,transcode_mediaInfo_t* mediaInfo);
 
-typedef struct  {
-    pthread_t thread;
-    int queueSize;
-    AVThreadMessageQueue *queue;
-    void* callbackContext;
-    packet_queue_packetCB*  onPacket;
-    packet_queue_mediaInfoCB*  onMediaInfo;
-} PacketQueueContext_t;
-
 
 typedef enum FifoMessageType {
     FIFO_WRITE_NOPS,
@@ -36,17 +29,62 @@ typedef enum FifoMessageType {
 } FifoMessageType;
 
 
+// ring slot, pkt is allocated once in packet_queue_init and reused
 typedef struct FifoMessage {
     FifoMessageType type;
     AVPacket* pkt;
     transcode_mediaInfo_t* mediaInfo;
+    uint64_t enqueueTime;
 } FifoMessage;
 
+// wakes up the other side of the ring, an eventfd on linux
+typedef struct {
+    int readFd;
+    int writeFd;
+    atomic_int waiting;
+} PacketQueueEvent_t;
+
+typedef struct {
+    atomic_int maxLength;
+    atomic_int_fast64_t dequeued;
+    atomic_int_fast64_t totalWaitTime;
+    atomic_int_fast64_t maxWaitTime;
+    atomic_int_fast64_t producerBlockedTime;
+    latency_histogram_t waitTime;
+} PacketQueueStats_t;
+
+// bounded single producer / single consumer ring
+typedef struct  {
+    pthread_t thread;
+    int queueSize;
+    FifoMessage* slots;
+    atomic_uint_fast64_t writeIndex;    // advanced by the producer only
+    char pad1[64];
+    atomic_uint_fast64_t readIndex;     // advanced by the consumer only
+    char pad2[64];
+    PacketQueueEvent_t notEmpty;
+    PacketQueueEvent_t notFull;
+    PacketQueueStats_t stats;
+    void* callbackContext;
+    packet_queue_packetCB*  onPacket;
+    packet_queue_mediaInfoCB*  onMediaInfo;
+    // when set, the ring is consumed by a lane of the shared pool instead of a dedicated thread
+    worker_pool_t* workerPool;
+    worker_pool_lane_t lane;
+} PacketQueueContext_t;
+
 #define CATEGORY_PACKET_QUEUE "CATEGORY_PACKET_QUEUE"
 
+// moves the packet's reference into the queue, the caller still owns (and frees) pkt
 int packet_queue_write_packet(PacketQueueContext_t *ctx, AVPacket *pkt);
 int packet_queue_write_mediaInfo(PacketQueueContext_t *ctx, transcode_mediaInfo_t *mediaInfo);
 
+// number of queued messages, -1 if the queue is not running
+int packet_queue_get_length(PacketQueueContext_t *ctx);
+// true when the next write would block, called by the producer
+bool packet_queue_is_full(PacketQueueContext_t *ctx);
+void packet_queue_get_diagnostics(PacketQueueContext_t *ctx,json_writer_ctx_t js);
+
 void* fifo_consumer_thread(void* params);
 int packet_queue_init(PacketQueueContext_t *ctx);
 void packet_queue_destroy(PacketQueueContext_t *ctx);
@@ -10,7 +10,7 @@
 #include "json_parser.h"
 
 // forward declarations
-static void doThrottle(float maxDataRate,
+static int64_t getThrottleWait(float maxDataRate,
     double minThrottleWaitMs,
     samples_stats_t *stats,
     AVRational targetFramerate);
@@ -37,6 +37,14 @@ throttler_init(samples_stats_t *stats,throttler_t *throttler) {
 
 void
 throttler_process(throttler_t *throttler,transcode_session_t *transcode_session) {
+    int64_t throttleWaitUSec = throttler_get_wait(throttler,transcode_session);
+    if(throttleWaitUSec > 0) {
+        av_usleep(throttleWaitUSec);
+    }
+}
+
+int64_t
+throttler_get_wait(throttler_t *throttler,transcode_session_t *transcode_session) {
    if(throttler && throttler->maxDataRate < INFINITY) {
         const transcode_mediaInfo_t *mediaInfo = transcode_session ? transcode_session->currentMediaInfo : NULL;
         if(mediaInfo && mediaInfo->codecParams){
@@ -59,12 +67,13 @@ throttler_process(throttler_t *throttler,transcode_session_t *transcode_session)
                 }
             }
 
-            doThrottle(throttler->maxDataRate,
+            return getThrottleWait(throttler->maxDataRate,
                 throttler->minThrottleWaitMs,
                 throttler->stats,
                 frameRate);
         }
     }
+    return 0;
 }
 
 // implementation:
@@ -113,8 +122,8 @@ int64_t calculateThrottleWindow(samples_stats_t *stats,AVRational targetFramerat
 }
 
 static
-void
-doThrottle(float maxDataRate,
+int64_t
+getThrottleWait(float maxDataRate,
     double minThrottleWaitMs,
     samples_stats_t *stats,
     AVRational targetFramerate)
@@ -140,7 +149,8 @@ doThrottle(float maxDataRate,
              __FUNCTION__,
              throttleWaitUSec / 1000.f);
              stats->throttleWait += av_rescale_q(throttleWaitUSec, clockScale, standard_timebase);
-             av_usleep(throttleWaitUSec);
+             return throttleWaitUSec;
          }
      }
+     return 0;
 }
\ No newline at end of file
@@ -18,4 +18,8 @@ int throttler_init(samples_stats_t *stats,throttler_t *throttler);
 void
 throttler_process(throttler_t *throttler,transcode_session_t *session);
 
+// the non-blocking form of throttler_process, returns the time (microseconds) the input should wait
+int64_t
+throttler_get_wait(throttler_t *throttler,transcode_session_t *session);
+
 #endif
\ No newline at end of file
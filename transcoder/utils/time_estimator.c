@@ -12,10 +12,14 @@
 
 void clock_estimator_init(clock_estimator_t *fifo) {
     fifo->framesFifoHead= fifo->framesFifoTail=-1;
-
+    pthread_mutex_init(&fifo->locker,NULL);
+}
+void clock_estimator_destroy(clock_estimator_t *fifo) {
+    pthread_mutex_destroy(&fifo->locker);
 }
 void clock_estimator_push_frame(clock_estimator_t *fifo,int64_t dts,int64_t clock)
 {
+    pthread_mutex_lock(&fifo->locker);
     if (fifo->framesFifoTail==-1) {
         fifo->framesFifoTail=fifo->framesFifoHead=0;
     } else {
@@ -27,15 +31,18 @@ void clock_estimator_push_frame(clock_estimator_t *fifo,int64_t dts,int64_t cloc
     clock_estimator_sample_t* sample=&(fifo->samples[fifo->framesFifoHead  %  TIME_ESTIMATOR_FIFO_SIZE]);
     sample->clock=clock;
     sample->dts=dts;
+    pthread_mutex_unlock(&fifo->locker);
 }
 
 uint64_t clock_estimator_get_clock(clock_estimator_t *fifo,int64_t dts)
 {
+    int64_t distance=__INT64_MAX__;
+    int64_t clock=0;
+    pthread_mutex_lock(&fifo->locker);
     if (fifo->framesFifoTail==-1) {
+        pthread_mutex_unlock(&fifo->locker);
         return 0;
     }
-    int64_t distance=__INT64_MAX__;
-    int64_t clock=0;
     for (int64_t runner=fifo->framesFifoHead;runner>=fifo->framesFifoTail;runner--) {
         clock_estimator_sample_t* sample=&(fifo->samples[runner %  TIME_ESTIMATOR_FIFO_SIZE]);
         int64_t runnerdistance=llabs(dts - sample->dts);
@@ -54,5 +61,6 @@ uint64_t clock_estimator_get_clock(clock_estimator_t *fifo,int64_t dts)
             break;
         }
     }
+    pthread_mutex_unlock(&fifo->locker);
     return clock;
 }
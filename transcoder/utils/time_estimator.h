@@ -23,10 +23,12 @@ typedef struct {
 typedef struct {
     int64_t framesFifoHead,framesFifoTail;
     clock_estimator_sample_t samples[TIME_ESTIMATOR_FIFO_SIZE];
+    pthread_mutex_t locker; // pushed by the input thread, read by encoder threads
 } clock_estimator_t;
 
 
 void clock_estimator_init(clock_estimator_t *fifo);
+void clock_estimator_destroy(clock_estimator_t *fifo);
 void clock_estimator_push_frame(clock_estimator_t *fifo,int64_t dts,int64_t clock);
 uint64_t clock_estimator_get_clock(clock_estimator_t *fifo,int64_t dts);
 
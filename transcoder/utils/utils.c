@@ -265,6 +265,11 @@ void log_frame_side_data(const char* category,const AVFrame *pFrame)
 }
 
 int add_packet_frame_id_and_pts(AVPacket *packet,int64_t frame_id,pts_t pts) {
+     return add_packet_frame_metadata(packet,frame_id,pts,0);
+}
+
+// the dictionary ends up in the metadata of the decoded frame
+int add_packet_frame_metadata(AVPacket *packet,int64_t frame_id,pts_t pts,int64_t receiveTime) {
      AVDictionary * frameDict = NULL;
      size_t frameDictSize = 0;
      char buf[sizeof("9223372036854775807")];
@@ -273,6 +278,10 @@ int add_packet_frame_id_and_pts(AVPacket *packet,int64_t frame_id,pts_t pts) {
      _S(av_dict_set(&frameDict, "frame_id", buf, 0));
      sprintf(buf,"%lld",pts);
      _S(av_dict_set(&frameDict, "pts", buf, 0));
+     if (receiveTime>0) {
+         sprintf(buf,"%lld",receiveTime);
+         _S(av_dict_set(&frameDict, "recv_time", buf, 0));
+     }
      // Pack dictionary to be able to use it as a side data in AVPacket
      frameDictData = av_packet_pack_dictionary(frameDict, &frameDictSize);
      if(!frameDictData)
@@ -301,6 +310,23 @@ int get_packet_frame_id(const AVPacket *packet,int64_t *frame_id_ptr)
     return 0;
 }
 
+int get_packet_receive_time(const AVPacket *packet,int64_t *time_ptr)
+{
+     AVDictionary * frameDict = NULL;
+     AVDictionaryEntry * entry;
+     size_t frameDictSize = 0;
+     uint8_t *frameDictData = av_packet_get_side_data(packet, AV_PKT_DATA_STRINGS_METADATA, &frameDictSize);
+     *time_ptr = 0;
+     if (!frameDictData)
+        return AVERROR(EINVAL);
+    _S(av_packet_unpack_dictionary(frameDictData,frameDictSize,&frameDict));
+    entry = av_dict_get(frameDict, "recv_time", NULL, 0);
+    if(entry)
+       *time_ptr = strtoll(entry->value,NULL,10);
+    av_dict_free(&frameDict);
+    return entry ? 0 : AVERROR(EINVAL);
+}
+
 int get_packet_original_pts(const AVPacket *packet,pts_t *pts_ptr)
 {
     const char *pts_str;
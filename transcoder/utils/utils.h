@@ -35,6 +35,9 @@ char* av_socket_info(char* buf,int len,const struct sockaddr_in* sa);
 void log_frame_side_data(const char* category,const AVFrame *pFrame);
 typedef int64_t pts_t;
 int add_packet_frame_id_and_pts(AVPacket *packet,int64_t frame_id,pts_t pts);
+// receiveTime (getTime64) is used for the latency tracing, 0 to leave it out
+int add_packet_frame_metadata(AVPacket *packet,int64_t frame_id,pts_t pts,int64_t receiveTime);
+int get_packet_receive_time(const AVPacket *packet,int64_t *time_ptr);
 int get_frame_id(const AVFrame *frame,uint64_t *frame_id_ptr);
 int get_packet_frame_id(const AVPacket *packet,int64_t *frame_id_ptr);
 int get_packet_original_pts(const AVPacket *packet,pts_t *pts_ptr);
@@ -0,0 +1,240 @@
+#include "workerPool.h"
+#include <unistd.h>
+
+
+// caller holds pool->lock
+static void worker_pool_enqueue(worker_pool_t *pool,worker_pool_lane_t *lane)
+{
+    worker_pool_run_queue_t *runQueue=&pool->runQueue[lane->priority];
+    lane->next=NULL;
+    if (runQueue->tail!=NULL) {
+        runQueue->tail->next=lane;
+    } else {
+        runQueue->head=lane;
+    }
+    runQueue->tail=lane;
+    lane->queued=true;
+    pthread_cond_signal(&pool->workCond);
+}
+
+// caller holds pool->lock
+static worker_pool_lane_t* worker_pool_dequeue(worker_pool_t *pool)
+{
+    for (int priority=0;priority<WORKER_POOL_PRIORITIES;priority++) {
+        worker_pool_run_queue_t *runQueue=&pool->runQueue[priority];
+        worker_pool_lane_t *lane=runQueue->head;
+        if (lane!=NULL) {
+            runQueue->head=lane->next;
+            if (runQueue->head==NULL) {
+                runQueue->tail=NULL;
+            }
+            lane->next=NULL;
+            lane->queued=false;
+            return lane;
+        }
+    }
+    return NULL;
+}
+
+// caller holds pool->lock
+static void worker_pool_remove(worker_pool_t *pool,worker_pool_lane_t *lane)
+{
+    for (int priority=0;priority<WORKER_POOL_PRIORITIES;priority++) {
+        worker_pool_run_queue_t *runQueue=&pool->runQueue[priority];
+        worker_pool_lane_t *prev=NULL;
+        for (worker_pool_lane_t *cur=runQueue->head;cur!=NULL;prev=cur,cur=cur->next) {
+            if (cur!=lane) {
+                continue;
+            }
+            if (prev!=NULL) {
+                prev->next=cur->next;
+            } else {
+                runQueue->head=cur->next;
+            }
+            if (runQueue->tail==cur) {
+                runQueue->tail=prev;
+            }
+            lane->next=NULL;
+            lane->queued=false;
+            return;
+        }
+    }
+}
+
+// called without the lock, with lane->running already set
+static void worker_pool_run_lane(worker_pool_t *pool,worker_pool_lane_t *lane)
+{
+    // cleared before running, so work queued from now on schedules the lane again
+    atomic_store(&lane->signaled,false);
+    int more=lane->run(lane->context);
+    atomic_fetch_add_explicit(&pool->totalRuns,1,memory_order_relaxed);
+
+    pthread_mutex_lock(&pool->lock);
+    lane->running=false;
+    if (more>0 || atomic_load(&lane->signaled)) {
+        worker_pool_enqueue(pool,lane);
+    }
+    pthread_cond_broadcast(&pool->idleCond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void* worker_pool_thread(void* params)
+{
+    worker_pool_t *pool=(worker_pool_t *)params;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        worker_pool_lane_t *lane=worker_pool_dequeue(pool);
+        if (lane==NULL) {
+            if (pool->stopping) {
+                break;
+            }
+            pthread_cond_wait(&pool->workCond,&pool->lock);
+            continue;
+        }
+        lane->running=true;
+        pthread_mutex_unlock(&pool->lock);
+        worker_pool_run_lane(pool,lane);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int worker_pool_init(worker_pool_t *pool,int threads)
+{
+    if (threads<=0) {
+        threads=(int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads<=0) {
+            threads=1;
+        }
+    }
+    pool->threads=0;
+    pool->stopping=false;
+    atomic_init(&pool->totalRuns,0);
+    atomic_init(&pool->totalHelps,0);
+    for (int priority=0;priority<WORKER_POOL_PRIORITIES;priority++) {
+        pool->runQueue[priority].head=pool->runQueue[priority].tail=NULL;
+    }
+    pool->thread=av_mallocz_array(threads,sizeof(pthread_t));
+    if (pool->thread==NULL) {
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_init(&pool->lock,NULL);
+    pthread_cond_init(&pool->workCond,NULL);
+    pthread_cond_init(&pool->idleCond,NULL);
+
+    for (int i=0;i<threads;i++) {
+        int ret=pthread_create(&pool->thread[i],NULL,worker_pool_thread,pool);
+        if (ret) {
+            LOGGER(CATEGORY_WORKER_POOL,AV_LOG_ERROR,"Failed to start worker thread: %s",av_err2str(AVERROR(ret)));
+            worker_pool_destroy(pool);
+            return AVERROR(ret);
+        }
+        pool->threads++;
+    }
+    LOGGER(CATEGORY_WORKER_POOL,AV_LOG_INFO,"Started worker pool with %d threads",pool->threads);
+    return 0;
+}
+
+void worker_pool_destroy(worker_pool_t *pool)
+{
+    if (pool->thread==NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping=true;
+    pthread_cond_broadcast(&pool->workCond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i=0;i<pool->threads;i++) {
+        pthread_join(pool->thread[i],NULL);
+    }
+    pthread_cond_destroy(&pool->workCond);
+    pthread_cond_destroy(&pool->idleCond);
+    pthread_mutex_destroy(&pool->lock);
+    av_freep(&pool->thread);
+    LOGGER0(CATEGORY_WORKER_POOL,AV_LOG_INFO,"Stopped worker pool");
+}
+
+void worker_pool_get_diagnostics(worker_pool_t *pool,json_writer_ctx_t js)
+{
+    int queued[WORKER_POOL_PRIORITIES]={0};
+    pthread_mutex_lock(&pool->lock);
+    for (int priority=0;priority<WORKER_POOL_PRIORITIES;priority++) {
+        for (worker_pool_lane_t *lane=pool->runQueue[priority].head;lane!=NULL;lane=lane->next) {
+            queued[priority]++;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    JSON_SERIALIZE_INT("threads",pool->threads);
+    JSON_SERIALIZE_INT("queuedHighPriority",queued[WORKER_POOL_PRIORITY_HIGH]);
+    JSON_SERIALIZE_INT("queuedNormalPriority",queued[WORKER_POOL_PRIORITY_NORMAL]);
+    JSON_SERIALIZE_INT64("totalRuns",(int64_t)atomic_load_explicit(&pool->totalRuns,memory_order_relaxed));
+    JSON_SERIALIZE_INT64("totalHelps",(int64_t)atomic_load_explicit(&pool->totalHelps,memory_order_relaxed));
+}
+
+void worker_pool_lane_init(worker_pool_lane_t *lane,worker_pool_t *pool,worker_pool_runCB* run,void* context,int priority)
+{
+    lane->pool=pool;
+    lane->run=run;
+    lane->context=context;
+    lane->priority=priority;
+    atomic_init(&lane->signaled,false);
+    lane->queued=false;
+    lane->running=false;
+    lane->next=NULL;
+}
+
+void worker_pool_lane_set_priority(worker_pool_lane_t *lane,int priority)
+{
+    // a lane that is already queued keeps its place, the priority applies from its next run
+    pthread_mutex_lock(&lane->pool->lock);
+    lane->priority=priority;
+    pthread_mutex_unlock(&lane->pool->lock);
+}
+
+void worker_pool_lane_schedule(worker_pool_lane_t *lane)
+{
+    // already pending, the lane will pick up the new work
+    if (atomic_exchange(&lane->signaled,true)) {
+        return;
+    }
+    worker_pool_t *pool=lane->pool;
+    pthread_mutex_lock(&pool->lock);
+    // a running lane is queued again by its worker once it sees the signal
+    if (!lane->queued && !lane->running) {
+        worker_pool_enqueue(pool,lane);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_lane_help(worker_pool_lane_t *lane)
+{
+    worker_pool_t *pool=lane->pool;
+    pthread_mutex_lock(&pool->lock);
+    if (lane->running) {
+        pthread_cond_wait(&pool->idleCond,&pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    // steal the lane from the run queue, a producer that is itself a worker
+    // would otherwise block a pool thread waiting for work no thread picks up
+    if (lane->queued) {
+        worker_pool_remove(pool,lane);
+    }
+    lane->running=true;
+    pthread_mutex_unlock(&pool->lock);
+    atomic_fetch_add_explicit(&pool->totalHelps,1,memory_order_relaxed);
+    worker_pool_run_lane(pool,lane);
+}
+
+void worker_pool_lane_wait_idle(worker_pool_lane_t *lane)
+{
+    worker_pool_t *pool=lane->pool;
+    pthread_mutex_lock(&pool->lock);
+    while (lane->queued || lane->running || atomic_load(&lane->signaled)) {
+        pthread_cond_wait(&pool->idleCond,&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
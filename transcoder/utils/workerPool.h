@@ -0,0 +1,69 @@
+#ifndef workerPool_h
+#define workerPool_h
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "../core.h"
+
+// work items run per lane call before the lane goes back to the end of the run queue
+#define WORKER_POOL_QUANTUM 8
+
+typedef enum {
+    WORKER_POOL_PRIORITY_HIGH,      // audio
+    WORKER_POOL_PRIORITY_NORMAL,    // video
+    WORKER_POOL_PRIORITIES
+} worker_pool_priority_t;
+
+// drains up to WORKER_POOL_QUANTUM work items, returns >0 if work is left
+typedef int worker_pool_runCB(void* context);
+
+struct worker_pool_s;
+
+// a serial unit of work (a queue consumer), runs on one worker at a time
+typedef struct worker_pool_lane_s {
+    struct worker_pool_s* pool;
+    worker_pool_runCB* run;
+    void* context;
+    int priority;
+    atomic_bool signaled;
+    bool queued;
+    bool running;
+    struct worker_pool_lane_s* next;
+} worker_pool_lane_t;
+
+typedef struct {
+    worker_pool_lane_t* head;
+    worker_pool_lane_t* tail;
+} worker_pool_run_queue_t;
+
+typedef struct worker_pool_s {
+    int threads;
+    pthread_t* thread;
+    pthread_mutex_t lock;
+    pthread_cond_t workCond;        // a lane was queued
+    pthread_cond_t idleCond;        // a lane finished running
+    worker_pool_run_queue_t runQueue[WORKER_POOL_PRIORITIES];
+    bool stopping;
+    atomic_int_fast64_t totalRuns;
+    atomic_int_fast64_t totalHelps;
+} worker_pool_t;
+
+#define CATEGORY_WORKER_POOL "CATEGORY_WORKER_POOL"
+
+// threads<=0 starts one worker per online cpu
+int worker_pool_init(worker_pool_t *pool,int threads);
+void worker_pool_destroy(worker_pool_t *pool);
+void worker_pool_get_diagnostics(worker_pool_t *pool,json_writer_ctx_t js);
+
+void worker_pool_lane_init(worker_pool_lane_t *lane,worker_pool_t *pool,worker_pool_runCB* run,void* context,int priority);
+void worker_pool_lane_set_priority(worker_pool_lane_t *lane,int priority);
+// called by the producer after queuing work for the lane
+void worker_pool_lane_schedule(worker_pool_lane_t *lane);
+// called by a producer blocked on the lane's full queue, runs the lane on the calling thread
+// unless a worker is already running it, in which case it waits for some lane to complete a run
+void worker_pool_lane_help(worker_pool_lane_t *lane);
+// waits until all the work scheduled on the lane was processed
+void worker_pool_lane_wait_idle(worker_pool_lane_t *lane);
+
+#endif /* workerPool_h */